@@ -0,0 +1,97 @@
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include "alphabet.h"
+
+using namespace std;
+
+
+struct AlphabetChoice {
+    string name = "latin";
+    unique_ptr<Alphabet> custom;
+    const Alphabet* alphabet = &LATIN_ALPHABET;
+};
+
+static const AlphabetChoice& alphabet_choice() {
+    static const AlphabetChoice choice = [] {
+        AlphabetChoice result;
+        const char* value = getenv("LAB_ALPHABET");
+        if (!value || !*value) return result;
+
+        string setting = value;
+        const string CUSTOM = "custom:";
+        if (setting == "latin") {
+            return result;
+        }
+        if (setting == "ukrainian") {
+            result.name = setting;
+            result.alphabet = &UKRAINIAN_ALPHABET;
+            return result;
+        }
+        if (setting.rfind(CUSTOM, 0) == 0) {
+            try {
+                result.custom = make_unique<Alphabet>(setting.substr(CUSTOM.size()));
+                result.name = "custom";
+                result.alphabet = result.custom.get();
+            }
+            catch (const exception& e) {
+                cerr << "LAB_ALPHABET: " << e.what() << "; using latin" << endl;
+            }
+            return result;
+        }
+        cerr << "LAB_ALPHABET must be latin, ukrainian or custom:<symbols>; using latin" << endl;
+        return result;
+    }();
+    return choice;
+}
+
+const Alphabet& lab_alphabet() {
+    return *alphabet_choice().alphabet;
+}
+
+const string& lab_alphabet_name() {
+    return alphabet_choice().name;
+}
+
+
+// Case conversion table for the code points below ALPHABET_CODE_POINTS
+template <char32_t (*Convert)(char32_t)>
+struct CaseTable {
+    char16_t to[ALPHABET_CODE_POINTS] = {};
+
+    constexpr CaseTable() {
+        for (char32_t c = 0; c < ALPHABET_CODE_POINTS; c++) to[c] = char16_t(Convert(c));
+    }
+};
+
+// Both cases of the letters lower_case/upper_case know are 1 byte (ASCII)
+// or 2 bytes (Latin-1 and Cyrillic), so the text is rewritten in place.
+// The 1- and 2-byte cases share one branch-free path, like in decode_utf8.
+// With Lookup::ConstantTime every 1- and 2-byte character is converted by
+// CtConvert instead of the table (the result is the same)
+template <char32_t (*Convert)(char32_t), char32_t (*CtConvert)(char32_t), Lookup L>
+static void convert_case(char* text, size_t size) {
+    static constexpr CaseTable<Convert> table;
+    char* p = text;
+    char* end = text + size;
+    while (p < end) {
+        char32_t c;
+        size_t length = decode_utf8(p, end, c);
+        if (L == Lookup::ConstantTime ? length <= 2 && c != REPLACEMENT_CHARACTER : c < ALPHABET_CODE_POINTS) {
+            char32_t to = L == Lookup::ConstantTime ? CtConvert(c) : char32_t(table.to[c]);
+            char first = length == 1 ? char(to) : char(0xC0 | (to >> 6));
+            char second = char(0x80 | (to & 0x3F));
+            p[0] = first;
+            p[length - 1] = length == 1 ? first : second;
+        }
+        p += length;
+    }
+}
+
+void to_lower_utf8(char* text, size_t size) {
+    with_lookup([&](auto lookup) { convert_case<lower_case, ct_lower_case, lookup>(text, size); });
+}
+
+void to_upper_utf8(char* text, size_t size) {
+    with_lookup([&](auto lookup) { convert_case<upper_case, ct_upper_case, lookup>(text, size); });
+}
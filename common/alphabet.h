@@ -0,0 +1,383 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "constant_time.h"
+
+
+// Alphabets of the classical ciphers and of the lab1 analyzer.
+//
+// An alphabet is an ordered list of up to ALPHABET_MAX Unicode symbols,
+// given as a UTF-8 string; the position of a symbol is its cipher index.
+// The constructor is constexpr, so for the built-in alphabets the compiler
+// decodes the list and generates the dense code point -> index table; a
+// custom alphabet (LAB_ALPHABET=custom:...) is built the same way at run time.
+//
+// Lookups ignore the case of Latin and Cyrillic letters, the output always
+// uses the symbols as listed. The walks over a text take a Lookup: Fast
+// indexes the tables by the character, ConstantTime scans them whole
+// (see constant_time.h). Code points of the symbols must be below
+// ALPHABET_CODE_POINTS (ASCII, Latin-1 and Cyrillic), everything else in a
+// text is never a symbol and is copied as is.
+
+const int ALPHABET_MAX = 64;
+const char32_t ALPHABET_CODE_POINTS = 0x500;
+const char32_t REPLACEMENT_CHARACTER = 0xFFFD;
+
+constexpr char32_t lower_case(char32_t c) {
+    if (c >= 'A' && c <= 'Z') return c + 0x20;
+    if (c >= 0xC0 && c <= 0xDE && c != 0xD7) return c + 0x20;
+    if (c >= 0x410 && c <= 0x42F) return c + 0x20;
+    if (c >= 0x400 && c <= 0x40F) return c + 0x50;
+    if (c == 0x490) return 0x491;
+    return c;
+}
+
+constexpr char32_t upper_case(char32_t c) {
+    if (c >= 'a' && c <= 'z') return c - 0x20;
+    if (c >= 0xE0 && c <= 0xFE && c != 0xF7) return c - 0x20;
+    if (c >= 0x430 && c <= 0x44F) return c - 0x20;
+    if (c >= 0x450 && c <= 0x45F) return c - 0x50;
+    if (c == 0x491) return 0x490;
+    return c;
+}
+
+// lower_case and upper_case as masked arithmetic, for Lookup::ConstantTime
+inline uint32_t ct_range_mask(char32_t c, uint32_t low, uint32_t high) {
+    return ~ct_less_mask(uint32_t(c), low) & ct_less_mask(uint32_t(c), high + 1);
+}
+
+inline char32_t ct_lower_case(char32_t c) {
+    uint32_t letter = ct_range_mask(c, 'A', 'Z') | (ct_range_mask(c, 0xC0, 0xDE) & ~ct_equal_mask(c, 0xD7)) |
+        ct_range_mask(c, 0x410, 0x42F);
+    return c + (0x20 & letter) + (0x50 & ct_range_mask(c, 0x400, 0x40F)) + (1 & ct_equal_mask(c, 0x490));
+}
+
+inline char32_t ct_upper_case(char32_t c) {
+    uint32_t letter = ct_range_mask(c, 'a', 'z') | (ct_range_mask(c, 0xE0, 0xFE) & ~ct_equal_mask(c, 0xF7)) |
+        ct_range_mask(c, 0x430, 0x44F);
+    return c - (0x20 & letter) - (0x50 & ct_range_mask(c, 0x450, 0x45F)) - (1 & ct_equal_mask(c, 0x491));
+}
+
+// Decodes the UTF-8 sequence at p (p < end) and returns its length in bytes.
+// A malformed or truncated sequence decodes to REPLACEMENT_CHARACTER one
+// byte at a time, so any byte string can be walked and copied back intact.
+constexpr size_t decode_utf8(const char* p, const char* end, char32_t& c) {
+    // ASCII and 2-byte sequences (Latin-1, Cyrillic) are told apart without
+    // a branch: in Cyrillic text with spaces and punctuation a branch on the
+    // length is mispredicted on almost every word boundary
+    unsigned char b0 = (unsigned char)p[0];
+    unsigned char b1 = end - p >= 2 ? (unsigned char)p[1] : 0;
+    bool ascii = b0 < 0x80;
+    bool pair = b0 >= 0xC2 && b0 <= 0xDF && (b1 & 0xC0) == 0x80;
+    if (ascii | pair) {
+        char32_t twoBytes = (char32_t(b0 & 0x1F) << 6) | (b1 & 0x3F);
+        c = pair ? twoBytes : char32_t(b0);
+        return 1 + size_t(pair);
+    }
+    size_t length = b0 >= 0xC2 && b0 <= 0xDF ? 2 : b0 >= 0xE0 && b0 <= 0xEF ? 3 : b0 >= 0xF0 && b0 <= 0xF4 ? 4 : 0;
+    if (length == 0 || size_t(end - p) < length) {
+        c = REPLACEMENT_CHARACTER;
+        return 1;
+    }
+    char32_t value = b0 & (0x7F >> length);
+    for (size_t i = 1; i < length; i++) {
+        unsigned char b = (unsigned char)p[i];
+        if ((b & 0xC0) != 0x80) {
+            c = REPLACEMENT_CHARACTER;
+            return 1;
+        }
+        value = (value << 6) | (b & 0x3F);
+    }
+    // Overlong forms, surrogates and values past U+10FFFF
+    if ((length == 3 && value < 0x800) || (length == 4 && (value < 0x10000 || value > 0x10FFFF)) ||
+        (value >= 0xD800 && value <= 0xDFFF)) {
+        c = REPLACEMENT_CHARACTER;
+        return 1;
+    }
+    c = value;
+    return length;
+}
+
+// Writes the UTF-8 form of c to out (at least 4 bytes) and returns its length
+constexpr size_t encode_utf8(char32_t c, char* out) {
+    if (c < 0x80) {
+        out[0] = char(c);
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = char(0xC0 | (c >> 6));
+        out[1] = char(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = char(0xE0 | (c >> 12));
+        out[1] = char(0x80 | ((c >> 6) & 0x3F));
+        out[2] = char(0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = char(0xF0 | (c >> 18));
+    out[1] = char(0x80 | ((c >> 12) & 0x3F));
+    out[2] = char(0x80 | ((c >> 6) & 0x3F));
+    out[3] = char(0x80 | (c & 0x3F));
+    return 4;
+}
+
+// Length of the longest prefix of text that does not end inside a UTF-8
+// sequence (e.g. of a file that is still being written)
+constexpr size_t utf8_complete_length(std::string_view text) {
+    size_t size = text.size();
+    for (size_t back = 1; back <= 3 && back <= size; back++) {
+        unsigned char b = (unsigned char)text[size - back];
+        if ((b & 0xC0) != 0x80) {
+            size_t length = b >= 0xF0 ? 4 : b >= 0xE0 ? 3 : b >= 0xC0 ? 2 : 1;
+            return length > back ? size - back : size;
+        }
+    }
+    return size;
+}
+
+class Alphabet {
+public:
+    constexpr explicit Alphabet(std::string_view utf8Symbols) {
+        for (char32_t c = 0; c < ALPHABET_CODE_POINTS; c++) table[c] = -1;
+        for (uint32_t& c : ctLowerCase) c = 0xFFFFFFFF;
+
+        const char* p = utf8Symbols.data();
+        const char* end = p + utf8Symbols.size();
+        while (p < end) {
+            char32_t c = 0;
+            p += decode_utf8(p, end, c);
+            if (c == REPLACEMENT_CHARACTER) throw std::runtime_error("Alphabet is not valid UTF-8");
+            if (c >= ALPHABET_CODE_POINTS) throw std::runtime_error("Alphabet symbols must be Latin or Cyrillic characters");
+            if (count == ALPHABET_MAX) throw std::runtime_error("Alphabet has more than 64 symbols");
+            if (table[c] != -1) throw std::runtime_error("Alphabet lists a symbol twice");
+
+            symbols[count] = c;
+            encodedLength[count] = uint8_t(encode_utf8(c, encoded[count]));
+            table[c] = int8_t(count);
+            table[lower_case(c)] = int8_t(count);
+            table[upper_case(c)] = int8_t(count);
+            count++;
+        }
+        if (count < 2) throw std::runtime_error("Alphabet needs at least 2 symbols");
+
+        ctCount = (count + 3) / 4 * 4;
+        for (int i = 0; i < count; i++) {
+            ctLowerCase[i] = lower_case(symbols[i]);
+            ctEncoded[i] = uint32_t(uint8_t(encoded[i][0])) | uint32_t(uint8_t(encoded[i][1])) << 8 | uint32_t(encodedLength[i]) << 24;
+        }
+
+        int shortest = 4, longest = 1;
+        for (int i = 0; i < count; i++) {
+            shortest = encodedLength[i] < shortest ? encodedLength[i] : shortest;
+            longest = encodedLength[i] > longest ? encodedLength[i] : longest;
+        }
+        expansion = (longest + shortest - 1) / shortest;
+    }
+
+    constexpr int size() const { return count; }
+
+    // Index of a code point, -1 if it is not a symbol
+    constexpr int index(char32_t c) const {
+        return c < ALPHABET_CODE_POINTS ? table[c] : -1;
+    }
+
+    // index, or with Lookup::ConstantTime the same by a scan of the lower
+    // cases of all the symbols: the lower case of a character is the lower
+    // case of a symbol exactly when index finds that symbol
+    template <Lookup L = Lookup::Fast>
+    int find(char32_t c) const {
+        if constexpr (L == Lookup::Fast) return index(c);
+        else return ct_find(ctLowerCase, size_t(ctCount), uint32_t(ct_lower_case(c)));
+    }
+
+    // Writes symbol i in UTF-8 to out (4 bytes of room) and returns its length
+    template <Lookup L = Lookup::Fast>
+    size_t encode(int i, char* out) const {
+        if constexpr (L == Lookup::Fast) {
+            memcpy(out, encoded[i], 4);
+            return encodedLength[i];
+        }
+        else {
+            // Symbols are below ALPHABET_CODE_POINTS, so at most 2 bytes
+            uint32_t packed = ct_get(ctEncoded, size_t(ctCount), size_t(i));
+            out[0] = char(packed & 0xFF);
+            out[1] = char((packed >> 8) & 0xFF);
+            return packed >> 24;
+        }
+    }
+
+    constexpr char32_t symbol(int i) const { return symbols[i]; }
+
+    std::string_view utf8(int i) const { return std::string_view(encoded[i], encodedLength[i]); }
+
+    // The symbols as a UTF-8 string (the constructor argument)
+    std::string str() const {
+        std::string result;
+        for (int i = 0; i < count; i++) result += utf8(i);
+        return result;
+    }
+
+    // Walks text calling onSymbol(index, bytes) for every symbol and
+    // onOther(bytes) for every other character (or malformed byte)
+    template <Lookup L = Lookup::Fast, typename OnSymbol, typename OnOther>
+    void for_each(std::string_view text, OnSymbol onSymbol, OnOther onOther) const {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            char32_t c;
+            size_t length = decode_utf8(p, end, c);
+            int i = find<L>(c);
+            if (i >= 0) onSymbol(i, std::string_view(p, length));
+            else onOther(std::string_view(p, length));
+            p += length;
+        }
+    }
+
+    // Calls onSymbol(index) for the symbols of text in order
+    template <Lookup L = Lookup::Fast, typename OnSymbol>
+    void scan(std::string_view text, OnSymbol onSymbol) const {
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            char32_t c;
+            p += decode_utf8(p, end, c);
+            int i = find<L>(c);
+            if (i >= 0) onSymbol(i);
+        }
+    }
+
+    // Text with every symbol replaced by the symbol at map(index);
+    // everything else is copied byte for byte
+    template <Lookup L = Lookup::Fast, typename Map>
+    std::string transform(std::string_view text, Map map) const {
+        std::string result(transform_capacity(text.size()), '\0');
+        result.resize(transform_to<L>(text, result.data(), map));
+        return result;
+    }
+
+    // Bytes transform_to may write for a text of textSize bytes
+    size_t transform_capacity(size_t textSize) const {
+        return textSize * size_t(expansion) + 4;
+    }
+
+    // transform into out, which has transform_capacity(text.size()) bytes;
+    // returns the length of the result
+    template <Lookup L = Lookup::Fast, typename Map>
+    size_t transform_to(std::string_view text, char* out, Map map) const {
+        // Every symbol is written as 4 bytes and the pointer moves by its
+        // real length, so the buffer keeps 4 spare bytes at the end
+        char* start = out;
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            char32_t c;
+            size_t length = decode_utf8(p, end, c);
+            int i = find<L>(c);
+            if (i >= 0) {
+                out += encode<L>(map(i), out);
+            }
+            else {
+                memcpy(out, p, length);
+                out += length;
+            }
+            p += length;
+        }
+        return size_t(out - start);
+    }
+
+    // transform under several maps at once: result[k] is transform(text, maps[k]).
+    // The text is decoded once, a block at a time, and every block is
+    // written out for all the maps while its decoded symbols are in L1
+    template <Lookup L = Lookup::Fast, typename Map>
+    std::vector<std::string> transform_many(std::string_view text, std::vector<Map> maps) const {
+        const size_t BLOCK = 4096;
+        int8_t indices[BLOCK];
+        uint8_t lengths[BLOCK];
+
+        std::vector<std::string> results(maps.size());
+        std::vector<char*> outs(maps.size());
+        for (size_t k = 0; k < maps.size(); k++) {
+            results[k].assign(transform_capacity(text.size()), '\0');
+            outs[k] = results[k].data();
+        }
+
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end) {
+            const char* blockStart = p;
+            size_t count = 0;
+            while (p < end && count < BLOCK) {
+                char32_t c;
+                size_t length = decode_utf8(p, end, c);
+                indices[count] = int8_t(find<L>(c));
+                lengths[count] = uint8_t(length);
+                count++;
+                p += length;
+            }
+
+            for (size_t k = 0; k < maps.size(); k++) {
+                // Local copies: stores through char* could alias the map's
+                // state (the key position) and force it out of registers
+                Map map = maps[k];
+                char* out = outs[k];
+                const char* from = blockStart;
+                for (size_t j = 0; j < count; j++) {
+                    if (indices[j] >= 0) {
+                        out += encode<L>(map(indices[j]), out);
+                    }
+                    else {
+                        memcpy(out, from, lengths[j]);
+                        out += lengths[j];
+                    }
+                    from += lengths[j];
+                }
+                maps[k] = map;
+                outs[k] = out;
+            }
+        }
+
+        for (size_t k = 0; k < maps.size(); k++) results[k].resize(size_t(outs[k] - results[k].data()));
+        return results;
+    }
+
+private:
+    char32_t symbols[ALPHABET_MAX] = {};
+    char encoded[ALPHABET_MAX][4] = {};
+    uint8_t encodedLength[ALPHABET_MAX] = {};
+    int8_t table[ALPHABET_CODE_POINTS] = {};
+    // For the constant-time lookups, ctCount entries (count rounded up to 4;
+    // the unused ones never match): the lower case of every symbol, and its
+    // UTF-8 bytes with the length in the top byte
+    uint32_t ctLowerCase[ALPHABET_MAX] = {};
+    uint32_t ctEncoded[ALPHABET_MAX] = {};
+    int ctCount = 4;
+    int count = 0;
+    int expansion = 1;  // worst-case output bytes per input byte of a symbol
+};
+
+// The alphabet of the original tools
+constexpr Alphabet LATIN_ALPHABET("abcdefghijklmnopqrstuvwxyz .,;-'");
+
+// 33 Ukrainian letters and the same punctuation
+constexpr Alphabet UKRAINIAN_ALPHABET("абвгґдеєжзиіїйклмнопрстуфхцчшщьюя .,;-'");
+
+// Alphabet of the tools: LAB_ALPHABET=latin|ukrainian|custom:<symbols>,
+// latin by default. Read once; an invalid value is reported and ignored.
+const Alphabet& lab_alphabet();
+
+// "latin", "ukrainian" or "custom"
+const std::string& lab_alphabet_name();
+
+// Case conversion of Latin and Cyrillic letters in UTF-8 text, in place
+// (the two cases of these letters have the same encoded length)
+void to_lower_utf8(char* text, size_t size);
+void to_upper_utf8(char* text, size_t size);
+
+inline void to_lower_utf8(std::string& text) { to_lower_utf8(text.data(), text.size()); }
+inline void to_upper_utf8(std::string& text) { to_upper_utf8(text.data(), text.size()); }
@@ -0,0 +1,25 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+
+
+// Monotonic arena for the transient buffers of one job. Allocation is a
+// pointer bump, deallocation is a no-op and everything goes back to the heap
+// in one shot when the arena is destroyed at the end of the job. With a size
+// hint that covers the job, the heap is hit a constant number of times
+// whatever the input size.
+class JobArena {
+public:
+    explicit JobArena(size_t sizeHint) : resource(std::max(sizeHint, MIN_SIZE)) {}
+
+    JobArena(const JobArena&) = delete;
+    JobArena& operator=(const JobArena&) = delete;
+
+    std::pmr::memory_resource* get() { return &resource; }
+
+private:
+    static constexpr size_t MIN_SIZE = 4096;
+
+    std::pmr::monotonic_buffer_resource resource;
+};
@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include "batch_files.h"
+#include "profiler.h"
+
+using namespace std;
+
+
+vector<string> read_key_list(const string& path) {
+    ifstream file(path);
+    if (!file.is_open()) throw runtime_error("Cannot open key list: " + path);
+
+    vector<string> keys;
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) keys.push_back(line);
+    }
+    if (keys.empty()) throw runtime_error("Key list has no keys: " + path);
+    return keys;
+}
+
+string batch_output_name(const string& outputName, size_t number) {
+    size_t dot = outputName.rfind('.');
+    if (dot == string::npos) return outputName + "_" + to_string(number);
+    return outputName.substr(0, dot) + "_" + to_string(number) + outputName.substr(dot);
+}
+
+void write_files_concurrently(const vector<string>& paths, vector<string>& texts,
+                              const function<void(string&)>& finish) {
+    ProfileScope scope("write outputs");
+    size_t threadCount = min(paths.size(), size_t(max(1u, thread::hardware_concurrency())));
+
+    // Files are taken from a shared counter, so a large file does not hold
+    // up the ones queued behind it on the same thread
+    atomic<size_t> next{ 0 };
+    mutex errorLock;
+    exception_ptr firstError;
+    auto writer = [&] {
+        for (size_t k = next++; k < paths.size(); k = next++) {
+            try {
+                if (finish) finish(texts[k]);
+                ofstream out(paths[k]);
+                if (!out.is_open()) throw runtime_error("Cannot open file to write: " + paths[k]);
+                out.write(texts[k].data(), streamsize(texts[k].size()));
+                if (!out) throw runtime_error("Cannot write " + paths[k]);
+            }
+            catch (...) {
+                lock_guard<mutex> guard(errorLock);
+                if (!firstError) firstError = current_exception();
+            }
+        }
+    };
+
+    vector<thread> threads;
+    for (size_t i = 1; i < threadCount; i++) threads.emplace_back(writer);
+    writer();
+    for (thread& t : threads) t.join();
+
+    for (const string& text : texts) scope.add_bytes(text.size());
+    if (firstError) rethrow_exception(firstError);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+// File side of the batch mode of lab2 and lab4 (one input, many keys):
+//
+//   labN --batch INPUT KEYS [--decrypt]
+//
+// KEYS lists one key per line. The input is read and normalized once, the
+// k-th key's result goes to output_<k>.txt, and the outputs are written by
+// several threads at once.
+
+// Keys of a batch, one per line; blank lines are skipped and a CR before
+// the line break is dropped. Throws if the file cannot be read or has no keys
+std::vector<std::string> read_key_list(const std::string& path);
+
+// Name of the output of key number (from 1): output.txt -> output_<number>.txt
+std::string batch_output_name(const std::string& outputName, size_t number);
+
+// Writes texts[k] to paths[k], up to one file per hardware thread at a time.
+// finish, if given, runs on the writing thread just before a text is
+// written (e.g. lab4's uppercasing). Throws the first error after all
+// the writers have stopped
+void write_files_concurrently(const std::vector<std::string>& paths, std::vector<std::string>& texts,
+                              const std::function<void(std::string&)>& finish = nullptr);
@@ -0,0 +1,212 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "alphabet.h"
+
+
+// Caesar and Vigenere engines over an Alphabet, templated on the alphabet
+// size. For the sizes of the built-in alphabets the modulus is a constant:
+// 32 (latin) reduces with a mask, 39 (ukrainian) with a multiply and shift.
+// Size 0 is the generic instantiation for custom alphabets, with the size
+// known only at run time. with_alphabet_size picks the instantiation.
+//
+// Shifts are kept in [0, size): decryption is encryption with size - shift,
+// so there is no negative fix-up anywhere.
+//
+// The arithmetic has no branch or division on the values, so its timing
+// does not depend on the symbols or the key (see constant_time.h); the
+// engines take a Lookup for the alphabet walks.
+
+// Arithmetic modulo the alphabet size
+template <int Size>
+class Modulo {
+public:
+    explicit Modulo(int size)
+        : runtimeSize(Size > 0 ? Size : size), reciprocal(uint32_t((uint64_t(1) << 32) / uint64_t(runtimeSize))) {}
+
+    int size() const { return Size > 0 ? Size : runtimeSize; }
+
+    // a + b for a, b in [0, size)
+    int add(int a, int b) const {
+        int sum = a + b;
+        if constexpr (Size > 0 && (Size & (Size - 1)) == 0) return sum & (Size - 1);
+        else {
+            // sum - size, plus size back if that went negative
+            int difference = sum - size();
+            return difference + (size() & (difference >> 31));
+        }
+    }
+
+    // Any non-negative value
+    int reduce(unsigned value) const {
+        if constexpr (Size > 0) return int(value % unsigned(Size));
+        else {
+            // A run-time divisor would compile to a division, whose latency
+            // may depend on the dividend. value * floor(2^32 / size) / 2^32
+            // is the quotient or one less, so one subtraction corrects it
+            const uint32_t quotient = uint32_t((uint64_t(value) * reciprocal) >> 32);
+            const uint32_t rest = value - quotient * uint32_t(runtimeSize);
+            return int(rest - (uint32_t(runtimeSize) & ~ct_less_mask(rest, uint32_t(runtimeSize))));
+        }
+    }
+
+private:
+    int runtimeSize;
+    uint32_t reciprocal;
+};
+
+// Runs fn with the alphabet size as a compile-time constant (0 for a size
+// without its own instantiation)
+template <typename Fn>
+decltype(auto) with_alphabet_size(int size, Fn fn) {
+    switch (size) {
+    case 32: return fn(std::integral_constant<int, 32>());
+    case 39: return fn(std::integral_constant<int, 39>());
+    }
+    return fn(std::integral_constant<int, 0>());
+}
+
+// Longest Vigenere key with its own instantiation: the key position then
+// wraps at a constant and the shifts stay in a fixed-size local array
+const size_t FIXED_KEY_MAX = 8;
+
+template <typename Fn>
+decltype(auto) with_key_length(size_t keyLength, Fn fn) {
+    switch (keyLength) {
+    case 1: return fn(std::integral_constant<size_t, 1>());
+    case 2: return fn(std::integral_constant<size_t, 2>());
+    case 3: return fn(std::integral_constant<size_t, 3>());
+    case 4: return fn(std::integral_constant<size_t, 4>());
+    case 5: return fn(std::integral_constant<size_t, 5>());
+    case 6: return fn(std::integral_constant<size_t, 6>());
+    case 7: return fn(std::integral_constant<size_t, 7>());
+    case 8: return fn(std::integral_constant<size_t, 8>());
+    }
+    return fn(std::integral_constant<size_t, 0>());
+}
+
+// Maps of the engines: a symbol index to the index it is replaced with.
+// Plain structs, so Alphabet::transform_many can copy them in and out
+template <int Size>
+struct CaesarMap {
+    Modulo<Size> mod;
+    int shift;
+
+    int operator()(int pos) const { return mod.add(pos, shift); }
+};
+
+// KeyLength 0: any key length; the shifts stay in the caller's vector
+template <int Size, size_t KeyLength>
+struct VigenereMap {
+    Modulo<Size> mod;
+    int key[KeyLength];
+    size_t keyIndex = 0;
+
+    VigenereMap(int size, const std::vector<int>& shifts) : mod(size) {
+        for (size_t i = 0; i < KeyLength; i++) key[i] = shifts[i];
+    }
+
+    int operator()(int pos) {
+        int to = mod.add(pos, key[keyIndex]);
+        keyIndex = keyIndex + 1 == KeyLength ? 0 : keyIndex + 1;
+        return to;
+    }
+};
+
+template <int Size>
+struct VigenereMap<Size, 0> {
+    Modulo<Size> mod;
+    const int* key;
+    size_t keyLength;
+    size_t keyIndex = 0;
+
+    VigenereMap(int size, const std::vector<int>& shifts) : mod(size), key(shifts.data()), keyLength(shifts.size()) {}
+
+    int operator()(int pos) {
+        int to = mod.add(pos, key[keyIndex]);
+        keyIndex = keyIndex + 1 == keyLength ? 0 : keyIndex + 1;
+        return to;
+    }
+};
+
+template <int Size, Lookup L = Lookup::Fast>
+std::string caesar_engine(const Alphabet& alphabet, std::string_view text, int shift) {
+    return alphabet.transform<L>(text, CaesarMap<Size>{ Modulo<Size>(alphabet.size()), shift });
+}
+
+template <int Size, size_t KeyLength, Lookup L = Lookup::Fast>
+std::string vigenere_engine(const Alphabet& alphabet, std::string_view text, const std::vector<int>& shifts) {
+    return alphabet.transform<L>(text, VigenereMap<Size, KeyLength>(alphabet.size(), shifts));
+}
+
+// Shift reduced to [0, size) (the key may be negative or larger than the alphabet)
+inline int normalize_shift(long long shift, int size) {
+    return int((shift % size + size) % size);
+}
+
+// Caesar with any shift; the lookup is the one selected for the process
+// (LAB_CONSTANT_TIME) unless given
+template <Lookup L>
+std::string caesar(const Alphabet& alphabet, std::string_view text, int shift) {
+    int normalized = normalize_shift(shift, alphabet.size());
+    return with_alphabet_size(alphabet.size(), [&](auto size) {
+        return caesar_engine<size, L>(alphabet, text, normalized);
+    });
+}
+
+inline std::string caesar(const Alphabet& alphabet, std::string_view text, int shift) {
+    return with_lookup([&](auto lookup) { return caesar<lookup>(alphabet, text, shift); });
+}
+
+// Vigenere with the key given as shifts in [0, size): the alphabet indices
+// of the key letters for encryption, size minus them for decryption
+template <Lookup L>
+std::string vigenere(const Alphabet& alphabet, std::string_view text, const std::vector<int>& shifts) {
+    return with_alphabet_size(alphabet.size(), [&](auto size) {
+        return with_key_length(shifts.size(), [&](auto keyLength) {
+            return vigenere_engine<size, keyLength, L>(alphabet, text, shifts);
+        });
+    });
+}
+
+inline std::string vigenere(const Alphabet& alphabet, std::string_view text, const std::vector<int>& shifts) {
+    return with_lookup([&](auto lookup) { return vigenere<lookup>(alphabet, text, shifts); });
+}
+
+
+// Batch forms: one text under many keys. The text is decoded once and
+// every block of it is encrypted under all the keys before the next one
+// (Alphabet::transform_many); result[k] is the text under the k-th key.
+// Any text normalization (lowercasing) is likewise done once by the caller
+
+inline std::vector<std::string> caesar_batch(const Alphabet& alphabet, std::string_view text, const std::vector<int>& shifts) {
+    return with_alphabet_size(alphabet.size(), [&](auto size) {
+        std::vector<CaesarMap<size>> maps;
+        maps.reserve(shifts.size());
+        for (int shift : shifts) {
+            maps.push_back({ Modulo<size>(alphabet.size()), normalize_shift(shift, alphabet.size()) });
+        }
+        return with_lookup([&](auto lookup) { return alphabet.transform_many<lookup>(text, std::move(maps)); });
+    });
+}
+
+// Keys of one length share the key-length instantiation, mixed lengths use the generic one
+inline std::vector<std::string> vigenere_batch(const Alphabet& alphabet, std::string_view text, const std::vector<std::vector<int>>& keys) {
+    size_t keyLength = keys.empty() ? 0 : keys[0].size();
+    for (const std::vector<int>& shifts : keys) {
+        if (shifts.size() != keyLength) keyLength = 0;
+    }
+    return with_alphabet_size(alphabet.size(), [&](auto size) {
+        return with_key_length(keyLength, [&](auto length) {
+            std::vector<VigenereMap<size, length>> maps;
+            maps.reserve(keys.size());
+            for (const std::vector<int>& shifts : keys) maps.emplace_back(alphabet.size(), shifts);
+            return with_lookup([&](auto lookup) { return alphabet.transform_many<lookup>(text, std::move(maps)); });
+        });
+    });
+}
@@ -0,0 +1,126 @@
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include "console_log.h"
+
+using namespace std;
+
+
+static ConsoleMode mode = ConsoleMode::Preview;
+
+// Queue of the writer thread: producers append to pending, the writer swaps
+// it out and writes the whole batch with one fwrite
+static mutex queueMutex;
+static condition_variable queueReady;
+static condition_variable queueDrained;
+static string pending;
+static bool writing = false;
+static bool stopping = false;
+static thread writer;
+
+
+static void writer_loop() {
+    unique_lock<mutex> lock(queueMutex);
+    while (true) {
+        queueReady.wait(lock, [] { return !pending.empty() || stopping; });
+        if (pending.empty()) return;
+
+        string batch;
+        batch.swap(pending);
+        writing = true;
+        lock.unlock();
+        fwrite(batch.data(), 1, batch.size(), stdout);
+        fflush(stdout);
+        lock.lock();
+        writing = false;
+        queueDrained.notify_all();
+    }
+}
+
+static void stop_writer() {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_one();
+    writer.join();
+}
+
+static string env_value(const char* name) {
+#ifdef _MSC_VER
+    char* value = nullptr;
+    size_t size = 0;
+    if (_dupenv_s(&value, &size, name) != 0 || !value) return "";
+    string result(value);
+    free(value);
+    return result;
+#else
+    const char* value = getenv(name);
+    return value ? value : "";
+#endif
+}
+
+
+void console_init() {
+    ConsoleMode fromEnv;
+    if (parse_console_mode(env_value("LAB_OUTPUT"), fromEnv)) mode = fromEnv;
+}
+
+bool parse_console_mode(const string& name, ConsoleMode& result) {
+    if (name == "full") result = ConsoleMode::Full;
+    else if (name == "preview") result = ConsoleMode::Preview;
+    else if (name == "quiet") result = ConsoleMode::Quiet;
+    else return false;
+    return true;
+}
+
+void set_console_mode(ConsoleMode newMode) {
+    mode = newMode;
+}
+
+ConsoleMode console_mode() {
+    return mode;
+}
+
+void console_write(string text) {
+    if (text.empty()) return;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (!writer.joinable()) {
+            // cout and the writer share stdout: whatever cout holds goes first
+            fflush(stdout);
+            writer = thread(writer_loop);
+            atexit(stop_writer);
+        }
+        if (pending.empty()) pending = move(text);
+        else pending += text;
+    }
+    queueReady.notify_one();
+}
+
+void console_text(string_view header, string_view text) {
+    string out(header);
+    if (mode == ConsoleMode::Full || text.size() <= PREVIEW_BYTES) {
+        if (mode == ConsoleMode::Quiet) out += "[" + to_string(text.size()) + " bytes]";
+        else out += text;
+    }
+    else if (mode == ConsoleMode::Preview) {
+        // Cut at a character boundary, not inside a UTF-8 sequence
+        size_t cut = PREVIEW_BYTES;
+        while (cut > 0 && (static_cast<unsigned char>(text[cut]) & 0xC0) == 0x80) cut--;
+        out += text.substr(0, cut);
+        out += "\n... [" + to_string(text.size() - cut) + " more bytes]";
+    }
+    else {
+        out += "[" + to_string(text.size()) + " bytes]";
+    }
+    out += '\n';
+    console_write(move(out));
+}
+
+void console_flush() {
+    unique_lock<mutex> lock(queueMutex);
+    queueDrained.wait(lock, [] { return pending.empty() && !writing; });
+}
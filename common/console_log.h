@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+
+// Console echo of the texts the tools process.
+//
+//   full    - whole texts, as the tools always printed them
+//   preview - the first PREVIEW_BYTES of every text and a note about the rest (default)
+//   quiet   - only the size of every text
+//
+// Selected with LAB_OUTPUT=full|preview|quiet (lab6 also takes
+// --output MODE). The text goes to an in-memory queue that a background
+// thread writes to stdout, so the processing thread never waits for the
+// terminal.
+
+enum class ConsoleMode { Full, Preview, Quiet };
+
+const size_t PREVIEW_BYTES = 2048;
+
+// Reads LAB_OUTPUT; call first thing in main
+void console_init();
+
+bool parse_console_mode(const std::string& name, ConsoleMode& mode);
+void set_console_mode(ConsoleMode mode);
+ConsoleMode console_mode();
+
+// Queues text for stdout as is
+void console_write(std::string text);
+
+// Queues header, then text (or its preview), then a line break
+void console_text(std::string_view header, std::string_view text);
+
+// Waits until everything queued has been written; call before prompting
+// the user or writing to cout directly
+void console_flush();
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CONSTANT_TIME_SSE2 1
+#include <emmintrin.h>
+#endif
+
+
+// Constant-time kernels for the table lookups of the classical ciphers.
+//
+// The fast kernels index tables with secret values (a plaintext code point,
+// a symbol index, a key entry), so which cache lines they touch depends on
+// the secret. The constant-time ones read the whole table every time and
+// pick the entry with compare masks (SSE2, 4 entries per compare), with no
+// branch or address that depends on the secret value.
+//
+// Not hidden, by design of the ciphers: the UTF-8 length of every character
+// and whether it is a symbol at all (other characters are copied to the
+// output as they are). With the ukrainian alphabet the lengths tell letters
+// from spaces and punctuation; with the latin one every symbol is one byte.
+//
+// Opt-in at run time with LAB_CONSTANT_TIME=1; a build with LAB_CONSTANT_TIME
+// defined uses the constant-time kernels only. The fast kernels stay
+// available to the benchmarks either way.
+
+inline bool constant_time_enabled() {
+#ifdef LAB_CONSTANT_TIME
+    return true;
+#else
+    static const bool enabled = [] {
+        const char* value = std::getenv("LAB_CONSTANT_TIME");
+        return value && *value && std::strcmp(value, "0") != 0;
+    }();
+    return enabled;
+#endif
+}
+
+// Which kernel a lookup uses
+enum class Lookup { Fast, ConstantTime };
+
+// Runs fn with the lookup selected for this process as a compile-time constant
+template <typename Fn>
+decltype(auto) with_lookup(Fn fn) {
+    if (constant_time_enabled()) return fn(std::integral_constant<Lookup, Lookup::ConstantTime>());
+    return fn(std::integral_constant<Lookup, Lookup::Fast>());
+}
+
+// All ones if a == b, zero otherwise, without a branch
+inline uint32_t ct_equal_mask(uint32_t a, uint32_t b) {
+    uint32_t x = a ^ b;
+    // High bit of x | -x is set unless x == 0
+    return ((x | (0u - x)) >> 31) - 1;
+}
+
+// All ones if a < b, zero otherwise (a, b below 2^31)
+inline uint32_t ct_less_mask(uint32_t a, uint32_t b) {
+    return uint32_t(int32_t(a - b) >> 31);
+}
+
+// Position of value in values[0, count), -1 if it is not there; every entry
+// is compared. count is a multiple of 4 and the values are distinct
+inline int ct_find(const uint32_t* values, size_t count, uint32_t value) {
+    uint32_t found = 0;  // position + 1
+#ifdef CONSTANT_TIME_SSE2
+    const __m128i target = _mm_set1_epi32(int(value));
+    __m128i position = _mm_setr_epi32(1, 2, 3, 4);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i acc = _mm_setzero_si128();
+    for (size_t i = 0; i < count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + i));
+        acc = _mm_or_si128(acc, _mm_and_si128(_mm_cmpeq_epi32(v, target), position));
+        position = _mm_add_epi32(position, step);
+    }
+    acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    found = uint32_t(_mm_cvtsi128_si32(acc));
+#else
+    for (size_t i = 0; i < count; i++) found |= ct_equal_mask(values[i], value) & uint32_t(i + 1);
+#endif
+    return int(found) - 1;
+}
+
+// table[index] for index in [0, count), reading every entry; count is a multiple of 4
+inline uint32_t ct_get(const uint32_t* table, size_t count, size_t index) {
+    uint32_t result = 0;
+#ifdef CONSTANT_TIME_SSE2
+    const __m128i target = _mm_set1_epi32(int(index));
+    __m128i position = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i acc = _mm_setzero_si128();
+    for (size_t i = 0; i < count; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(table + i));
+        acc = _mm_or_si128(acc, _mm_and_si128(_mm_cmpeq_epi32(position, target), v));
+        position = _mm_add_epi32(position, step);
+    }
+    acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc = _mm_or_si128(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+    result = uint32_t(_mm_cvtsi128_si32(acc));
+#else
+    for (size_t i = 0; i < count; i++) result |= ct_equal_mask(uint32_t(i), uint32_t(index)) & table[i];
+#endif
+    return result;
+}
+
+// A table of up to Size ints read with ct_get (e.g. a substitution key);
+// a read scans the entries given, rounded up to 4
+template <size_t Size>
+class CtTable {
+public:
+    static_assert(Size % 4 == 0, "ct_get reads 4 entries at a time");
+
+    CtTable() = default;
+
+    template <typename Container>
+    explicit CtTable(const Container& values) : count(values.size() < Size ? (values.size() + 3) / 4 * 4 : Size) {
+        for (size_t i = 0; i < values.size() && i < Size; i++) entries[i] = uint32_t(values[i]);
+    }
+
+    int operator[](size_t index) const { return int(ct_get(entries, count, index)); }
+
+private:
+    size_t count = Size;
+    uint32_t entries[Size] = {};
+};
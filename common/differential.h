@@ -0,0 +1,263 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "alphabet.h"
+#include "kernel_bench.h"
+
+
+// Differential fuzzing of the optimized kernels against the reference
+// implementations every lab keeps in its reference.h (--fuzz of the labs).
+//
+// Each reference.h has two kinds of oracles. The baseline namespace keeps
+// the functions of the original lab as they were: they define the output
+// format (what output.txt must contain) for the latin alphabet and ASCII
+// (or byte) input, and the few cases where the labs now differ on purpose
+// are listed there. The other references are the plain forms of the
+// ciphers written for what the baseline did not do (UTF-8 text, other
+// alphabets, block widths and modes): a linear search for every symbol, %
+// for every shift, one block at a time. Every optimized kernel has to
+// agree with them byte for byte. A fuzz run
+// checks random texts, keys and alphabets, then times every kernel against
+// its reference on the same text; --record appends those throughputs to a
+// CSV file, so the gains of an optimization stay on record.
+//
+// Every case is generated from its own seed (printed on a mismatch), and
+// --fuzz 1 --seed <that seed> runs just that case again.
+
+// Output of a case that throws: the messages may differ, the outcome may not
+inline const std::string FUZZ_THROWS = "<throws>";
+
+template <typename Fn>
+std::string fuzz_outcome(Fn fn) {
+    try {
+        return fn();
+    }
+    catch (const std::exception&) {
+        return FUZZ_THROWS;
+    }
+}
+
+
+// Reference lookups shared by the references of the labs
+
+// Index of a character by a linear search over the symbols (either case), -1 if none
+inline int reference_index(const Alphabet& alphabet, char32_t c) {
+    for (int i = 0; i < alphabet.size(); i++) {
+        char32_t symbol = alphabet.symbol(i);
+        if (c == symbol || c == lower_case(symbol) || c == upper_case(symbol)) return i;
+    }
+    return -1;
+}
+
+inline void reference_append(std::string& out, char32_t c) {
+    char buffer[4];
+    out.append(buffer, encode_utf8(c, buffer));
+}
+
+// Calls fn(code point, bytes) for every character of text; a malformed
+// byte comes as REPLACEMENT_CHARACTER with its one byte
+template <typename Fn>
+void reference_characters(const std::string& text, Fn fn) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    while (p < end) {
+        char32_t c;
+        size_t length = decode_utf8(p, end, c);
+        fn(c, std::string_view(p, length));
+        p += length;
+    }
+}
+
+// Text with the letters converted by convert (lower_case or upper_case); the rest as is
+inline std::string reference_case(const std::string& text, char32_t (*convert)(char32_t)) {
+    std::string result;
+    reference_characters(text, [&](char32_t c, std::string_view bytes) {
+        if (c < ALPHABET_CODE_POINTS && convert(c) != c) reference_append(result, convert(c));
+        else result += bytes;
+    });
+    return result;
+}
+
+
+// Random cases
+
+using FuzzRandom = std::mt19937_64;
+
+// Seed of a run without --seed
+inline uint64_t fuzz_seed() {
+    std::random_device device;
+    return (uint64_t(device()) << 32) | device();
+}
+
+// Text of up to maxLength characters: symbols of the alphabet in either
+// case, other characters of 1 to 4 bytes, malformed and truncated sequences
+inline std::string fuzz_text(FuzzRandom& rng, const Alphabet& alphabet, size_t maxLength) {
+    static const char32_t OTHERS[] = { '0', '7', '\n', '\t', '\r', '!', '"', '?', '_', 0xA0, 0xD7, 0xDF, 0xF7, 0xFF,
+        0x400, 0x40F, 0x450, 0x45F, 0x490, 0x491, 0x4FF, 0x500, 0x5D0, 0x7FF, 0x800, 0x20AC, 0xFFFD, 0x1F600, 0x10FFFF };
+    static const char* const MALFORMED[] = { "\x80", "\xBF", "\xC0", "\xC1\x80", "\xD0", "\xE0\x80\x80", "\xED\xA0\x80",
+        "\xE2\x82", "\xF0\x9F\x98", "\xF4\x90\x80\x80", "\xF8", "\xFF" };
+
+    std::string text;
+    const size_t length = size_t(rng() % (maxLength + 1));
+    for (size_t k = 0; k < length; k++) {
+        unsigned kind = unsigned(rng() % 10);
+        if (kind < 7) {
+            char32_t symbol = alphabet.symbol(int(rng() % unsigned(alphabet.size())));
+            unsigned form = unsigned(rng() % 3);
+            reference_append(text, form == 0 ? symbol : form == 1 ? lower_case(symbol) : upper_case(symbol));
+        }
+        else if (kind < 9) {
+            reference_append(text, OTHERS[rng() % std::size(OTHERS)]);
+        }
+        else {
+            text += MALFORMED[rng() % std::size(MALFORMED)];
+        }
+    }
+    return text;
+}
+
+// Text of up to maxLength ASCII characters but NUL, the input the baseline
+// labs were written for (see baseline in the reference.h): about half of
+// them letters of either case, the rest any of the 127
+inline std::string fuzz_ascii(FuzzRandom& rng, size_t maxLength) {
+    std::string text(size_t(rng() % (maxLength + 1)), '\0');
+    for (char& c : text) c = rng() % 2 ? char((rng() % 2 ? 'a' : 'A') + rng() % 26) : char(1 + rng() % 127);
+    return text;
+}
+
+// Latin, ukrainian, or 2 to 64 random letters and signs (some listed in upper case)
+inline Alphabet fuzz_alphabet(FuzzRandom& rng) {
+    switch (rng() % 3) {
+    case 0: return LATIN_ALPHABET;
+    case 1: return UKRAINIAN_ALPHABET;
+    }
+    std::vector<char32_t> pool;
+    for (char32_t c = 'a'; c <= 'z'; c++) pool.push_back(c);
+    for (char32_t c = 0x430; c <= 0x44F; c++) pool.push_back(c);
+    for (char32_t c : { 0x454, 0x456, 0x457, 0x491, 0xDF, 0xE0, 0xE9, 0xF6, 0xFE }) pool.push_back(c);
+    for (char c : std::string(" .,;-'0123456789")) pool.push_back(char32_t(c));
+    std::shuffle(pool.begin(), pool.end(), rng);
+
+    std::string symbols;
+    const size_t count = 2 + size_t(rng() % (ALPHABET_MAX - 1));
+    for (size_t i = 0; i < count; i++) reference_append(symbols, rng() % 4 == 0 ? upper_case(pool[i]) : pool[i]);
+    return Alphabet(symbols);
+}
+
+
+// Runs the cases of every kernel, then times the kernels against their references
+class FuzzRun {
+public:
+    // setting (the alphabet, for the text ciphers) labels the timings
+    FuzzRun(std::string lab, int cases, uint64_t seed, std::string setting = lab_alphabet_name() + " alphabet")
+        : lab(std::move(lab)), setting(std::move(setting)), cases(cases), seed(seed) {
+        std::cout << "=== " << this->lab << " differential fuzzing: " << cases << " cases per kernel, seed " << seed
+                  << " ===" << std::endl;
+    }
+
+    // runCase(rng, what) returns { reference output, kernel output } and
+    // may describe the case (key, options) in what
+    template <typename Case>
+    bool check(const std::string& kernel, Case runCase) {
+        for (int k = 0; k < cases; k++) {
+            const uint64_t caseSeed = seed + uint64_t(k);
+            FuzzRandom rng(caseSeed);
+            std::string what;
+            std::pair<std::string, std::string> outputs = runCase(rng, what);
+            if (outputs.first != outputs.second) {
+                report(kernel, caseSeed, what, outputs.first, outputs.second);
+                failures++;
+                return false;
+            }
+        }
+        std::cout << std::left << std::setw(32) << kernel << std::right << "ok" << std::endl;
+        return true;
+    }
+
+    // Best times of reference() and kernel() on bytes bytes of input
+    template <typename Reference, typename Kernel>
+    void measure(const std::string& kernel, size_t bytes, Reference reference, Kernel optimized, int repeats = 3) {
+        double referenceSeconds = bench_seconds(repeats, reference);
+        double kernelSeconds = bench_seconds(repeats, optimized);
+        timings.push_back({ kernel, bytes, double(bytes) / referenceSeconds / 1e6, double(bytes) / kernelSeconds / 1e6 });
+    }
+
+    // Prints the timings and appends them to recordPath (CSV) unless it is empty; 0 if every kernel agreed
+    int finish(const std::string& recordPath) const {
+        if (!timings.empty()) {
+            std::cout << '\n' << std::left << std::setw(32) << "Throughput (" + setting + ")" << std::right
+                      << std::setw(13) << "reference" << std::setw(13) << "optimized" << std::endl;
+            for (const Timing& t : timings) {
+                std::cout << std::left << std::setw(32) << t.kernel << std::right << std::fixed << std::setprecision(1)
+                          << std::setw(8) << t.referenceRate << " MB/s" << std::setw(8) << t.kernelRate << " MB/s   x"
+                          << std::setprecision(2) << t.kernelRate / t.referenceRate << std::endl;
+            }
+        }
+        if (!recordPath.empty() && !record(recordPath)) {
+            std::cerr << "Cannot write " << recordPath << std::endl;
+            return 1;
+        }
+        if (failures) std::cout << failures << " kernel(s) disagree with the reference" << std::endl;
+        return failures ? 1 : 0;
+    }
+
+private:
+    struct Timing {
+        std::string kernel;
+        size_t bytes;
+        double referenceRate;
+        double kernelRate;
+    };
+
+    std::string lab;
+    std::string setting;
+    int cases;
+    uint64_t seed;
+    int failures = 0;
+    std::vector<Timing> timings;
+
+    static void report(const std::string& kernel, uint64_t caseSeed, const std::string& what, const std::string& expected,
+        const std::string& actual) {
+        size_t at = 0;
+        while (at < expected.size() && at < actual.size() && expected[at] == actual[at]) at++;
+        auto around = [&](const std::string& s) {
+            std::ostringstream hex;
+            for (size_t i = at; i < s.size() && i < at + 16; i++) hex << std::hex << std::setw(2) << std::setfill('0') << int(uint8_t(s[i])) << ' ';
+            return hex.str();
+        };
+        std::cout << std::left << std::setw(32) << kernel << std::right << "MISMATCH (--fuzz 1 --seed " << caseSeed << ")\n"
+                  << "  case: " << what << "\n"
+                  << "  reference " << expected.size() << " bytes, kernel " << actual.size() << " bytes, first difference at byte " << at << "\n"
+                  << "  reference: " << around(expected) << "\n"
+                  << "  kernel:    " << around(actual) << std::endl;
+    }
+
+    // One row per kernel: time, lab, setting, kernel, bytes, reference and kernel MB/s
+    bool record(const std::string& path) const {
+        bool fresh = !std::ifstream(path).good();
+        std::ofstream out(path, std::ios::app);
+        if (!out.is_open()) return false;
+        if (fresh) out << "time,lab,setting,kernel,bytes,reference_mbps,kernel_mbps\n";
+        std::time_t now = std::time(nullptr);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        for (const Timing& t : timings) {
+            out << stamp << ',' << lab << ",\"" << setting << "\",\"" << t.kernel << "\"," << t.bytes << ','
+                << std::fixed << std::setprecision(2) << t.referenceRate << ',' << t.kernelRate << '\n';
+        }
+        return bool(out);
+    }
+};
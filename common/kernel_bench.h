@@ -0,0 +1,58 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <type_traits>
+#include "alphabet.h"
+
+
+// Side-by-side timing of the fast and the constant-time kernels (--bench
+// of the labs). Both are always compiled, whatever LAB_CONSTANT_TIME says.
+
+// About size bytes of alphabet symbols in words of 1..8, with line breaks
+// and digits that pass through, the same for every run
+inline std::string bench_text(const Alphabet& alphabet, size_t size) {
+    std::string text;
+    text.reserve(size + 64);
+    std::mt19937 rng(12345);
+    while (text.size() < size) {
+        size_t length = 1 + rng() % 8;
+        for (size_t i = 0; i < length; i++) text += alphabet.utf8(int(rng() % unsigned(alphabet.size())));
+        unsigned separator = rng() % 16;
+        text += separator == 0 ? "\n" : separator == 1 ? "7" : " ";
+    }
+    return text;
+}
+
+// Best time of repeats calls of fn, in seconds
+template <typename Fn>
+double bench_seconds(int repeats, Fn fn) {
+    double best = 1e9;
+    for (int r = 0; r < repeats; r++) {
+        auto start = std::chrono::steady_clock::now();
+        fn();
+        best = std::min(best, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return best;
+}
+
+// Times run(lookup) (returning the output text) with both lookups on a text
+// of bytes bytes and prints one row; false if the outputs differ
+template <typename Run>
+bool bench_lookups(const std::string& label, size_t bytes, Run run, int repeats = 3) {
+    const std::integral_constant<Lookup, Lookup::Fast> fast;
+    const std::integral_constant<Lookup, Lookup::ConstantTime> constantTime;
+    std::string fastOutput, constantTimeOutput;
+    double fastSeconds = bench_seconds(repeats, [&] { fastOutput = run(fast); });
+    double constantTimeSeconds = bench_seconds(repeats, [&] { constantTimeOutput = run(constantTime); });
+    bool same = fastOutput == constantTimeOutput;
+    std::cout << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(1)
+              << "fast " << std::setw(8) << double(bytes) / fastSeconds / 1e6 << " MB/s   constant-time "
+              << std::setw(8) << double(bytes) / constantTimeSeconds / 1e6 << " MB/s   x" << std::setprecision(2)
+              << constantTimeSeconds / fastSeconds << (same ? "" : "  [MISMATCH]") << std::endl;
+    return same;
+}
@@ -0,0 +1,56 @@
+#include <cmath>
+#include <stdexcept>
+#include "ngram_fitness.h"
+#include "profiler.h"
+
+using namespace std;
+
+
+// Counts to log10 probabilities, with the floor for the n-grams never seen
+static void toLogProbabilities(const vector<uint64_t>& counts, uint64_t total, vector<float>& logs) {
+    double floor = log10(0.01 / double(total));
+    logs.resize(counts.size());
+    for (size_t i = 0; i < counts.size(); i++) {
+        logs[i] = float(counts[i] ? log10(double(counts[i]) / double(total)) : floor);
+    }
+}
+
+NGramFitness::NGramFitness(const Alphabet& alphabet, string_view reference)
+    : alphabet(&alphabet), n(alphabet.size()) {
+    ProfileScope scope("fitness model", reference.size());
+
+    vector<uint8_t> symbols;
+    symbols.reserve(reference.size());
+    alphabet.scan(reference, [&](int i) { symbols.push_back(uint8_t(i)); });
+    if (symbols.size() < 4) throw runtime_error("The reference text has fewer than 4 symbols of the alphabet");
+
+    const size_t N = size_t(n);
+    vector<uint64_t> bigramCounts(N * N, 0);
+    vector<uint64_t> quadgramCounts(N * N * N * N, 0);
+    for (size_t i = 1; i < symbols.size(); i++) bigramCounts[symbols[i - 1] * N + symbols[i]]++;
+    for (size_t i = 3; i < symbols.size(); i++) {
+        quadgramCounts[((symbols[i - 3] * N + symbols[i - 2]) * N + symbols[i - 1]) * N + symbols[i]]++;
+    }
+    toLogProbabilities(bigramCounts, symbols.size() - 1, bigrams);
+    toLogProbabilities(quadgramCounts, symbols.size() - 3, quadgrams);
+
+    double sum = 0;
+    for (size_t i = 1; i < symbols.size(); i++) sum += bigrams[symbols[i - 1] * N + symbols[i]];
+    referenceBigramMean = sum / double(symbols.size() - 1);
+    sum = 0;
+    for (float logProbability : bigrams) sum += logProbability;
+    randomBigramMean = sum / double(bigrams.size());
+}
+
+double NGramFitness::score(const uint8_t* symbols, size_t count) const {
+    double sum = 0;
+    for (size_t i = 3; i < count; i++) sum += quadgram(symbols[i - 3], symbols[i - 2], symbols[i - 1], symbols[i]);
+    return sum;
+}
+
+double NGramFitness::text_score(string_view text) const {
+    vector<uint8_t> symbols;
+    alphabet->scan(text, [&](int i) { symbols.push_back(uint8_t(i)); });
+    if (symbols.size() < 4) return 0;
+    return score(symbols.data(), symbols.size()) / double(symbols.size() - 3);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "alphabet.h"
+
+
+// Language model for judging candidate decryptions: log10 probabilities
+// of the bigrams and quadgrams of a reference text (a book or articles in
+// the language of the plaintext) over the symbols of an alphabet.
+//
+// Texts are scored as sequences of symbol indices; characters outside the
+// alphabet are skipped, as the ciphers skip them. N-grams missing from the
+// reference get log10(0.01 / total), so one unseen n-gram does not rule a
+// text out. The quadgram table is dense: 4 MB for latin, 9 MB for ukrainian.
+
+class NGramFitness {
+public:
+    // Throws if the reference has fewer than 4 symbols of the alphabet
+    NGramFitness(const Alphabet& alphabet, std::string_view reference);
+
+    int size() const { return n; }
+
+    float bigram(int a, int b) const { return bigrams[size_t(a * n + b)]; }
+
+    float quadgram(int a, int b, int c, int d) const {
+        return quadgrams[((size_t(a) * n + b) * n + c) * n + d];
+    }
+
+    // Mean bigram log-probability of the reference itself and of text of
+    // uniformly random symbols, which is what a wrong key decrypts to
+    double reference_bigram_mean() const { return referenceBigramMean; }
+    double random_bigram_mean() const { return randomBigramMean; }
+
+    // Sum of the quadgram log-probabilities of a symbol sequence
+    double score(const uint8_t* symbols, size_t count) const;
+
+    // Mean quadgram log-probability of the symbols of text (0 if it has fewer than 4)
+    double text_score(std::string_view text) const;
+
+private:
+    const Alphabet* alphabet;
+    int n;
+    std::vector<float> bigrams;
+    std::vector<float> quadgrams;
+    double referenceBigramMean = 0;
+    double randomBigramMean = 0;
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+
+// Splits [0, count) into contiguous chunks, one per thread but none shorter
+// than minPerThread, and runs fn(begin, end) on each chunk.
+// The last chunk runs on the calling thread.
+template <typename Fn>
+void parallel_chunks(size_t count, unsigned threads, size_t minPerThread, Fn fn) {
+    size_t maxThreads = std::max<size_t>(1, count / std::max<size_t>(1, minPerThread));
+    size_t n = std::min<size_t>(std::max(1u, threads), maxThreads);
+    if (n <= 1) {
+        fn(size_t(0), count);
+        return;
+    }
+
+    size_t chunk = (count + n - 1) / n;
+    std::vector<std::thread> workers;
+    workers.reserve(n - 1);
+    for (size_t begin = 0; begin + chunk < count; begin += chunk) {
+        workers.emplace_back(fn, begin, begin + chunk);
+    }
+    fn(workers.size() * chunk, count);
+    for (std::thread& t : workers) t.join();
+}
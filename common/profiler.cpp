@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+#include "profiler.h"
+
+using namespace std;
+
+
+bool profilerOn = false;
+
+static thread_local uint64_t allocationCount = 0;
+static thread_local uint64_t allocatedBytes = 0;
+static thread_local int scopeDepth = 0;
+
+struct StageStats {
+    const char* name;
+    int depth;
+    uint64_t calls = 0;
+    uint64_t nanoseconds = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+};
+
+static mutex stagesMutex;
+static vector<StageStats> stages; // in order of first use
+static ProfileFormat reportFormat = ProfileFormat::Off;
+static string reportPath;
+static chrono::steady_clock::time_point programStart;
+
+
+// --- allocation counting ---
+void* operator new(size_t size) {
+    allocationCount++;
+    allocatedBytes += size;
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+#ifdef __cpp_aligned_new
+// Over-aligned types and pmr resources (new_delete_resource) come here
+void* operator new(size_t size, align_val_t alignment) {
+    allocationCount++;
+    allocatedBytes += size;
+#ifdef _MSC_VER
+    if (void* p = _aligned_malloc(size ? size : 1, size_t(alignment))) return p;
+#else
+    void* p = nullptr;
+    if (posix_memalign(&p, max(size_t(alignment), sizeof(void*)), size ? size : 1) == 0) return p;
+#endif
+    throw bad_alloc();
+}
+
+void operator delete(void* p, align_val_t) noexcept {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+void operator delete(void* p, size_t, align_val_t alignment) noexcept {
+    operator delete(p, alignment);
+}
+#endif
+
+uint64_t thread_allocation_count() {
+    return allocationCount;
+}
+
+uint64_t thread_allocated_bytes() {
+    return allocatedBytes;
+}
+
+
+// --- stages ---
+void ProfileScope::begin(const char* stage, uint64_t bytes) {
+    {
+        // Registered on first start, so the report lists parents before children
+        lock_guard<mutex> lock(stagesMutex);
+        stageIndex = 0;
+        while (stageIndex < stages.size() && strcmp(stages[stageIndex].name, stage) != 0) stageIndex++;
+        if (stageIndex == stages.size()) stages.push_back({ stage, scopeDepth });
+    }
+    this->bytes = bytes;
+    running = true;
+    scopeDepth++;
+    startAllocations = allocationCount;
+    startAllocatedBytes = allocatedBytes;
+    startTime = chrono::steady_clock::now();
+}
+
+void ProfileScope::end() {
+    auto elapsed = chrono::steady_clock::now() - startTime;
+    uint64_t allocations = allocationCount - startAllocations;
+    uint64_t allocated = allocatedBytes - startAllocatedBytes;
+    running = false;
+    scopeDepth--;
+
+    lock_guard<mutex> lock(stagesMutex);
+    StageStats& stats = stages[stageIndex];
+    stats.calls++;
+    stats.nanoseconds += uint64_t(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+    stats.bytes += bytes;
+    stats.allocations += allocations;
+    stats.allocatedBytes += allocated;
+}
+
+
+// --- report ---
+static string env_value(const char* name) {
+#ifdef _MSC_VER
+    char* value = nullptr;
+    size_t size = 0;
+    if (_dupenv_s(&value, &size, name) != 0 || !value) return "";
+    string result(value);
+    free(value);
+    return result;
+#else
+    const char* value = getenv(name);
+    return value ? value : "";
+#endif
+}
+
+static void report_at_exit() {
+    if (reportPath.empty()) {
+        profiler_report(cerr, reportFormat);
+        return;
+    }
+    ofstream out(reportPath);
+    if (!out.is_open()) {
+        cerr << "Cannot open " << reportPath << " for the profile!" << endl;
+        return;
+    }
+    profiler_report(out, reportFormat);
+}
+
+void profiler_init() {
+    string format = env_value("LAB_PROFILE");
+    if (format.empty() || format == "0" || format == "off") return;
+    reportPath = env_value("LAB_PROFILE_FILE");
+    profiler_enable(format == "json" ? ProfileFormat::Json : ProfileFormat::Text);
+}
+
+void profiler_enable(ProfileFormat format) {
+    if (format == ProfileFormat::Off || profilerOn) return;
+    reportFormat = format;
+    programStart = chrono::steady_clock::now();
+    profilerOn = true;
+    atexit(report_at_exit);
+}
+
+// Heap allocations per MB the stage processed; a stage that allocates
+// per element shows a constant here instead of a falling one
+static double allocations_per_mb(const StageStats& s) {
+    return s.bytes ? s.allocations / (s.bytes / 1e6) : 0.0;
+}
+
+void profiler_report(ostream& out, ProfileFormat format) {
+    double totalMs = chrono::duration<double, milli>(chrono::steady_clock::now() - programStart).count();
+    lock_guard<mutex> lock(stagesMutex);
+
+    ios state(nullptr);
+    state.copyfmt(out);
+    out << fixed;
+
+    if (format == ProfileFormat::Json) {
+        out << "{\"total_ms\":" << setprecision(3) << totalMs << ",\"stages\":[";
+        for (size_t i = 0; i < stages.size(); i++) {
+            const StageStats& s = stages[i];
+            out << (i ? "," : "") << "{\"name\":\"" << s.name << "\",\"depth\":" << s.depth
+                << ",\"calls\":" << s.calls << ",\"ms\":" << s.nanoseconds / 1e6
+                << ",\"bytes\":" << s.bytes << ",\"allocations\":" << s.allocations
+                << ",\"allocated_bytes\":" << s.allocatedBytes
+                << ",\"allocations_per_mb\":" << allocations_per_mb(s) << "}";
+        }
+        out << "]}" << endl;
+    }
+    else {
+        out << "\n--- Profile (total " << setprecision(3) << totalMs << " ms) ---\n"
+            << left << setw(28) << "stage" << right << setw(8) << "calls" << setw(12) << "time ms"
+            << setw(10) << "MB" << setw(10) << "MB/s" << setw(10) << "allocs" << setw(12) << "alloc KB" << setw(12) << "allocs/MB" << "\n";
+        for (const StageStats& s : stages) {
+            double ms = s.nanoseconds / 1e6;
+            double mb = s.bytes / 1e6;
+            string name = string(size_t(2 * s.depth), ' ') + s.name;
+            out << left << setw(28) << name << right << setw(8) << s.calls
+                << setw(12) << setprecision(3) << ms
+                << setw(10) << setprecision(2) << mb
+                << setw(10) << setprecision(1) << (s.bytes && ms > 0 ? mb / (ms / 1000) : 0.0)
+                << setw(10) << s.allocations
+                << setw(12) << setprecision(1) << s.allocatedBytes / 1024.0
+                << setw(12) << setprecision(1) << allocations_per_mb(s) << "\n";
+        }
+        out << flush;
+    }
+
+    out.copyfmt(state);
+}
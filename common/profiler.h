@@ -0,0 +1,74 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+
+// Per-stage timing for the lab tools.
+//
+// Off by default. LAB_PROFILE=text or LAB_PROFILE=json turns it on at run
+// time; the report is written to stderr (or to the file named by
+// LAB_PROFILE_FILE) when the program exits. Every stage reports its calls,
+// wall time, bytes processed, and heap allocations made inside it.
+// When profiling is off, a scope costs one test of a global flag.
+
+enum class ProfileFormat { Off, Text, Json };
+
+// Reads LAB_PROFILE / LAB_PROFILE_FILE; call first thing in main
+void profiler_init();
+
+// Turns profiling on from code (e.g. a command-line flag); call before any thread starts
+void profiler_enable(ProfileFormat format);
+
+void profiler_report(std::ostream& out, ProfileFormat format);
+
+// Heap allocations made by the calling thread since it started
+// (counted by the global operator new of profiler.cpp, also when profiling is off)
+uint64_t thread_allocation_count();
+uint64_t thread_allocated_bytes();
+
+
+// Set once before any thread starts, read-only afterwards
+extern bool profilerOn;
+
+// Times a stage from construction to destruction. Stages of the same name
+// are summed, and nested stages are shown indented under their parent.
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* stage, uint64_t bytes = 0) {
+        if (profilerOn) begin(stage, bytes);
+    }
+
+    ~ProfileScope() {
+        if (running) end();
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+    // Closes this stage and opens the next one, for straight-line code
+    void next(const char* stage, uint64_t bytes = 0) {
+        if (running) end();
+        if (profilerOn) begin(stage, bytes);
+    }
+
+    void add_bytes(uint64_t n) {
+        bytes += n;
+    }
+
+    void stop() {
+        if (running) end();
+    }
+
+private:
+    size_t stageIndex = 0;
+    uint64_t bytes = 0;
+    bool running = false;
+    std::chrono::steady_clock::time_point startTime;
+    uint64_t startAllocations = 0;
+    uint64_t startAllocatedBytes = 0;
+
+    void begin(const char* stage, uint64_t bytes);
+    void end();
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <fstream>
+#include <iterator>
+#include <string>
+
+
+// Contents of an open file in one allocation sized from its length, the way
+// lab1 reads its inputs (a string grown through istreambuf_iterator is
+// reallocated and copied about log2(size) times). In text mode the length
+// is an upper bound, as CRLF is read as '\n', so the string is cut to what
+// was read. A stream that cannot seek is read the slow way.
+inline std::string read_whole_file(std::ifstream& file) {
+    file.seekg(0, std::ios::end);
+    const std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+    if (size < 0 || !file) {
+        file.clear();
+        return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    }
+
+    std::string content(size_t(size), '\0');
+    file.read(content.data(), std::streamsize(size));
+    content.resize(size_t(file.gcount()));
+    return content;
+}
@@ -0,0 +1,87 @@
+#include <algorithm>
+#include "thread_pool.h"
+
+using namespace std;
+
+
+// Pool and deque index of the current thread, if it is a worker
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local unsigned currentIndex = 0;
+
+
+ThreadPool::ThreadPool(unsigned threads) {
+    threads = max(1u, threads);
+    for (unsigned i = 0; i < threads; i++) queues.push_back(make_unique<Queue>());
+    for (unsigned i = 0; i < threads; i++) workers.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread& worker : workers) worker.join();
+}
+
+void ThreadPool::submit(Task task) {
+    // A task spawned by a worker stays on that worker's deque
+    unsigned index = currentPool == this ? currentIndex : nextQueue.fetch_add(1) % size();
+    {
+        // Counted before it is visible, so a thief never takes pending below zero;
+        // under the sleep mutex, so a worker cannot miss the wake-up
+        lock_guard<mutex> lock(sleepMutex);
+        pending++;
+    }
+    {
+        lock_guard<mutex> lock(queues[index]->mutex);
+        queues[index]->tasks.push_back(move(task));
+    }
+    wake.notify_one();
+}
+
+bool ThreadPool::pop_local(unsigned index, Task& task) {
+    Queue& queue = *queues[index];
+    lock_guard<mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) return false;
+    task = move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::steal(unsigned index, Task& task) {
+    for (unsigned k = 1; k < size(); k++) {
+        Queue& victim = *queues[(index + k) % size()];
+        lock_guard<mutex> lock(victim.mutex);
+        if (victim.tasks.empty()) continue;
+        task = move(victim.tasks.front());
+        victim.tasks.pop_front();
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned index) {
+    currentPool = this;
+    currentIndex = index;
+
+    Task task;
+    while (true) {
+        if (pop_local(index, task) || steal(index, task)) {
+            pending--;
+            active++;
+            try {
+                task();
+            }
+            catch (...) {
+            }
+            task = nullptr;
+            active--;
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return pending > 0 || stopping; });
+        if (stopping && pending == 0) return;
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Work-stealing thread pool: every worker owns a deque. External submissions
+// are spread round-robin over the deques; a worker takes its newest task
+// first (its data is still in cache) and, when its own deque is empty,
+// steals the oldest task from another worker.
+class ThreadPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit ThreadPool(unsigned threads);
+
+    // Runs every task that is still queued, then joins the workers
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Tasks must not throw; an escaping exception is swallowed
+    void submit(Task task);
+
+    unsigned size() const { return unsigned(queues.size()); }
+
+    // Tasks waiting in the deques
+    size_t queued() const { return pending.load(); }
+
+    // Tasks being run right now
+    unsigned busy() const { return active.load(); }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    std::atomic<size_t> pending{ 0 };
+    std::atomic<unsigned> active{ 0 };
+    std::atomic<unsigned> nextQueue{ 0 };
+
+    bool pop_local(unsigned index, Task& task);
+    bool steal(unsigned index, Task& task);
+    void worker_loop(unsigned index);
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+// Числа у файлах знімків - 64-бітні little-endian незалежно від платформи,
+// рядки - довжина і байти
+
+inline void writeU64(std::ostream& out, uint64_t value) {
+    char bytes[8];
+    for (int i = 0; i < 8; i++) bytes[i] = char((value >> (8 * i)) & 0xFF);
+    out.write(bytes, sizeof(bytes));
+}
+
+inline uint64_t readU64(std::istream& in) {
+    unsigned char bytes[8];
+    if (!in.read(reinterpret_cast<char*>(bytes), sizeof(bytes))) throw std::runtime_error("Snapshot is truncated");
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) value = (value << 8) | bytes[i];
+    return value;
+}
+
+inline void writeString(std::ostream& out, std::string_view s) {
+    writeU64(out, s.size());
+    out.write(s.data(), std::streamsize(s.size()));
+}
+
+inline std::string readString(std::istream& in) {
+    uint64_t size = readU64(in);
+    if (size > (uint64_t(1) << 30)) throw std::runtime_error("Snapshot is damaged");
+    std::string s(size_t(size), '\0');
+    if (!in.read(s.data(), std::streamsize(size))) throw std::runtime_error("Snapshot is truncated");
+    return s;
+}
@@ -5,70 +5,210 @@
 #include <vector>
 #include <numeric>
 #include <algorithm>
-#include <cctype>
+#include <cstring>
+#include <memory_resource>
+#include <string_view>
 #include <xlnt/xlnt.hpp>
+#include "ngram_counter.h"
+#include "snapshot.h"
+#include "../common/alphabet.h"
+#include "../common/arena.h"
+#include "../common/profiler.h"
 
 #define INPUT_FILE_NAME "VT00.txt"
 #define OUTPUT_FILE_NAME "occurrence.xlsx"
+#define SNAPSHOT_FILE_NAME "occurrence.snapshot"
 
 using namespace std;
 
-// Функція для перевірки, чи символ є буквою або знаком пунктуації (для шифру)
-bool isValidChar(char c) {
-    return isalpha((unsigned char)c) || c == '.' || c == ',' || c == ';' || c == ':' || c == '-' || c == '\'';
+// Алфавіти аналізатора: літери, пробіл і розділові знаки .,;:-'
+// (LAB_ALPHABET=latin|ukrainian; з custom:... рахуються саме його символи)
+constexpr Alphabet ANALYZER_LATIN("abcdefghijklmnopqrstuvwxyz .,;:-'");
+constexpr Alphabet ANALYZER_UKRAINIAN("абвгґдеєжзиіїйклмнопрстуфхцчшщьюя .,;:-'");
+
+const Alphabet& analyzerAlphabet() {
+    if (lab_alphabet_name() == "ukrainian") return ANALYZER_UKRAINIAN;
+    if (lab_alphabet_name() == "custom") return lab_alphabet();
+    return ANALYZER_LATIN;
 }
 
-// Функція для завантаження частот символів у Excel
-void loadFreqToExcel(xlnt::worksheet& ws, int letterCol, int freqCol, const unordered_map<char, int>& freq) {
+// Функція для завантаження частот символів і n-грам у Excel
+void loadFreqToExcel(xlnt::worksheet& ws, int letterCol, int freqCol, const unordered_map<string, uint64_t>& freq) {
     int row = 1;
     for (const auto& pair : freq) {
-        ws.cell(letterCol, row).value(string(1, pair.first));
+        ws.cell(letterCol, row).value(pair.first);
         ws.cell(freqCol, row).value(pair.second);
         row++;
     }
 }
 
-// Функція для завантаження частот n-грам у Excel
-void loadFreqToExcel(xlnt::worksheet& ws, int letterCol, int freqCol, const unordered_map<string, int>& freq) {
-    int row = 1;
-    for (const auto& pair : freq) {
-        ws.cell(letterCol, row).value(pair.first);
-        ws.cell(freqCol, row).value(pair.second);
-        row++;
+// Лічильники слів; ключі вказують на копії слів в арені
+using WordCounts = pmr::unordered_map<string_view, uint64_t>;
+
+// Таблиця всіх слів: кожне різне слово копіюється в арену один раз,
+// усі подальші входження лише збільшують лічильник
+class WordTable {
+public:
+    explicit WordTable(pmr::memory_resource* memory) : memory(memory), counts(memory) {}
+
+    // Рахує входження слова і повертає його збережену копію
+    string_view add(string_view word, uint64_t times = 1) {
+        auto it = counts.find(word);
+        if (it == counts.end()) {
+            char* copy = static_cast<char*>(memory->allocate(word.size(), 1));
+            memcpy(copy, word.data(), word.size());
+            it = counts.emplace(string_view(copy, word.size()), 0).first;
+        }
+        it->second += times;
+        return it->first;
+    }
+
+    // Скасовує одне входження слова (слово з нульовою частотою видаляється)
+    void remove(string_view word) {
+        auto it = counts.find(word);
+        if (it != counts.end() && --it->second == 0) counts.erase(it);
+    }
+
+    const WordCounts& all() const { return counts; }
+
+private:
+    pmr::memory_resource* memory;
+    WordCounts counts;
+};
+
+// Кількість символів алфавіту в слові (довжина слова в літерах, а не в байтах UTF-8)
+size_t symbolCount(const Alphabet& alphabet, string_view word) {
+    size_t count = 0;
+    alphabet.scan(word, [&](int) { count++; });
+    return count;
+}
+
+// Функція для розбиття тексту на слова без копіювання.
+// Символи алфавіту (UTF-8) зсуваються на місце в самому тексті, тож кожне
+// слово стає суцільним фрагментом (інші символи, крім пробілу, всередині
+// слова пропускаються, як і раніше). Після виклику текст зіпсований: на його
+// початку лишаються самі слова. onWord(слово, кількість символів у ньому).
+// openWord на вході - незавершене слово попереднього запуску: воно
+// продовжується першим словом тексту (склеюється лише це одне слово).
+// Повертає кількість слів; у openWord - останнє слово, якщо після нього
+// не було пробілу (воно може продовжитися в дописаному пізніше тексті).
+template <typename OnWord>
+size_t splitWords(const Alphabet& alphabet, char* text, size_t size, OnWord onWord, string& openWord) {
+    string joined = move(openWord);
+    const size_t joinedSymbols = symbolCount(alphabet, joined);
+    bool first = true;
+    // Поточне слово text[wordStart, out); перше - разом з початком із joined
+    auto current = [&](size_t wordStart, size_t out, size_t& symbols) {
+        string_view token(text + wordStart, out - wordStart);
+        if (!first || joined.empty()) return token;
+        joined += token;
+        symbols += joinedSymbols;
+        return string_view(joined);
+    };
+
+    size_t words = 0;
+    size_t out = 0;
+    size_t wordStart = 0;
+    size_t symbols = 0;
+    const char* end = text + size;
+    for (size_t i = 0; i < size;) {
+        // Символи ASCII - без декодування (звичайний випадок)
+        char32_t c = (unsigned char)text[i];
+        size_t length = c < 0x80 ? 1 : decode_utf8(text + i, end, c);
+        if (c == ' ') {
+            string_view word = current(wordStart, out, symbols);
+            first = false;
+            if (!word.empty()) {
+                onWord(word, symbols);
+                wordStart = out;
+                symbols = 0;
+                words++;
+            }
+        }
+        else if (alphabet.index(c) >= 0) {
+            // Запис іде не далі за поточний символ, тож він ще не затертий
+            for (size_t j = 0; j < length; j++) text[out++] = text[i + j];
+            symbols++;
+        }
+        i += length;
     }
+    // Останнє слово, якщо воно є
+    string_view word = current(wordStart, out, symbols);
+    openWord.assign(word);
+    if (!word.empty()) {
+        onWord(word, symbols);
+        words++;
+    }
+    return words;
 }
 
 // Функція для знаходження топ-N n-грам
-vector<pair<string, int>> getTopNGrams(const unordered_map<string, int>& ngramFreq, int topN) {
-    vector<pair<string, int>> ngrams(ngramFreq.begin(), ngramFreq.end());
+// (сортуються вказівники на записи, рядки копіюються лише для топ-N)
+vector<pair<string, uint64_t>> getTopNGrams(const WordCounts& ngramFreq, int topN) {
+    ProfileScope scope("sort");
+    using Entry = pair<const string_view, uint64_t>;
+    vector<const Entry*> ngrams;
+    ngrams.reserve(ngramFreq.size());
+    for (const Entry& entry : ngramFreq) {
+        ngrams.push_back(&entry);
+    }
 
-    // Сортування за частотою (спадання)
+    // Сортування за частотою (спадання), за однакової частоти - за абеткою,
+    // щоб результат не залежав від порядку в хеш-таблиці
     sort(ngrams.begin(), ngrams.end(),
-        [](const pair<string, int>& a, const pair<string, int>& b) {
-            return a.second > b.second;
+        [](const Entry* a, const Entry* b) {
+            return a->second != b->second ? a->second > b->second : a->first < b->first;
         });
 
     // Повертаємо топ-N елементів
-    if (ngrams.size() > topN) {
-        ngrams.resize(topN);
+    vector<pair<string, uint64_t>> top;
+    for (size_t i = 0; i < ngrams.size() && i < size_t(topN); ++i) {
+        top.emplace_back(string(ngrams[i]->first), ngrams[i]->second);
     }
 
-    return ngrams;
+    return top;
 }
 
 // Функція для виведення топ-N n-грам у консоль
-void printTopNGrams(const vector<pair<string, int>>& topNGrams, const string& title) {
-    cout << title << ":" << endl;
+void printTopNGrams(const vector<pair<string, uint64_t>>& topNGrams, const string& title) {
+    cout << title << ":\n";
     for (size_t i = 0; i < topNGrams.size(); ++i) {
         cout << "[" << topNGrams[i].first << "]: " << topNGrams[i].second;
         if (i < topNGrams.size() - 1) cout << ", ";
-        if ((i + 1) % 5 == 0) cout << endl;
+        if ((i + 1) % 5 == 0) cout << "\n";
     }
-    cout << endl << endl;
+    cout << "\n\n";
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    profiler_init();
+
+    // --ngrams: додатково рахуються символьні n-грами ковзним вікном
+    // --fresh: знімок попереднього запуску ігнорується, все рахується заново
+    // Далі - вхідні файли (за замовчуванням INPUT_FILE_NAME)
+    bool charNGrams = false;
+    bool fresh = false;
+    vector<string> inputPaths;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--ngrams") {
+            charNGrams = true;
+        }
+        else if (arg == "--fresh") {
+            fresh = true;
+        }
+        else if (arg.rfind("--", 0) != 0) {
+            inputPaths.push_back(arg);
+        }
+        else {
+            cerr << "Usage: lab1 [--ngrams] [--fresh] [input files...]" << endl;
+            return 1;
+        }
+    }
+    if (inputPaths.empty()) inputPaths.push_back(INPUT_FILE_NAME);
+
     // Отримуємо робочий зошит
+    ProfileScope stage("xlsx load");
     xlnt::workbook wb;
     try {
         wb.load(OUTPUT_FILE_NAME);
@@ -79,149 +219,252 @@ int main() {
     }
     xlnt::worksheet ws = wb.active_sheet();
 
-    // Отримуємо текст
-    ifstream file(INPUT_FILE_NAME);
-    if (!file.is_open()) {
-        cerr << "Cannot open " << INPUT_FILE_NAME << "!" << endl;
+    // === ЗНІМОК ПОПЕРЕДНЬОГО ЗАПУСКУ ===
+    stage.stop();
+    const Alphabet& alphabet = analyzerAlphabet();
+    Snapshot snapshot;
+    bool resumed = false;
+    if (!fresh) {
+        try {
+            resumed = loadSnapshot(SNAPSHOT_FILE_NAME, snapshot, alphabet);
+        }
+        catch (const std::exception& e) {
+            cerr << e.what() << "; counting from scratch." << endl;
+        }
+        if (resumed && bool(snapshot.ngrams) != charNGrams) {
+            cerr << SNAPSHOT_FILE_NAME << " was made " << (charNGrams ? "without" : "with")
+                << " --ngrams; counting from scratch." << endl;
+            resumed = false;
+        }
+    }
+    auto startFromScratch = [&]() {
+        snapshot = Snapshot();
+        if (charNGrams) snapshot.ngrams = make_unique<NGramCounter>(alphabet);
+    };
+    if (!resumed) startFromScratch();
+
+    // Отримуємо текст: лише байти, дописані після попереднього запуску
+    stage.next("read");
+    vector<string> buffers(inputPaths.size());
+    auto readInputs = [&]() {
+        for (size_t i = 0; i < inputPaths.size(); i++) {
+            string problem;
+            if (!readAppended(snapshot.progress(inputPaths[i]), buffers[i], problem)) {
+                cerr << inputPaths[i] << ": " << problem << "; counting from scratch." << endl;
+                return false;
+            }
+        }
+        return true;
+    };
+    try {
+        if (!readInputs()) {
+            resumed = false;
+            startFromScratch();
+            readInputs();
+        }
+    }
+    catch (const std::exception& e) {
+        cerr << e.what() << endl;
         return 1;
     }
 
-    string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
-    file.close();
+    // Нова частина кожного буфера (перед нею - контрольні байти знімка);
+    // зсув і хеш знімка переносяться на кінець буфера, поки він не змінений
+    vector<FileProgress*> progress;
+    vector<string_view> newText;
+    uint64_t newBytes = 0;
+    for (size_t i = 0; i < inputPaths.size(); i++) {
+        progress.push_back(&snapshot.progress(inputPaths[i]));
+        newText.push_back(string_view(buffers[i]).substr(size_t(progress[i]->checkLength)));
+        newBytes += newText[i].size();
+        markCounted(*progress[i], buffers[i]);
+    }
+    stage.add_bytes(newBytes);
 
     // Перетворюємо на нижній регістр
-    for (char& c : text) {
-        c = tolower((unsigned char)c);
+    stage.next("lowercase", newBytes);
+    for (size_t i = 0; i < buffers.size(); i++) {
+        size_t from = buffers[i].size() - newText[i].size();
+        to_lower_utf8(buffers[i].data() + from, newText[i].size());
     }
 
-    cout << "=== AUTOMATIC CHARACTER AND N-GRAM ANALYSIS ===" << endl << endl;
+    cout << "=== AUTOMATIC CHARACTER AND N-GRAM ANALYSIS ===\n\n";
+    if (resumed) {
+        cout << "Resumed from " << SNAPSHOT_FILE_NAME << ": " << newBytes << " new bytes in "
+            << inputPaths.size() << " file(s)\n\n";
+    }
 
     // === АНАЛІЗ СИМВОЛІВ ===
-    unordered_map<char, int> charFreq;
-    for (char c : text) {
-        if (isValidChar(c) || c == ' ') {
-            charFreq[c]++;
-        }
+    stage.next("count chars", newBytes);
+    for (string_view text : newText) {
+        alphabet.scan(text, [&](int c) { snapshot.charCounts[c]++; });
+    }
+    // Пари (індекс символу, частота)
+    vector<pair<int, uint64_t>> sortedChars;
+    unordered_map<string, uint64_t> charFreq;
+    for (int c = 0; c < alphabet.size(); c++) {
+        if (!snapshot.charCounts[c]) continue;
+        sortedChars.emplace_back(c, snapshot.charCounts[c]);
+        charFreq[string(alphabet.utf8(c))] = snapshot.charCounts[c];
     }
 
-    // Сортуємо символи за частотою
-    vector<pair<char, int>> sortedChars(charFreq.begin(), charFreq.end());
+    // Сортуємо символи за частотою (за однакової - за кодом символу)
+    stage.next("sort chars");
     sort(sortedChars.begin(), sortedChars.end(),
-        [](const pair<char, int>& a, const pair<char, int>& b) {
-            return a.second > b.second;
+        [&](const pair<int, uint64_t>& a, const pair<int, uint64_t>& b) {
+            return a.second != b.second ? a.second > b.second : alphabet.symbol(a.first) < alphabet.symbol(b.first);
         });
 
-    cout << "CHARACTER FREQUENCIES:" << endl;
+    stage.next("print chars");
+    cout << "CHARACTER FREQUENCIES:\n";
     for (size_t i = 0; i < sortedChars.size(); ++i) {
-        if (sortedChars[i].first == ' ') {
+        if (alphabet.symbol(sortedChars[i].first) == ' ') {
             cout << "[space]: " << sortedChars[i].second;
         }
         else {
-            cout << "[" << sortedChars[i].first << "]: " << sortedChars[i].second;
+            cout << "[" << alphabet.utf8(sortedChars[i].first) << "]: " << sortedChars[i].second;
         }
         if (i < sortedChars.size() - 1) cout << ", ";
-        if ((i + 1) % 8 == 0) cout << endl;
+        if ((i + 1) % 8 == 0) cout << "\n";
     }
-    cout << endl << endl;
+    cout << "\n\n";
 
     // Завантажуємо частоти символів у Excel
+    stage.next("xlsx fill");
     loadFreqToExcel(ws, 1, 2, charFreq);
 
-    // === РОЗБІР ТЕКСТУ НА СЛОВА ===
-    vector<string> words;
-    string currentWord;
-
-    for (char c : text) {
-        if (isValidChar(c)) {
-            currentWord += c;
+    // === СИМВОЛЬНІ N-ГРАМИ ===
+    // (по неперервному потоку символів кожного файлу, а не по словах; стовпці 9-20)
+    if (charNGrams) {
+        stage.next("count char n-grams", newBytes);
+        for (size_t i = 0; i < newText.size(); i++) {
+            snapshot.ngrams->add(newText[i], progress[i]->ngrams);
         }
-        else if (c == ' ' && !currentWord.empty()) {
-            words.push_back(currentWord);
-            currentWord.clear();
+
+        stage.next("top-n char n-grams");
+        for (int n = 1; n <= NGRAM_MAX; n++) {
+            vector<pair<string, uint64_t>> topNGrams = snapshot.ngrams->top(n, 20);
+            printTopNGrams(topNGrams, "TOP 20 CHARACTER " + to_string(n) + "-GRAMS (" +
+                to_string(snapshot.ngrams->total(n)) + " total)");
+            loadFreqToExcel(ws, 7 + 2 * n, 8 + 2 * n, unordered_map<string, uint64_t>(topNGrams.begin(), topNGrams.end()));
         }
     }
-    // Додаємо останнє слово, якщо воно є
-    if (!currentWord.empty()) {
-        words.push_back(currentWord);
-    }
 
-    cout << "Total words found: " << words.size() << endl << endl;
-
-    // === АНАЛІЗ СЛІВ РІЗНОЇ ДОВЖИНИ ===
-    unordered_map<string, int> bigramWords;   // слова з 2 символів
-    unordered_map<string, int> trigramWords;  // слова з 3 символів  
-    unordered_map<string, int> fourgramWords; // слова з 4 символів
-    unordered_map<string, int> otherWords;    // слова іншої довжини
+    // === РОЗБІР ТЕКСТУ НА СЛОВА ТА ПІДРАХУНОК ===
+    stage.next("split and count words", newBytes);
+
+    // Різні слова та лічильники живуть в арені, яка звільняється одним махом
+    // наприкінці; за один прохід оновлюються і всі слова, і групи за довжиною
+    size_t knownWordBytes = 0;
+    for (const auto& word : snapshot.words) knownWordBytes += word.first.size();
+    JobArena arena(knownWordBytes * 2 + size_t(newBytes) * 2);
+    WordTable allWords(arena.get());
+    WordCounts bigramWords(arena.get());   // слова з 2 символів
+    WordCounts trigramWords(arena.get());  // слова з 3 символів
+    WordCounts fourgramWords(arena.get()); // слова з 4 символів
+    WordCounts otherWords(arena.get());    // слова іншої довжини
+
+    // Групи за кількістю символів слова (кирилична літера займає 2 байти)
+    auto lengthGroup = [&](size_t length) -> WordCounts& {
+        if (length == 2) return bigramWords;
+        if (length == 3) return trigramWords;
+        if (length == 4) return fourgramWords;
+        return otherWords;
+    };
+
+    // Слова зі знімка
+    for (const auto& entry : snapshot.words) {
+        string_view word = allWords.add(entry.first, entry.second);
+        lengthGroup(symbolCount(alphabet, word))[word] += entry.second;
+    }
 
-    for (const auto& word : words) {
-        int length = word.length();
+    for (size_t i = 0; i < newText.size(); i++) {
+        FileProgress& file = *progress[i];
 
-        if (length == 2) {
-            bigramWords[word]++;
-        }
-        else if (length == 3) {
-            trigramWords[word]++;
-        }
-        else if (length == 4) {
-            fourgramWords[word]++;
-        }
-        else {
-            otherWords[word]++;
+        // Незавершене слово з кінця файлу рахується заново разом з продовженням
+        if (!file.openWord.empty()) {
+            allWords.remove(file.openWord);
+            WordCounts& group = lengthGroup(symbolCount(alphabet, file.openWord));
+            auto it = group.find(file.openWord);
+            if (it != group.end() && --it->second == 0) group.erase(it);
+            snapshot.totalWords--;
         }
+
+        // Розбиття на місці, у новій частині буфера (після нього текст уже не потрібен)
+        char* text = buffers[i].data() + (buffers[i].size() - newText[i].size());
+        snapshot.totalWords += splitWords(alphabet, text, newText[i].size(), [&](string_view token, size_t symbols) {
+            string_view word = allWords.add(token);
+            lengthGroup(symbols)[word]++;
+        }, file.openWord);
     }
 
+    cout << "Total words found: " << snapshot.totalWords << "\n\n";
+
     // === ВИВЕДЕННЯ РЕЗУЛЬТАТІВ ===
+    stage.next("top-n words");
 
     // Біграми (слова з 2 символів)
-    vector<pair<string, int>> topBigrams = getTopNGrams(bigramWords, 20);
+    vector<pair<string, uint64_t>> topBigrams = getTopNGrams(bigramWords, 20);
     printTopNGrams(topBigrams, "TOP 20 BIGRAMS (2-character words)");
-    loadFreqToExcel(ws, 3, 4, unordered_map<string, int>(topBigrams.begin(), topBigrams.end()));
+    loadFreqToExcel(ws, 3, 4, unordered_map<string, uint64_t>(topBigrams.begin(), topBigrams.end()));
 
     // Триграми (слова з 3 символів)
-    vector<pair<string, int>> topTrigrams = getTopNGrams(trigramWords, 20);
+    vector<pair<string, uint64_t>> topTrigrams = getTopNGrams(trigramWords, 20);
     printTopNGrams(topTrigrams, "TOP 20 TRIGRAMS (3-character words)");
-    loadFreqToExcel(ws, 5, 6, unordered_map<string, int>(topTrigrams.begin(), topTrigrams.end()));
+    loadFreqToExcel(ws, 5, 6, unordered_map<string, uint64_t>(topTrigrams.begin(), topTrigrams.end()));
 
     // Чотириграми (слова з 4 символів)
-    vector<pair<string, int>> topFourgrams = getTopNGrams(fourgramWords, 20);
+    vector<pair<string, uint64_t>> topFourgrams = getTopNGrams(fourgramWords, 20);
     printTopNGrams(topFourgrams, "TOP 20 FOURGRAMS (4-character words)");
-    loadFreqToExcel(ws, 7, 8, unordered_map<string, int>(topFourgrams.begin(), topFourgrams.end()));
+    loadFreqToExcel(ws, 7, 8, unordered_map<string, uint64_t>(topFourgrams.begin(), topFourgrams.end()));
 
     // Загальна статистика по словах
-    cout << "WORD LENGTH STATISTICS:" << endl;
+    stage.next("word stats");
+    cout << "WORD LENGTH STATISTICS:\n";
     cout << "2-character words: " << bigramWords.size() << " unique, " <<
-        accumulate(bigramWords.begin(), bigramWords.end(), 0,
-            [](int sum, const auto& pair) { return sum + pair.second; }) << " total" << endl;
+        accumulate(bigramWords.begin(), bigramWords.end(), uint64_t(0),
+            [](uint64_t sum, const auto& pair) { return sum + pair.second; }) << " total\n";
     cout << "3-character words: " << trigramWords.size() << " unique, " <<
-        accumulate(trigramWords.begin(), trigramWords.end(), 0,
-            [](int sum, const auto& pair) { return sum + pair.second; }) << " total" << endl;
+        accumulate(trigramWords.begin(), trigramWords.end(), uint64_t(0),
+            [](uint64_t sum, const auto& pair) { return sum + pair.second; }) << " total\n";
     cout << "4-character words: " << fourgramWords.size() << " unique, " <<
-        accumulate(fourgramWords.begin(), fourgramWords.end(), 0,
-            [](int sum, const auto& pair) { return sum + pair.second; }) << " total" << endl;
+        accumulate(fourgramWords.begin(), fourgramWords.end(), uint64_t(0),
+            [](uint64_t sum, const auto& pair) { return sum + pair.second; }) << " total\n";
     cout << "Other words: " << otherWords.size() << " unique, " <<
-        accumulate(otherWords.begin(), otherWords.end(), 0,
-            [](int sum, const auto& pair) { return sum + pair.second; }) << " total" << endl;
-    cout << endl;
+        accumulate(otherWords.begin(), otherWords.end(), uint64_t(0),
+            [](uint64_t sum, const auto& pair) { return sum + pair.second; }) << " total\n";
+    cout << "\n";
 
     // Топ-20 всіх слів
-    unordered_map<string, int> allWordFreq;
-    for (const auto& word : words) {
-        allWordFreq[word]++;
-    }
-
-    vector<pair<string, int>> topAllWords = getTopNGrams(allWordFreq, 20);
-    cout << "TOP 20 ALL WORDS:" << endl;
+    stage.next("top-n all words");
+    vector<pair<string, uint64_t>> topAllWords = getTopNGrams(allWords.all(), 20);
+    cout << "TOP 20 ALL WORDS:\n";
     for (size_t i = 0; i < topAllWords.size(); ++i) {
         cout << "[" << topAllWords[i].first << "]: " << topAllWords[i].second;
         if (i < topAllWords.size() - 1) cout << ", ";
-        if ((i + 1) % 5 == 0) cout << endl;
+        if ((i + 1) % 5 == 0) cout << "\n";
+    }
+    cout << "\n";
+
+    // Зберігаємо знімок для наступного запуску
+    stage.stop();
+    snapshot.words.clear();
+    snapshot.words.reserve(allWords.all().size());
+    for (const auto& entry : allWords.all()) {
+        snapshot.words.emplace_back(string(entry.first), entry.second);
+    }
+    try {
+        saveSnapshot(SNAPSHOT_FILE_NAME, snapshot, alphabet);
+    }
+    catch (const std::exception& e) {
+        cerr << e.what() << endl;
     }
-    cout << endl;
 
     // Зберігаємо результати
+    stage.next("xlsx save");
     try {
         wb.save(OUTPUT_FILE_NAME);
-        cout << "Results successfully saved to " << OUTPUT_FILE_NAME << endl;
+        cout << "Results successfully saved to " << OUTPUT_FILE_NAME << "\n";
     }
     catch (const std::exception&) {
         cerr << "Cannot save " << OUTPUT_FILE_NAME << "!" << endl;
@@ -0,0 +1,270 @@
+#include <algorithm>
+#include "binary_io.h"
+#include "ngram_counter.h"
+#include "../common/profiler.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <xmmintrin.h>
+#define PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#elif defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+using namespace std;
+
+
+NGramCounter::SparseCounts::SparseCounts() : slots(size_t(1) << 16), bits(16) {}
+
+void NGramCounter::SparseCounts::prefetch(uint64_t code) const {
+    PREFETCH(&slots[size_t(((code + 1) * 0x9E3779B97F4A7C15ull) >> (64 - bits))]);
+}
+
+void NGramCounter::SparseCounts::insert(size_t slot, uint64_t key, uint64_t by) {
+    // Заповнення не більше половини, інакше ланцюжки пробування довшають
+    if (2 * (used + 1) > slots.size()) {
+        grow();
+        increment(key - 1, by);
+        return;
+    }
+    slots[slot] = { key, by };
+    used++;
+}
+
+void NGramCounter::SparseCounts::grow() {
+    vector<Slot> old(slots.size() * 2, Slot{ 0, 0 });
+    old.swap(slots);
+    bits++;
+    size_t mask = slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.key == 0) continue;
+        size_t i = size_t((slot.key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+        while (slots[i].key != 0) i = (i + 1) & mask;
+        slots[i] = slot;
+    }
+}
+
+
+static uint64_t power(uint64_t base, int exponent) {
+    uint64_t result = 1;
+    while (exponent-- > 0) result *= base;
+    return result;
+}
+
+// Зсувний регістр: по SYMBOL_BITS біт на символ, останній символ - в молодших бітах
+static const int SYMBOL_BITS = 6;
+static const uint64_t SYMBOL_MASK = (uint64_t(1) << SYMBOL_BITS) - 1;
+static const uint64_t WINDOW_MASK = (uint64_t(1) << (SYMBOL_BITS * (NGRAM_MAX - 1))) - 1;
+
+// Код останніх n символів регістра
+static uint64_t packedToCode(uint64_t packed, int n, uint64_t base) {
+    uint64_t code = 0;
+    for (int i = n - 1; i >= 0; i--) {
+        code = code * base + ((packed >> (SYMBOL_BITS * i)) & SYMBOL_MASK);
+    }
+    return code;
+}
+
+// То саме для 4-грами, розгорнуте: рахується на кожен символ
+static inline uint64_t fourgramCode(uint64_t packed, uint64_t base) {
+    uint64_t a = (packed >> (SYMBOL_BITS * 3)) & SYMBOL_MASK;
+    uint64_t b = (packed >> (SYMBOL_BITS * 2)) & SYMBOL_MASK;
+    uint64_t c = (packed >> SYMBOL_BITS) & SYMBOL_MASK;
+    uint64_t d = packed & SYMBOL_MASK;
+    return ((a * base + b) * base + c) * base + d;
+}
+
+NGramCounter::NGramCounter(const Alphabet& alphabet)
+    : alphabet(&alphabet), base(uint64_t(alphabet.size())),
+      fourgrams(size_t(power(uint64_t(alphabet.size()), NGRAM_DENSE)), 0) {
+    for (int c = 0; c < 128; c++) asciiIndex[c] = int8_t(alphabet.index(char32_t(c)));
+    int space = alphabet.index(' ');
+    if (space >= 0) {
+        for (int c : { '\t', '\n', '\v', '\f' }) asciiIndex[c] = int8_t(space);
+    }
+}
+
+void NGramCounter::add(string_view text, NGramStream& stream) {
+    ProfileScope scope("char n-grams", text.size());
+
+    // Текст обробляється блоками: спершу регістри вікна для всіх символів
+    // блоку (ланцюжок залежностей - лише зсув і "або"), потім лічильники.
+    // Окремі прості цикли виконуються значно швидше за один змішаний
+    const size_t BLOCK = 4096;
+    uint64_t packed[BLOCK];
+    uint64_t* dense = fourgrams.data();
+    const uint64_t base = this->base;
+    const char* data = text.data();
+    const char* dataEnd = data + text.size();
+    uint64_t window = stream.window;
+    uint64_t seen = stream.symbols;
+
+    // Блок - BLOCK байтів тексту (останній символ UTF-8 може виходити за межу)
+    for (size_t i = 0; i < text.size();) {
+        size_t end = min(text.size(), i + BLOCK);
+        size_t count = 0;
+        while (i < end) {
+            unsigned char b = (unsigned char)data[i];
+            int s;
+            if (b < 0x80) {
+                s = asciiIndex[b];
+                i++;
+            }
+            else {
+                char32_t c;
+                i += decode_utf8(data + i, dataEnd, c);
+                s = alphabet->index(c);
+            }
+            if (s < 0) continue;
+            window = ((window << SYMBOL_BITS) | uint64_t(s));
+            packed[count++] = window;
+            window &= WINDOW_MASK;
+        }
+
+        // Кількість перших символів блоку, для яких ще немає n-грами довжини n
+        // (seen і count передаються за значенням: лічильники uint64_t могли б
+        // їх псевдонімити, якби на них були посилання)
+        auto warmup = [seen, count](int n) {
+            return seen >= uint64_t(n - 1) ? size_t(0) : min(count, size_t(uint64_t(n - 1) - seen));
+        };
+
+        // Початок потоку: n-грами, що не є суфіксами 4-грам чи 6-грам
+        for (size_t i = 0; i < warmup(NGRAM_MAX); i++) {
+            uint64_t position = seen + i;
+            for (int n = 1; n <= int(position) + 1; n++) {
+                int source = n < NGRAM_DENSE ? NGRAM_DENSE : NGRAM_MAX;
+                if (n != source && position < uint64_t(source - 1)) heads[n].push_back(packedToCode(packed[i], n, base));
+            }
+        }
+        for (int n = 1; n <= NGRAM_MAX; n++) totals[n] += count - warmup(n);
+
+        const size_t firstDense = warmup(NGRAM_DENSE);
+        const size_t firstFull = warmup(NGRAM_MAX);
+        for (size_t i = firstDense; i < count; i++) dense[fourgramCode(packed[i], base)]++;
+        // Комірки великої таблиці запитуються на кілька символів наперед
+        const size_t AHEAD = 8;
+        for (size_t i = firstFull; i < count; i++) {
+            if (i + AHEAD < count) sixgrams.prefetch(packed[i + AHEAD]);
+            sixgrams.increment(packed[i]);
+        }
+        seen += count;
+    }
+
+    stream.window = window;
+    stream.symbols = seen;
+}
+
+uint64_t NGramCounter::total(int n) const {
+    if (n < 1 || n > NGRAM_MAX) return 0;
+    return totals[n];
+}
+
+vector<pair<uint64_t, uint64_t>> NGramCounter::counts(int n) const {
+    vector<pair<uint64_t, uint64_t>> result;
+    if (n < 1 || n > NGRAM_MAX) return result;
+
+    if (n == NGRAM_DENSE) {
+        for (size_t code = 0; code < fourgrams.size(); code++) {
+            if (fourgrams[code]) result.emplace_back(uint64_t(code), fourgrams[code]);
+        }
+        return result;
+    }
+    if (n == NGRAM_MAX) {
+        for (const auto& slot : sixgrams.slots) {
+            if (slot.key) result.emplace_back(packedToCode(slot.key - 1, NGRAM_MAX, base), slot.count);
+        }
+        return result;
+    }
+
+    // Суфікси довших n-грам і n-грами з початку потоків
+    SparseCounts suffixes;
+    if (n < NGRAM_DENSE) {
+        uint64_t modulus = power(base, n);
+        for (size_t code = 0; code < fourgrams.size(); code++) {
+            if (fourgrams[code]) suffixes.increment(code % modulus, fourgrams[code]);
+        }
+    }
+    else {
+        for (const auto& slot : sixgrams.slots) {
+            if (slot.key) suffixes.increment(packedToCode(slot.key - 1, n, base), slot.count);
+        }
+    }
+    for (uint64_t code : heads[n]) suffixes.increment(code);
+
+    for (const auto& slot : suffixes.slots) {
+        if (slot.key) result.emplace_back(slot.key - 1, slot.count);
+    }
+    return result;
+}
+
+void NGramCounter::save(ostream& out) const {
+    for (int n = 1; n <= NGRAM_MAX; n++) {
+        writeU64(out, totals[n]);
+        writeU64(out, heads[n].size());
+        for (uint64_t code : heads[n]) writeU64(out, code);
+    }
+
+    // Лише ненульові лічильники: пари (ключ, частота)
+    writeU64(out, uint64_t(count_if(fourgrams.begin(), fourgrams.end(), [](uint64_t c) { return c != 0; })));
+    for (size_t code = 0; code < fourgrams.size(); code++) {
+        if (!fourgrams[code]) continue;
+        writeU64(out, code);
+        writeU64(out, fourgrams[code]);
+    }
+    writeU64(out, sixgrams.used);
+    for (const auto& slot : sixgrams.slots) {
+        if (!slot.key) continue;
+        writeU64(out, slot.key - 1);
+        writeU64(out, slot.count);
+    }
+}
+
+void NGramCounter::load(istream& in) {
+    *this = NGramCounter(*alphabet);
+    for (int n = 1; n <= NGRAM_MAX; n++) {
+        totals[n] = readU64(in);
+        uint64_t headCount = readU64(in);
+        for (uint64_t i = 0; i < headCount; i++) heads[n].push_back(readU64(in));
+    }
+
+    uint64_t denseCount = readU64(in);
+    for (uint64_t i = 0; i < denseCount; i++) {
+        uint64_t code = readU64(in);
+        uint64_t count = readU64(in);
+        if (code >= fourgrams.size()) throw runtime_error("Snapshot is damaged");
+        fourgrams[size_t(code)] = count;
+    }
+    uint64_t sparseCount = readU64(in);
+    for (uint64_t i = 0; i < sparseCount; i++) {
+        uint64_t key = readU64(in);
+        uint64_t count = readU64(in);
+        sixgrams.increment(key, count);
+    }
+}
+
+vector<pair<string, uint64_t>> NGramCounter::top(int n, int topN) const {
+    vector<pair<uint64_t, uint64_t>> entries = counts(n); // (код, частота)
+
+    size_t shown = min(entries.size(), size_t(max(topN, 0)));
+    partial_sort(entries.begin(), entries.begin() + shown, entries.end(),
+        [](const pair<uint64_t, uint64_t>& a, const pair<uint64_t, uint64_t>& b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+
+    vector<pair<string, uint64_t>> result;
+    result.reserve(shown);
+    for (size_t i = 0; i < shown; i++) {
+        result.emplace_back(decode(entries[i].first, n), entries[i].second);
+    }
+    return result;
+}
+
+string NGramCounter::decode(uint64_t code, int n) const {
+    string ngram;
+    for (int i = 0; i < n; i++) {
+        ngram.insert(0, alphabet->utf8(int(code % base)));
+        code /= base;
+    }
+    return ngram;
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "../common/alphabet.h"
+
+
+// Частоти символьних n-грам (n = 1..NGRAM_MAX) ковзним вікном по
+// неперервному потоку символів тексту.
+//
+// Символи - символи алфавіту аналізатора (великі літери зводяться до малих,
+// текст - UTF-8); якщо в алфавіті є пробіл, інші пробільні символи ASCII,
+// крім \r, вважаються пробілом, решта пропускається (тож кінці рядків CRLF
+// і LF дають однакові n-грами).
+// n-грама кодується числом в системі з основою "розмір алфавіту"; всередині
+// вікно - це зсувний регістр по 6 біт на символ, щоб вилучення
+// найдавнішого символу не вимагало ділення.
+//
+// На кожен символ рахуються лише 4-грами (щільний масив за кодом) і 6-грами
+// (хеш-таблиця з відкритою адресацією). Коротші n-грами виводяться з них
+// під час запиту: n-грама, що закінчується в позиції p, - це суфікс 4-грами
+// (6-грами), що закінчується там само. Для перших символів потоку довшої
+// n-грами немає, тож ці кілька n-грам запам'ятовуються окремо. Початок
+// потоку з часом не змінюється, тому потік можна продовжити будь-коли.
+
+const int NGRAM_MAX = 6;
+const int NGRAM_DENSE = 4;
+
+// Стан одного потоку символів (наприклад, файлу, до якого дописують текст)
+struct NGramStream {
+    uint64_t window = 0;  // останні min(symbols, NGRAM_MAX - 1) символів, по 6 біт
+    uint64_t symbols = 0;
+};
+
+class NGramCounter {
+public:
+    explicit NGramCounter(const Alphabet& alphabet);
+
+    // Потік продовжується з того місця, де зупинився попередній виклик
+    void add(std::string_view text, NGramStream& stream);
+
+    // Кількість n-грам, порахованих для даного n
+    uint64_t total(int n) const;
+
+    // Усі n-грами з ненульовою частотою: пари (код, частота)
+    std::vector<std::pair<uint64_t, uint64_t>> counts(int n) const;
+
+    // Топ-N n-грам за частотою (за однакової частоти - за абеткою символів)
+    std::vector<std::pair<std::string, uint64_t>> top(int n, int topN) const;
+
+    // Лічильники у двійковому знімку (див. snapshot.h)
+    void save(std::ostream& out) const;
+    void load(std::istream& in);
+
+    // n-грама за кодом
+    std::string decode(uint64_t code, int n) const;
+
+private:
+    // Хеш-таблиця ключ -> лічильник з лінійним пробуванням;
+    // ключ зберігається зі зсувом +1, 0 - вільна комірка
+    struct SparseCounts {
+        struct Slot {
+            uint64_t key;
+            uint64_t count;
+        };
+        std::vector<Slot> slots;
+        size_t used = 0;
+        int bits;
+
+        SparseCounts();
+
+        void increment(uint64_t code, uint64_t by = 1) {
+            uint64_t key = code + 1;
+            size_t mask = slots.size() - 1;
+            size_t i = size_t((key * 0x9E3779B97F4A7C15ull) >> (64 - bits));
+            while (true) {
+                Slot& slot = slots[i];
+                if (slot.key == key) {
+                    slot.count += by;
+                    return;
+                }
+                if (slot.key == 0) {
+                    insert(i, key, by);
+                    return;
+                }
+                i = (i + 1) & mask;
+            }
+        }
+
+        // Підказка процесору завантажити комірку коду заздалегідь
+        void prefetch(uint64_t code) const;
+
+        void insert(size_t slot, uint64_t key, uint64_t by);
+        void grow();
+    };
+
+    const Alphabet* alphabet;
+    uint64_t base;                // розмір алфавіту
+    int8_t asciiIndex[128];       // індекси символів ASCII з урахуванням пробільних
+
+    std::vector<uint64_t> fourgrams;
+
+    // Ключі sixgrams - 6-грами у вигляді зсувного регістра, а не коди
+    SparseCounts sixgrams;
+
+    // Коди n-грам з початку потоків, які не є суфіксами порахованих
+    // 4-грам чи 6-грам (кілька на потік)
+    std::vector<uint64_t> heads[NGRAM_MAX + 1];
+
+    uint64_t totals[NGRAM_MAX + 1] = {};
+};
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include "binary_io.h"
+#include "snapshot.h"
+#include "../common/profiler.h"
+
+using namespace std;
+
+
+static const char SNAPSHOT_MAGIC[8] = { 'L', 'A', 'B', '1', 'S', 'N', 'A', 'P' };
+
+
+FileProgress& Snapshot::progress(const string& path) {
+    for (FileProgress& file : files) {
+        if (file.path == path) return file;
+    }
+    files.emplace_back();
+    files.back().path = path;
+    return files.back();
+}
+
+uint64_t fnv1a(string_view data) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (unsigned char c : data) {
+        hash ^= c;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+bool readSnapshotAlphabet(const string& path, string& symbols) {
+    ifstream in(path, ios::binary);
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) return false;
+    try {
+        if (readU64(in) != SNAPSHOT_VERSION) return false;
+        symbols = readString(in);
+    }
+    catch (const runtime_error&) {
+        return false;
+    }
+    return true;
+}
+
+bool loadSnapshot(const string& path, Snapshot& snapshot, const Alphabet& alphabet) {
+    ifstream in(path, ios::binary);
+    if (!in.is_open()) return false;
+    ProfileScope scope("snapshot load");
+
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+        throw runtime_error(path + " is not a lab1 snapshot");
+    if (readU64(in) != SNAPSHOT_VERSION) throw runtime_error(path + " was written by another version of lab1");
+    if (readString(in) != alphabet.str()) throw runtime_error(path + " was made for another alphabet");
+
+    for (uint64_t& count : snapshot.charCounts) count = readU64(in);
+    snapshot.totalWords = readU64(in);
+
+    uint64_t wordCount = readU64(in);
+    snapshot.words.clear();
+    snapshot.words.reserve(size_t(min<uint64_t>(wordCount, 1 << 20)));
+    for (uint64_t i = 0; i < wordCount; i++) {
+        string word = readString(in);
+        uint64_t count = readU64(in);
+        snapshot.words.emplace_back(move(word), count);
+    }
+
+    snapshot.ngrams.reset();
+    if (readU64(in)) {
+        snapshot.ngrams = make_unique<NGramCounter>(alphabet);
+        snapshot.ngrams->load(in);
+    }
+
+    uint64_t fileCount = readU64(in);
+    snapshot.files.clear();
+    for (uint64_t i = 0; i < fileCount; i++) {
+        FileProgress file;
+        file.path = readString(in);
+        file.offset = readU64(in);
+        file.checkLength = readU64(in);
+        file.checkHash = readU64(in);
+        file.openWord = readString(in);
+        file.ngrams.window = readU64(in);
+        file.ngrams.symbols = readU64(in);
+        if (file.checkLength > file.offset) throw runtime_error(path + " is damaged");
+        snapshot.files.push_back(move(file));
+    }
+    return true;
+}
+
+void saveSnapshot(const string& path, const Snapshot& snapshot, const Alphabet& alphabet) {
+    ProfileScope scope("snapshot save");
+    string temporaryPath = path + ".tmp";
+    {
+        ofstream out(temporaryPath, ios::binary | ios::trunc);
+        if (!out.is_open()) throw runtime_error("Cannot open " + temporaryPath + " for writing!");
+
+        out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        writeU64(out, SNAPSHOT_VERSION);
+        writeString(out, alphabet.str());
+
+        for (uint64_t count : snapshot.charCounts) writeU64(out, count);
+        writeU64(out, snapshot.totalWords);
+
+        writeU64(out, snapshot.words.size());
+        for (const auto& word : snapshot.words) {
+            writeString(out, word.first);
+            writeU64(out, word.second);
+        }
+
+        writeU64(out, snapshot.ngrams ? 1 : 0);
+        if (snapshot.ngrams) snapshot.ngrams->save(out);
+
+        writeU64(out, snapshot.files.size());
+        for (const FileProgress& file : snapshot.files) {
+            writeString(out, file.path);
+            writeU64(out, file.offset);
+            writeU64(out, file.checkLength);
+            writeU64(out, file.checkHash);
+            writeString(out, file.openWord);
+            writeU64(out, file.ngrams.window);
+            writeU64(out, file.ngrams.symbols);
+        }
+
+        if (!out.flush()) throw runtime_error("Cannot write " + temporaryPath + "!");
+    }
+    filesystem::rename(temporaryPath, path);
+}
+
+bool readAppended(const FileProgress& progress, string& buffer, string& problem) {
+    ifstream file(progress.path, ios::binary);
+    if (!file.is_open()) throw runtime_error("Cannot open " + progress.path + "!");
+
+    file.seekg(0, ios::end);
+    uint64_t size = uint64_t(file.tellg());
+    if (size < progress.offset) {
+        problem = "the file is shorter than at the last run";
+        return false;
+    }
+
+    uint64_t start = progress.offset - progress.checkLength;
+    buffer.resize(size_t(size - start));
+    file.seekg(streamoff(start));
+    if (!file.read(buffer.data(), streamsize(buffer.size()))) throw runtime_error("Cannot read " + progress.path + "!");
+
+    if (progress.checkLength > 0 && fnv1a(string_view(buffer).substr(0, size_t(progress.checkLength))) != progress.checkHash) {
+        problem = "the text counted at the last run has changed";
+        return false;
+    }
+
+    // Символ UTF-8, дописаний не до кінця, лишається на наступний запуск
+    size_t counted = size_t(progress.checkLength);
+    buffer.resize(counted + utf8_complete_length(string_view(buffer).substr(counted)));
+    return true;
+}
+
+void markCounted(FileProgress& progress, string_view buffer) {
+    progress.offset += buffer.size() - progress.checkLength;
+    progress.checkLength = min(progress.offset, SNAPSHOT_CHECK_BYTES);
+    progress.checkHash = fnv1a(buffer.substr(buffer.size() - size_t(progress.checkLength)));
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "ngram_counter.h"
+#include "../common/alphabet.h"
+
+
+// Знімок лічильників lab1 для корпусу, до якого щодня дописують текст.
+// Наступний запуск читає з кожного файлу лише байти після збереженого
+// зсуву і додає їх до лічильників зі знімка, тож час оновлення залежить
+// від обсягу нових даних, а не всього корпусу.
+//
+// Щоб помітити файл, який переписали, а не доповнили, зберігається хеш
+// останніх байтів перед зсувом; якщо він не збігається, все рахується заново.
+
+const uint64_t SNAPSHOT_VERSION = 2;
+const uint64_t SNAPSHOT_CHECK_BYTES = 4096;
+
+// Стан обробки одного вхідного файлу
+struct FileProgress {
+    std::string path;
+    uint64_t offset = 0;       // скільки байтів файлу вже пораховано
+    uint64_t checkLength = 0;  // min(offset, SNAPSHOT_CHECK_BYTES)
+    uint64_t checkHash = 0;    // FNV-1a останніх checkLength байтів перед offset
+    std::string openWord;      // слово в кінці файлу, після якого ще не було пробілу
+    NGramStream ngrams;
+};
+
+struct Snapshot {
+    uint64_t charCounts[ALPHABET_MAX] = {};  // за індексами символів алфавіту
+    uint64_t totalWords = 0;
+    std::vector<std::pair<std::string, uint64_t>> words;
+    std::unique_ptr<NGramCounter> ngrams;  // лише якщо рахуються n-грами
+    std::vector<FileProgress> files;
+
+    FileProgress& progress(const std::string& path);
+};
+
+uint64_t fnv1a(std::string_view data);
+
+// Алфавіт знімка (символи рядком UTF-8) з його заголовка; false, якщо файл
+// не є знімком цієї версії. lab3 так відрізняє знімок від еталонного тексту
+bool readSnapshotAlphabet(const std::string& path, std::string& symbols);
+
+// false, якщо файлу знімка немає; виняток, якщо він пошкоджений
+// або зроблений для іншого алфавіту
+bool loadSnapshot(const std::string& path, Snapshot& snapshot, const Alphabet& alphabet);
+
+// Пише в тимчасовий файл і перейменовує, щоб обірваний запис не зіпсував знімок
+void saveSnapshot(const std::string& path, const Snapshot& snapshot, const Alphabet& alphabet);
+
+// Читає в buffer контрольні байти перед progress.offset і все, що дописано
+// після нього (без незавершеного символу UTF-8 в кінці). Повертає false
+// і причину, якщо файл змінено не дописуванням в кінець (тоді його треба
+// рахувати заново); виняток, якщо файл не відкривається.
+bool readAppended(const FileProgress& progress, std::string& buffer, std::string& problem);
+
+// Для buffer від readAppended, поки його не змінено: зсув і контрольний
+// хеш - на кінець прочитаного
+void markCounted(FileProgress& progress, std::string_view buffer);
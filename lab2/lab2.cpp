@@ -2,72 +2,253 @@
 #include <fstream>
 #include <string>
 #include <algorithm>
+#include <memory>
+#include <vector>
+#include "../common/alphabet.h"
+#include "../common/batch_files.h"
+#include "../common/cipher_engines.h"
+#include "../common/console_log.h"
+#include "../common/kernel_bench.h"
+#include "../common/ngram_fitness.h"
+#include "../common/profiler.h"
+#include "../common/read_file.h"
+#include "reference.h"
 using namespace std;
 #define OUTPUT_FILE_NAME "output.txt"
 
 
-const string alphabet = "abcdefghijklmnopqrstuvwxyz .,;-'";
-const int alphabetSize = alphabet.length();
-
-
 string encrypt(string text, int key) {
-    for (char& c : text) {
-        c = tolower((unsigned char)c);
-    }
+    ProfileScope scope("encrypt", text.size());
+    to_lower_utf8(text);
+    return caesar(lab_alphabet(), text, key);
+}
 
-    string result = "";
 
-    for (char c : text) {
-        size_t pos = alphabet.find(c);
+string decrypt(string text, int key) {
+    ProfileScope scope("decrypt", text.size());
+    to_lower_utf8(text);
+    return caesar(lab_alphabet(), text, -key);
+}
 
-        if (pos != string::npos) {
-            int newPos = (pos + key) % alphabetSize;
-            result += alphabet[newPos];
-        }
-        else {
-            result += c;
+
+// With a language model, also names the key whose decryption reads most like the reference text.
+// The ciphertext is lowercased once and every key decrypts it from there
+void bruteForce(string ciphertext, const NGramFitness* fitness) {
+    console_write("\n=== All possible decryption variants ===\n");
+    console_write("Review the results and choose the one that makes sense:\n\n");
+
+    to_lower_utf8(ciphertext);
+    int bestKey = 0;
+    double bestScore = 0;
+    for (int key = 1; key < lab_alphabet().size(); key++) {
+        ProfileScope scope("decrypt", ciphertext.size());
+        string decrypted = caesar(lab_alphabet(), ciphertext, -key);
+        scope.stop();
+        console_text("Key " + to_string(key) + ": \n", decrypted);
+        if (fitness) {
+            double score = fitness->text_score(decrypted);
+            if (bestKey == 0 || score > bestScore) {
+                bestKey = key;
+                bestScore = score;
+            }
         }
     }
-
-    return result;
+    if (bestKey) {
+        console_write("Most likely key by quadgram fitness: " + to_string(bestKey) + "\n");
+    }
+    console_flush();
 }
 
 
-string decrypt(string text, int key) {
-    for (char& c : text) {
-        c = tolower((unsigned char)c);
+// Encrypts (decrypts) one file under every key of the list: --batch INPUT KEYS [--decrypt]
+int runBatch(const string& inputPath, const string& keysPath, bool decrypting) {
+    ifstream file(inputPath);
+    if (!file.is_open()) {
+        cerr << "Cannot open " << inputPath << "!" << endl;
+        return 1;
     }
+    string text = read_whole_file(file);
+    file.close();
 
-    string result = "";
-
-    for (char c : text) {
-        size_t pos = alphabet.find(c);
+    vector<string> keys;
+    try {
+        keys = read_key_list(keysPath);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
 
-        if (pos != string::npos) {
-            int newPos = (pos - key + alphabetSize) % alphabetSize;
-            result += alphabet[newPos];
+    vector<int> shifts;
+    vector<string> paths;
+    for (const string& key : keys) {
+        size_t used = 0;
+        int shift = 0;
+        try {
+            shift = stoi(key, &used);
         }
-        else {
-            result += c;
+        catch (const logic_error&) {
         }
+        if (used == 0 || used != key.size()) {
+            cerr << "Not a shift in the key list: " << key << endl;
+            return 1;
+        }
+        shifts.push_back(decrypting ? -shift : shift);
+        paths.push_back(batch_output_name(OUTPUT_FILE_NAME, paths.size() + 1));
     }
 
-    return result;
+    ProfileScope scope(decrypting ? "decrypt batch" : "encrypt batch", text.size() * shifts.size());
+    to_lower_utf8(text);
+    vector<string> results = caesar_batch(lab_alphabet(), text, shifts);
+    scope.stop();
+
+    try {
+        write_files_concurrently(paths, results);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    for (size_t k = 0; k < paths.size(); k++) {
+        cout << paths[k] << ": key " << keys[k] << endl;
+    }
+    return 0;
 }
 
 
-void bruteForce(string ciphertext) {
-    cout << "\n=== All possible decryption variants ===" << endl;
-    cout << "Review the results and choose the one that makes sense:\n" << endl;
+// Shift 3 forward and back with both lookups (see kernel_bench.h)
+int runBenchmark() {
+    const size_t SIZE = size_t(8) << 20;
+    const Alphabet& alphabet = lab_alphabet();
+    const string text = bench_text(alphabet, SIZE);
 
-    for (int key = 1; key < alphabetSize; key++) {
-        string decrypted = decrypt(ciphertext, key);
-        cout << "Key " << key << ": \n" << decrypted << endl;
+    cout << "=== Caesar cipher lookups (" << SIZE / (1 << 20) << " MB, " << lab_alphabet_name() << " alphabet) ===" << endl;
+    bool ok = bench_lookups("encrypt", text.size(), [&](auto lookup) { return caesar<lookup>(alphabet, text, 3); });
+    ok = bench_lookups("decrypt", text.size(), [&](auto lookup) { return caesar<lookup>(alphabet, text, -3); }) && ok;
+    return ok ? 0 : 1;
+}
+
+
+// Encryption, decryption and the batch and constant-time kernels against
+// referenceCaesar on random texts, keys and alphabets, and encryption
+// and decryption against the baseline on ASCII text (see reference.h and
+// differential.h)
+int runFuzz(int cases, uint64_t seed, const string& recordPath) {
+    FuzzRun run("lab2", cases, seed);
+    auto caseKey = [](FuzzRandom& rng, string& what) {
+        int key = int(rng() % 2001) - 1000;
+        what = "key " + to_string(key);
+        return key;
+    };
+
+    run.check("encrypt", [&](FuzzRandom& rng, string& what) {
+        string text = fuzz_text(rng, lab_alphabet(), 300);
+        int key = caseKey(rng, what);
+        return make_pair(referenceCaesar(lab_alphabet(), text, key), encrypt(text, key));
+    });
+    run.check("decrypt", [&](FuzzRandom& rng, string& what) {
+        string text = fuzz_text(rng, lab_alphabet(), 300);
+        int key = caseKey(rng, what);
+        return make_pair(referenceCaesar(lab_alphabet(), text, -key), decrypt(text, key));
+    });
+    // The baseline knew the latin alphabet only, and keys in [0, size)
+    if (lab_alphabet_name() == "latin") {
+        auto baselineKey = [](int key) { return (key % baseline::alphabetSize + baseline::alphabetSize) % baseline::alphabetSize; };
+        run.check("baseline encrypt", [&](FuzzRandom& rng, string& what) {
+            string text = fuzz_ascii(rng, 300);
+            int key = caseKey(rng, what);
+            return make_pair(baseline::encrypt(text, baselineKey(key)), encrypt(text, key));
+        });
+        run.check("baseline decrypt", [&](FuzzRandom& rng, string& what) {
+            string text = fuzz_ascii(rng, 300);
+            int key = caseKey(rng, what);
+            return make_pair(baseline::decrypt(text, baselineKey(key)), decrypt(text, key));
+        });
     }
+    auto engineCase = [&](auto lookup) {
+        return [&, lookup](FuzzRandom& rng, string& what) {
+            Alphabet alphabet = fuzz_alphabet(rng);
+            string text = fuzz_text(rng, alphabet, rng() % 16 == 0 ? 20000 : 300);
+            int key = caseKey(rng, what);
+            what += ", alphabet \"" + alphabet.str() + "\"";
+            string lower = text;
+            to_lower_utf8(lower);
+            return make_pair(referenceCaesar(alphabet, text, key), caesar<lookup>(alphabet, lower, key));
+        };
+    };
+    run.check("caesar, any alphabet", engineCase(integral_constant<Lookup, Lookup::Fast>()));
+    run.check("caesar, constant-time", engineCase(integral_constant<Lookup, Lookup::ConstantTime>()));
+    run.check("caesar_batch", [&](FuzzRandom& rng, string& what) {
+        Alphabet alphabet = fuzz_alphabet(rng);
+        string text = fuzz_text(rng, alphabet, 10000);
+        vector<int> keys(1 + rng() % 6);
+        for (int& key : keys) key = caseKey(rng, what);
+        what = to_string(keys.size()) + " keys, alphabet \"" + alphabet.str() + "\"";
+        string lower = text;
+        to_lower_utf8(lower);
+        string expected, actual;
+        for (int key : keys) expected += referenceCaesar(alphabet, text, key) + '\0';
+        for (const string& result : caesar_batch(alphabet, lower, keys)) actual += result + '\0';
+        return make_pair(expected, actual);
+    });
+
+    const string text = bench_text(lab_alphabet(), size_t(2) << 20);
+    string sink;
+    run.measure("encrypt", text.size(), [&] { sink = referenceCaesar(lab_alphabet(), text, 3); }, [&] { sink = encrypt(text, 3); });
+    return run.finish(recordPath);
 }
 
 
-int main() {
+int main(int argc, char* argv[]) {
+    profiler_init();
+    console_init();
+
+    string batchInput, batchKeys, corpusPath;
+    bool decrypting = false;
+    bool benchmark = false;
+    int fuzzCases = 0;
+    uint64_t fuzzSeed = fuzz_seed();
+    string recordPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bench") {
+            benchmark = true;
+        }
+        else if (arg == "--fuzz" && i + 1 < argc) {
+            fuzzCases = stoi(argv[++i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            fuzzSeed = stoull(argv[++i]);
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (arg == "--batch" && i + 2 < argc) {
+            batchInput = argv[++i];
+            batchKeys = argv[++i];
+        }
+        else if (arg == "--decrypt") {
+            decrypting = true;
+        }
+        else if (arg == "--corpus" && i + 1 < argc) {
+            corpusPath = argv[++i];
+        }
+        else {
+            cerr << "Usage: lab2 [--batch INPUT KEYS [--decrypt]] [--corpus REFERENCE] [--bench]" << endl;
+            cerr << "            [--fuzz CASES [--seed N] [--record CSV]]" << endl;
+            return 1;
+        }
+    }
+    if (benchmark) {
+        return runBenchmark();
+    }
+    if (fuzzCases > 0) {
+        return runFuzz(fuzzCases, fuzzSeed, recordPath);
+    }
+    if (!batchInput.empty()) {
+        return runBatch(batchInput, batchKeys, decrypting);
+    }
+
     int choice;
 
     cout << "=== Caesar Cipher ===" << endl;
@@ -93,7 +274,7 @@ int main() {
             return 1;
         }
 
-        string plaintext((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        string plaintext = read_whole_file(file);
         file.close();
 
         cout << "Enter the key (shift): ";
@@ -101,7 +282,7 @@ int main() {
 
         string encrypted = encrypt(plaintext, key);
 
-        cout << "\nEncrypted text: \n" << encrypted << endl;
+        console_text("\nEncrypted text: \n", encrypted);
 
         // Save result
         ofstream out(OUTPUT_FILE_NAME);
@@ -127,7 +308,7 @@ int main() {
             return 1;
         }
 
-        string ciphertext((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        string ciphertext = read_whole_file(file);
         file.close();
 
         cout << "Enter the key (shift): ";
@@ -135,7 +316,7 @@ int main() {
 
         string decrypted = decrypt(ciphertext, key);
 
-        cout << "\nDecrypted text: \n" << decrypted << endl;
+        console_text("\nDecrypted text: \n", decrypted);
 
         // Save result
         ofstream out(OUTPUT_FILE_NAME);
@@ -160,10 +341,28 @@ int main() {
             return 1;
         }
 
-        string ciphertext((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        string ciphertext = read_whole_file(file);
         file.close();
 
-        bruteForce(ciphertext);
+        // A reference text in the language of the plaintext, to rank the variants
+        unique_ptr<NGramFitness> fitness;
+        if (!corpusPath.empty()) {
+            ifstream corpus(corpusPath);
+            if (!corpus.is_open()) {
+                cerr << "Cannot open " << corpusPath << "!" << endl;
+            }
+            else {
+                string reference = read_whole_file(corpus);
+                try {
+                    fitness = make_unique<NGramFitness>(lab_alphabet(), reference);
+                }
+                catch (const exception& e) {
+                    cerr << "Cannot use " << corpusPath << ": " << e.what() << endl;
+                }
+            }
+        }
+
+        bruteForce(ciphertext, fitness.get());
 
         cout << "\nEnter the key number that gave the correct result: ";
         int correctKey;
@@ -171,7 +370,7 @@ int main() {
 
         string decrypted = decrypt(ciphertext, correctKey);
 
-        cout << "\nFinal result: \n" << decrypted << endl;
+        console_text("\nFinal result: \n", decrypted);
 
         // Save result
         ofstream out(OUTPUT_FILE_NAME);
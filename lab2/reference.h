@@ -0,0 +1,88 @@
+#pragma once
+#include <cctype>
+#include <string>
+#include "../common/alphabet.h"
+#include "../common/differential.h"
+
+
+// Reference Caesar cipher, the oracle of --fuzz for UTF-8 text, any
+// alphabet and any key (see baseline below for the rest): the text is lowercased,
+// every character is looked up by a linear search and shifted with %
+// (decryption shifts by -key).
+inline std::string referenceCaesar(const Alphabet& alphabet, const std::string& text, long long key) {
+    const long long size = alphabet.size();
+    std::string result;
+    reference_characters(reference_case(text, lower_case), [&](char32_t c, std::string_view bytes) {
+        int pos = reference_index(alphabet, c);
+        if (pos >= 0) {
+            long long newPos = ((pos + key) % size + size) % size;
+            reference_append(result, alphabet.symbol(int(newPos)));
+        }
+        else {
+            result += bytes;
+        }
+    });
+    return result;
+}
+
+
+// encrypt and decrypt of the baseline lab2, copied as they were (only made
+// inline), the oracle of --fuzz for the latin alphabet and ASCII text. The
+// lab now differs from them on purpose in these cases only:
+//  - a negative key, or a decryption key past the alphabet size: the
+//    baseline indexed outside the alphabet, the key is now taken modulo
+//    its size (the check maps it into [0, size) before calling them)
+//  - characters past ASCII: the baseline lowercased and copied single
+//    bytes, the text is now read as UTF-8 (left to referenceCaesar)
+namespace baseline {
+using namespace std;
+
+const string alphabet = "abcdefghijklmnopqrstuvwxyz .,;-'";
+const int alphabetSize = alphabet.length();
+
+
+inline string encrypt(string text, int key) {
+    for (char& c : text) {
+        c = tolower((unsigned char)c);
+    }
+
+    string result = "";
+
+    for (char c : text) {
+        size_t pos = alphabet.find(c);
+
+        if (pos != string::npos) {
+            int newPos = (pos + key) % alphabetSize;
+            result += alphabet[newPos];
+        }
+        else {
+            result += c;
+        }
+    }
+
+    return result;
+}
+
+
+inline string decrypt(string text, int key) {
+    for (char& c : text) {
+        c = tolower((unsigned char)c);
+    }
+
+    string result = "";
+
+    for (char c : text) {
+        size_t pos = alphabet.find(c);
+
+        if (pos != string::npos) {
+            int newPos = (pos - key + alphabetSize) % alphabetSize;
+            result += alphabet[newPos];
+        }
+        else {
+            result += c;
+        }
+    }
+
+    return result;
+}
+}
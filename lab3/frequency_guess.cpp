@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <stdexcept>
+#include "frequency_guess.h"
+#include "../common/profiler.h"
+#include "../common/read_file.h"
+#include "../lab1/snapshot.h"
+
+using namespace std;
+
+
+FrequencyProfile textProfile(const Alphabet& alphabet, string_view text) {
+    ProfileScope scope("profile", text.size());
+    const size_t n = size_t(alphabet.size());
+    FrequencyProfile profile{ vector<uint64_t>(n, 0), vector<uint64_t>(n * n, 0) };
+    int previous = -1;
+    alphabet.scan(text, [&](int i) {
+        profile.unigrams[i]++;
+        if (previous >= 0) profile.bigrams[size_t(previous) * n + size_t(i)]++;
+        previous = i;
+    });
+    profile.unigramTotal = accumulate(profile.unigrams.begin(), profile.unigrams.end(), uint64_t(0));
+    profile.bigramTotal = profile.unigramTotal ? profile.unigramTotal - 1 : 0;
+    return profile;
+}
+
+FrequencyProfile loadReferenceProfile(const string& path, const Alphabet& alphabet, string& source) {
+    string snapshotSymbols;
+    if (readSnapshotAlphabet(path, snapshotSymbols)) {
+        // lab1 counts over its analyzer alphabet: the counts are carried
+        // over by symbol, the ones of symbols this alphabet lacks dropped
+        const Alphabet analyzer(snapshotSymbols);
+        Snapshot snapshot;
+        loadSnapshot(path, snapshot, analyzer);
+        const size_t n = size_t(alphabet.size());
+        const uint64_t base = uint64_t(analyzer.size());
+        vector<int> to(analyzer.size());
+        for (int s = 0; s < analyzer.size(); s++) to[s] = alphabet.index(analyzer.symbol(s));
+
+        FrequencyProfile profile;
+        profile.unigrams.assign(n, 0);
+        for (int s = 0; s < analyzer.size(); s++) {
+            if (to[s] >= 0) profile.unigrams[to[s]] += snapshot.charCounts[s];
+        }
+        profile.unigramTotal = accumulate(profile.unigrams.begin(), profile.unigrams.end(), uint64_t(0));
+        if (snapshot.ngrams) {
+            profile.bigrams.assign(n * n, 0);
+            for (const auto& [code, count] : snapshot.ngrams->counts(2)) {
+                int a = to[size_t(code / base)], b = to[size_t(code % base)];
+                if (a < 0 || b < 0) continue;
+                profile.bigrams[size_t(a) * n + size_t(b)] += count;
+                profile.bigramTotal += count;
+            }
+        }
+        source = "lab1 snapshot" + string(snapshot.ngrams ? ", with bigrams" : ", no bigrams (run lab1 with --ngrams)");
+        return profile;
+    }
+
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) throw runtime_error("Cannot open " + path + "!");
+    string text = read_whole_file(file);
+    to_lower_utf8(text);
+    source = "reference text";
+    return textProfile(alphabet, text);
+}
+
+
+// Counts to log10 probabilities, with log10(0.01 / total) for the ones never seen
+static vector<double> logProbabilities(const vector<uint64_t>& counts, uint64_t total) {
+    const double floor = log10(0.01 / double(max<uint64_t>(total, 1)));
+    vector<double> logs(counts.size());
+    for (size_t i = 0; i < counts.size(); i++) {
+        logs[i] = counts[i] ? log10(double(counts[i]) / double(total)) : floor;
+    }
+    return logs;
+}
+
+// Symbol indices by count, most frequent first (ties by index)
+static vector<int> byFrequency(const vector<uint64_t>& counts) {
+    vector<int> order(counts.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](int a, int b) { return counts[a] > counts[b]; });
+    return order;
+}
+
+KeyGuess guessKey(const FrequencyProfile& ciphertext, const FrequencyProfile& reference) {
+    ProfileScope scope("key search");
+    const int n = int(ciphertext.unigrams.size());
+    if (int(reference.unigrams.size()) != n) throw runtime_error("The reference profile is for another alphabet");
+    if (reference.unigramTotal == 0) throw runtime_error("The reference profile is empty");
+
+    KeyGuess guess;
+    guess.usedBigrams = !reference.bigrams.empty() && reference.bigramTotal > 0 && ciphertext.bigramTotal > 0;
+
+    // plainOf[cipher symbol] = the plaintext symbol it is taken for
+    vector<int> plainOf(n);
+    const vector<int> cipherOrder = byFrequency(ciphertext.unigrams);
+    const vector<int> referenceOrder = byFrequency(reference.unigrams);
+    vector<int> ranked(n);
+    for (int k = 0; k < n; k++) ranked[cipherOrder[k]] = referenceOrder[k];
+
+    // Log-likelihood of the ciphertext decrypted by plainOf: bigram counts of
+    // the ciphertext times the reference log probabilities of the bigrams they
+    // decrypt to (unigrams if there are no bigrams). With at most n^2 = 4096
+    // distinct bigrams a full rescore per swap is cheap
+    const vector<double> logUnigrams = logProbabilities(reference.unigrams, reference.unigramTotal);
+    vector<double> logBigrams;
+    struct Count {
+        int a, b;
+        double count;
+    };
+    vector<Count> counts;
+    if (guess.usedBigrams) {
+        logBigrams = logProbabilities(reference.bigrams, reference.bigramTotal);
+        for (int a = 0; a < n; a++) {
+            for (int b = 0; b < n; b++) {
+                uint64_t count = ciphertext.bigrams[size_t(a) * n + b];
+                if (count) counts.push_back({ a, b, double(count) });
+            }
+        }
+    }
+    else {
+        for (int a = 0; a < n; a++) {
+            if (ciphertext.unigrams[a]) counts.push_back({ a, -1, double(ciphertext.unigrams[a]) });
+        }
+    }
+    auto score = [&] {
+        double sum = 0;
+        if (guess.usedBigrams) {
+            for (const Count& c : counts) sum += c.count * logBigrams[size_t(plainOf[c.a]) * n + plainOf[c.b]];
+        }
+        else {
+            for (const Count& c : counts) sum += c.count * logUnigrams[plainOf[c.a]];
+        }
+        return sum;
+    };
+
+    // Pairs of assignments are swapped while that raises the score
+    auto climb = [&] {
+        double best = score();
+        int swaps = 0;
+        for (bool improved = true; improved;) {
+            improved = false;
+            for (int a = 0; a < n; a++) {
+                for (int b = a + 1; b < n; b++) {
+                    swap(plainOf[a], plainOf[b]);
+                    double swapped = score();
+                    if (swapped > best + 1e-9) {
+                        best = swapped;
+                        swaps++;
+                        improved = true;
+                    }
+                    else {
+                        swap(plainOf[a], plainOf[b]);
+                    }
+                }
+            }
+        }
+        return make_pair(best, swaps);
+    };
+
+    // Frequency ranks already maximize the unigram likelihood, so only the
+    // bigram model has anything to climb. The climb stops at local optima,
+    // so it is restarted from the ranks with RESTARTS - 1 different sets
+    // of random swaps (fixed seeds: the guess is reproducible)
+    const int RESTARTS = guess.usedBigrams ? 24 : 1;
+    vector<vector<int>> optima;
+    vector<int> best = ranked;
+    double bestScore = -1e300;
+    for (int restart = 0; restart < RESTARTS; restart++) {
+        plainOf = ranked;
+        mt19937 rng(static_cast<unsigned>(restart));
+        for (int k = 0; restart > 0 && k < n / 2; k++) swap(plainOf[rng() % n], plainOf[rng() % n]);
+        auto [restartScore, swaps] = guess.usedBigrams ? climb() : make_pair(score(), 0);
+        if (restartScore > bestScore + 1e-9) {
+            bestScore = restartScore;
+            best = plainOf;
+            guess.swaps = swaps;
+        }
+        optima.push_back(plainOf);
+    }
+    plainOf = best;
+
+    // Confidence of cipher symbol a: the likelihood share of its pairing
+    // against the keys that swap its plaintext symbol with another one,
+    // times the share of the restarts that ended with the same pairing
+    // (a local optimum is locally sure of itself, other restarts are not)
+    vector<double> confidence(n);
+    for (int a = 0; a < n; a++) {
+        double others = 0;
+        for (int b = 0; b < n; b++) {
+            if (b == a) continue;
+            swap(plainOf[a], plainOf[b]);
+            others += pow(10.0, min(0.0, score() - bestScore));
+            swap(plainOf[a], plainOf[b]);
+        }
+        int agreeing = 0;
+        for (const vector<int>& optimum : optima) agreeing += optimum[a] == plainOf[a];
+        confidence[a] = 1 / (1 + others) * agreeing / double(optima.size());
+    }
+
+    guess.forward.assign(n, 0);
+    guess.symbols.resize(n);
+    for (int cipher = 0; cipher < n; cipher++) {
+        const int plain = plainOf[cipher];
+        guess.forward[plain] = cipher;
+        guess.symbols[plain] = { plain, cipher,
+            ciphertext.unigramTotal ? double(ciphertext.unigrams[cipher]) / double(ciphertext.unigramTotal) : 0,
+            double(reference.unigrams[plain]) / double(reference.unigramTotal), confidence[cipher] };
+    }
+    return guess;
+}
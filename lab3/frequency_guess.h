@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../common/alphabet.h"
+
+
+// First guess of a substitution key from symbol frequencies.
+//
+// The ciphertext's unigram and bigram counts are taken in one pass and
+// matched against a reference profile: a lab1 snapshot (occurrence.snapshot;
+// bigrams only if lab1 ran with --ngrams) or a plain reference text.
+// Cipher symbols are first paired with plaintext symbols by frequency rank,
+// then, if the reference has bigrams, pairs of assignments are swapped
+// while that raises the bigram log-likelihood of the ciphertext (a hill
+// climb, as in Jakobsen's method), restarted from a few perturbed rankings.
+// The result is meant to seed a manual or automatic key search, not to be
+// trusted blindly for short texts.
+
+// Symbol statistics over the indices of an alphabet
+struct FrequencyProfile {
+    std::vector<uint64_t> unigrams;  // count of symbol i
+    std::vector<uint64_t> bigrams;   // count of (a, b) at a * size + b; empty if not known
+    uint64_t unigramTotal = 0;
+    uint64_t bigramTotal = 0;
+};
+
+// Counts of a text in one pass (characters outside the alphabet are skipped)
+FrequencyProfile textProfile(const Alphabet& alphabet, std::string_view text);
+
+// A lab1 snapshot or, for any other file, the profile of its text.
+// source is set to a description of what was loaded
+FrequencyProfile loadReferenceProfile(const std::string& path, const Alphabet& alphabet, std::string& source);
+
+struct SymbolGuess {
+    int plain;
+    int cipher;
+    double cipherShare;     // of the ciphertext symbols
+    double referenceShare;  // of the reference symbols
+    // Likelihood share of this pairing against swapping it with any other
+    // plaintext symbol, times the share of the restarts that agree on it;
+    // near 1 when the ciphertext pins it down
+    double confidence;
+};
+
+struct KeyGuess {
+    std::vector<int> forward;          // plaintext symbol i is written as forward[i]
+    std::vector<SymbolGuess> symbols;  // by plaintext symbol
+    bool usedBigrams = false;
+    int swaps = 0;                     // improving swaps made by the hill climb
+};
+
+KeyGuess guessKey(const FrequencyProfile& ciphertext, const FrequencyProfile& reference);
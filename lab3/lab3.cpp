@@ -1,80 +1,318 @@
+#include <algorithm>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <string>
+#include <string_view>
+#include <stdexcept>
+#include <vector>
+#include "../common/alphabet.h"
+#include "../common/console_log.h"
+#include "../common/kernel_bench.h"
+#include "../common/profiler.h"
+#include "../common/read_file.h"
+#include "frequency_guess.h"
+#include "reference.h"
 #define OUTPUT_FILE_NAME "output.txt"
 
 using namespace std;
 
-// const char alphabet[] = "abcdefghijklmnopqrstuvwxyz .,;-'";
-char originAlphabet[] = {'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v','w','x','y','z',' ','.',',',';','-','\'','\0'};
-char cryptoAlphabet[] = {'m','t','u','f','v','w','z',' ','.','q','c','d','e','b','j','h','r','i','k','y','x','l','n','a',',','g','\'','o','p','-','s',';','\0' };
-const int alphabetLength = sizeof(originAlphabet) / sizeof(originAlphabet[0]);
+// Crypto alphabets: permutations of the built-in alphabets (common/alphabet.h)
+const string LATIN_KEY = "mtufvwz .qcdebjhrikyxlna,g'op-s;";
+const string UKRAINIAN_KEY = "дзпгомкивбюіфчйрхяї;с штеєн,'цщаґьуж.-л";
 
+// Symbol i of the alphabet is written as symbol forward[i]
+struct SubstitutionKey {
+    vector<int> forward;
+    vector<int> backward;
+};
 
-string encrypt(string text) {
-    string result = "";
-    
-    for (char c : text) {
-        bool found = false;
-        for (int i = 0; originAlphabet[i] != '\0'; i++) {
-            if (c == originAlphabet[i]) {
-                result += cryptoAlphabet[i];
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            result += c;
-        }
+// Symbol i of the alphabet is written as symbol i of cryptoAlphabet
+SubstitutionKey keyFromCryptoAlphabet(const Alphabet& alphabet, const string& cryptoAlphabet) {
+    Alphabet crypto(cryptoAlphabet);
+    if (crypto.size() != alphabet.size()) throw runtime_error("Substitution key does not match the alphabet");
+
+    SubstitutionKey key{ vector<int>(alphabet.size()), vector<int>(alphabet.size()) };
+    for (int i = 0; i < alphabet.size(); i++) {
+        int to = alphabet.index(crypto.symbol(i));
+        if (to < 0) throw runtime_error("Substitution key does not match the alphabet");
+        key.forward[i] = to;
+        key.backward[to] = i;
     }
+    return key;
+}
 
-    return result;
+SubstitutionKey makeKey(const Alphabet& alphabet, const string& alphabetName) {
+    if (alphabetName == "custom") throw runtime_error("There is no substitution key for a custom alphabet");
+    return keyFromCryptoAlphabet(alphabet, alphabetName == "ukrainian" ? UKRAINIAN_KEY : LATIN_KEY);
 }
 
 
-string decrypt(string text, bool isStrict = false, bool highLighSpaces = false, bool isUpperView = true) {
+// The key as read by a lookup: a vector indexed directly (Fast), or a
+// CtTable that reads all of it for every symbol (ConstantTime)
+template <Lookup L>
+auto keyTable(const vector<int>& table) {
+    if constexpr (L == Lookup::Fast) return table.data();
+    else return CtTable<ALPHABET_MAX>(table);
+}
+
+
+template <Lookup L>
+string encrypt(const string& text, const SubstitutionKey& key) {
+    const auto forward = keyTable<L>(key.forward);
+    return lab_alphabet().transform<L>(text, [&](int i) { return forward[i]; });
+}
+
+string encrypt(string text, const SubstitutionKey& key) {
+    ProfileScope scope("encrypt", text.size());
+    return with_lookup([&](auto lookup) { return encrypt<lookup>(text, key); });
+}
+
+
+template <Lookup L>
+string decrypt(const string& text, const SubstitutionKey& key, bool highLighSpaces, bool isUpperView) {
+    const Alphabet& alphabet = lab_alphabet();
+    const auto backward = keyTable<L>(key.backward);
     string result = "";
+    result.reserve(text.size());
 
-    for (char c : text) {
-        bool found = false, exist = false;
-        for (int i = 0; cryptoAlphabet[i] != '\0'; i++) {
-            if (c == cryptoAlphabet[i]) {
-                result += originAlphabet[i];
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            if (highLighSpaces && c == ' ')
+    alphabet.for_each<L>(text,
+        [&](int i, string_view) {
+            char symbol[4];
+            result.append(symbol, alphabet.encode<L>(backward[i], symbol));
+        },
+        [&](string_view c) {
+            if (highLighSpaces && c == " ")
             {
 				result += '_'; // highlight spaces
-				continue;
-            }
-            if (isStrict) {
-                for (int i = 0; originAlphabet[i] != '\0'; i++) {
-                    if (c == originAlphabet[i]) {
-                        exist = true;
-                        break;
-                    }
-                }
-                if (exist) {
-                    result += '?'; // unknown character
-                    continue;
-                }
+				return;
             }
+            size_t at = result.size();
+            result += c;
             if (isUpperView)
-                result += toupper((unsigned char)c);
-            else
-				result += c;
-        }
-    }
+                to_upper_utf8(result.data() + at, c.size());
+        });
 
     return result;
 }
 
+string decrypt(string text, const SubstitutionKey& key, bool highLighSpaces = false, bool isUpperView = true) {
+    ProfileScope scope("decrypt", text.size());
+    return with_lookup([&](auto lookup) { return decrypt<lookup>(text, key, highLighSpaces, isUpperView); });
+}
+
 
-int main()
+// Key guess for a ciphertext from its symbol frequencies against a
+// reference profile (see frequency_guess.h): prints the pairings with their
+// confidence and the guessed crypto alphabet, and writes the ciphertext
+// decrypted with the guess to OUTPUT_FILE_NAME
+int runGuess(const string& ciphertextPath, const string& referencePath) {
+    const Alphabet& alphabet = lab_alphabet();
+
+    ifstream file(ciphertextPath);
+    if (!file.is_open()) {
+        cerr << "Cannot open " << ciphertextPath << "!" << endl;
+        return 1;
+    }
+    string ciphertext = read_whole_file(file);
+    file.close();
+    to_lower_utf8(ciphertext);
+
+    KeyGuess guess;
+    string source;
+    try {
+        FrequencyProfile reference = loadReferenceProfile(referencePath, alphabet, source);
+        guess = guessKey(textProfile(alphabet, ciphertext), reference);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    // Symbols shown quoted, the space and other blanks visibly
+    auto shown = [&](int i) { return "'" + string(alphabet.utf8(i)) + "'"; };
+
+    cout << "=== Key guess from symbol frequencies ===" << endl;
+    cout << "Reference: " << referencePath << " (" << source << ")" << endl;
+    cout << "Fitted by " << (guess.usedBigrams ? "bigrams, " + to_string(guess.swaps) + " swaps after frequency ranks" : "frequency ranks only")
+         << "\n" << endl;
+    cout << "plain  cipher  cipher %  reference %  confidence" << endl;
+    string cryptoAlphabet;
+    for (const SymbolGuess& symbol : guess.symbols) {
+        cout << left << setw(7) << shown(symbol.plain) << setw(8) << shown(symbol.cipher) << right << fixed << setprecision(2)
+             << setw(8) << symbol.cipherShare * 100 << setw(13) << symbol.referenceShare * 100 << setw(12) << symbol.confidence << endl;
+        cryptoAlphabet += alphabet.utf8(symbol.cipher);
+    }
+    cout << "\nBest-guess crypto alphabet (for --key):\n\"" << cryptoAlphabet << "\"" << endl;
+
+    string decrypted = decrypt(ciphertext, keyFromCryptoAlphabet(alphabet, cryptoAlphabet));
+    ofstream out(OUTPUT_FILE_NAME);
+    if (!out.is_open()) {
+        cerr << "Cannot open " << OUTPUT_FILE_NAME << " for writing!" << endl;
+        return 1;
+    }
+    out << decrypted;
+    cout << "Decrypted with the guess: " << OUTPUT_FILE_NAME << endl;
+    return 0;
+}
+
+// The loaded key both ways with both lookups, decryption in the upper-case
+// view the menu prints (see kernel_bench.h)
+int runBenchmark(const SubstitutionKey& key) {
+    const size_t SIZE = size_t(8) << 20;
+    const string text = bench_text(lab_alphabet(), SIZE);
+
+    cout << "=== Substitution cipher lookups (" << SIZE / (1 << 20) << " MB, " << lab_alphabet_name() << " alphabet) ===" << endl;
+    bool ok = bench_lookups("encrypt", text.size(), [&](auto lookup) { return encrypt<lookup>(text, key); });
+    ok = bench_lookups("decrypt", text.size(), [&](auto lookup) { return decrypt<lookup>(text, key, false, true); }) && ok;
+    return ok ? 0 : 1;
+}
+
+// Both lookups of encrypt and decrypt against referenceEncrypt and
+// referenceDecrypt on random texts and keys, and against the baseline on
+// ASCII text (see reference.h and differential.h)
+int runFuzz(int cases, uint64_t seed, const string& recordPath) {
+    const Alphabet& alphabet = lab_alphabet();
+    FuzzRun run("lab3", cases, seed);
+
+    // A random crypto alphabet: the symbols of the alphabet shuffled
+    auto caseKey = [&](FuzzRandom& rng, string& what) {
+        vector<int> order(alphabet.size());
+        for (int i = 0; i < alphabet.size(); i++) order[i] = i;
+        shuffle(order.begin(), order.end(), rng);
+        string cryptoAlphabet;
+        for (int i : order) cryptoAlphabet += alphabet.utf8(i);
+        what = "key \"" + cryptoAlphabet + "\"";
+        return cryptoAlphabet;
+    };
+    auto encryptCase = [&](auto lookup) {
+        return [&, lookup](FuzzRandom& rng, string& what) {
+            string cryptoAlphabet = caseKey(rng, what);
+            string text = fuzz_text(rng, alphabet, rng() % 16 == 0 ? 20000 : 300);
+            SubstitutionKey key = keyFromCryptoAlphabet(alphabet, cryptoAlphabet);
+            return make_pair(referenceEncrypt(alphabet, Alphabet(cryptoAlphabet), text), encrypt<lookup>(text, key));
+        };
+    };
+    auto decryptCase = [&](auto lookup) {
+        return [&, lookup](FuzzRandom& rng, string& what) {
+            string cryptoAlphabet = caseKey(rng, what);
+            string text = fuzz_text(rng, alphabet, rng() % 16 == 0 ? 20000 : 300);
+            bool highlightSpaces = rng() % 2, upperView = rng() % 2;
+            what += string(highlightSpaces ? ", highlight spaces" : "") + (upperView ? ", upper view" : "");
+            SubstitutionKey key = keyFromCryptoAlphabet(alphabet, cryptoAlphabet);
+            return make_pair(referenceDecrypt(alphabet, Alphabet(cryptoAlphabet), text, highlightSpaces, upperView),
+                decrypt<lookup>(text, key, highlightSpaces, upperView));
+        };
+    };
+    const integral_constant<Lookup, Lookup::Fast> fast;
+    const integral_constant<Lookup, Lookup::ConstantTime> constantTime;
+    run.check("encrypt", encryptCase(fast));
+    run.check("encrypt, constant-time", encryptCase(constantTime));
+    run.check("decrypt", decryptCase(fast));
+    run.check("decrypt, constant-time", decryptCase(constantTime));
+    // The baseline knew the latin alphabet and its key only
+    if (lab_alphabet_name() == "latin") {
+        const SubstitutionKey latinKey = makeKey(alphabet, "latin");
+        auto lowerText = [](FuzzRandom& rng) {
+            string text = fuzz_ascii(rng, 300);
+            for (char& c : text) c = char(tolower((unsigned char)c));
+            return text;
+        };
+        run.check("baseline encrypt", [&](FuzzRandom& rng, string&) {
+            string text = lowerText(rng);
+            return make_pair(baseline::encrypt(text), encrypt(text, latinKey));
+        });
+        run.check("baseline decrypt", [&](FuzzRandom& rng, string& what) {
+            string text = lowerText(rng);
+            bool highlightSpaces = rng() % 2, upperView = rng() % 2;
+            what = string(highlightSpaces ? "highlight spaces, " : "") + (upperView ? "upper view" : "as read");
+            return make_pair(baseline::decrypt(text, false, highlightSpaces, upperView), decrypt(text, latinKey, highlightSpaces, upperView));
+        });
+    }
+
+    FuzzRandom rng(seed);
+    string what;
+    const string cryptoAlphabet = caseKey(rng, what);
+    const Alphabet crypto(cryptoAlphabet);
+    const SubstitutionKey key = keyFromCryptoAlphabet(alphabet, cryptoAlphabet);
+    const string text = bench_text(alphabet, size_t(2) << 20);
+    string sink;
+    run.measure("encrypt", text.size(), [&] { sink = referenceEncrypt(alphabet, crypto, text); }, [&] { sink = encrypt(text, key); });
+    run.measure("decrypt", text.size(), [&] { sink = referenceDecrypt(alphabet, crypto, text, false, true); },
+        [&] { sink = decrypt(text, key); });
+    return run.finish(recordPath);
+}
+
+int main(int argc, char* argv[])
 {
+    profiler_init();
+    console_init();
+
+    // --key: crypto alphabet to use instead of the built-in one
+    // --guess CIPHERTEXT --reference PROFILE: key guess, no menu
+    // --bench: fast and constant-time lookups side by side, with the key
+    // --fuzz CASES [--seed N] [--record CSV]: kernels against the reference, with a random key
+    string cryptoAlphabet;
+    string guessPath;
+    string referencePath;
+    bool benchmark = false;
+    int fuzzCases = 0;
+    uint64_t fuzzSeed = fuzz_seed();
+    string recordPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bench") {
+            benchmark = true;
+        }
+        else if (arg == "--fuzz" && i + 1 < argc) {
+            fuzzCases = stoi(argv[++i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            fuzzSeed = stoull(argv[++i]);
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (arg == "--key" && i + 1 < argc) {
+            cryptoAlphabet = argv[++i];
+        }
+        else if (arg == "--guess" && i + 1 < argc) {
+            guessPath = argv[++i];
+        }
+        else if (arg == "--reference" && i + 1 < argc) {
+            referencePath = argv[++i];
+        }
+        else {
+            cerr << "Usage: lab3 [--key CRYPTO_ALPHABET] [--guess CIPHERTEXT --reference PROFILE] [--bench]" << endl;
+            cerr << "            [--fuzz CASES [--seed N] [--record CSV]]" << endl;
+            cerr << "  PROFILE is a lab1 snapshot (occurrence.snapshot, best made with --ngrams) or a reference text" << endl;
+            return 1;
+        }
+    }
+    if (!guessPath.empty() || !referencePath.empty()) {
+        if (guessPath.empty() || referencePath.empty()) {
+            cerr << "--guess and --reference go together" << endl;
+            return 1;
+        }
+        return runGuess(guessPath, referencePath);
+    }
+    if (fuzzCases > 0) {
+        return runFuzz(fuzzCases, fuzzSeed, recordPath);
+    }
+
+    SubstitutionKey key;
+    try {
+        key = cryptoAlphabet.empty() ? makeKey(lab_alphabet(), lab_alphabet_name())
+                                     : keyFromCryptoAlphabet(lab_alphabet(), cryptoAlphabet);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    if (benchmark) {
+        return runBenchmark(key);
+    }
+
     int choice;
 
     cout << "=== Direct substitution cipher ===" << endl;
@@ -98,16 +336,14 @@ int main()
             return 1;
         }
 
-        string plaintext((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        string plaintext = read_whole_file(file);
         file.close();
 
-        for (char& c : plaintext) {
-            c = tolower((unsigned char)c);
-        }
+        to_lower_utf8(plaintext);
 
-        string encrypted = encrypt(plaintext);
+        string encrypted = encrypt(plaintext, key);
 
-        cout << "\nEncrypted text: \n" << encrypted << endl;
+        console_text("\nEncrypted text: \n", encrypted);
 
         // Save result
         ofstream out(OUTPUT_FILE_NAME);
@@ -132,16 +368,14 @@ int main()
             return 1;
         }
 
-        string ciphertext((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        string ciphertext = read_whole_file(file);
         file.close();
 
-        for (char& c : ciphertext) {
-            c = tolower((unsigned char)c);
-        }
+        to_lower_utf8(ciphertext);
 
-        string decrypted = decrypt(ciphertext);
+        string decrypted = decrypt(ciphertext, key);
 
-        cout << "\nDecrypted text: \n" << decrypted << endl;
+        console_text("\nDecrypted text: \n", decrypted);
 
         // Save result
         ofstream out(OUTPUT_FILE_NAME);
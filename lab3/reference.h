@@ -0,0 +1,123 @@
+#pragma once
+#include <cctype>
+#include <string>
+#include "../common/alphabet.h"
+#include "../common/differential.h"
+
+
+// Reference substitution cipher, the oracle of --fuzz for UTF-8 text, any
+// alphabet and any key (see baseline below for the rest): symbols are found
+// by a linear search, in the alphabet and then in the crypto alphabet
+// (symbol i of the alphabet is written as symbol i of cryptoAlphabet).
+
+inline std::string referenceEncrypt(const Alphabet& alphabet, const Alphabet& crypto, const std::string& text) {
+    std::string result;
+    reference_characters(text, [&](char32_t c, std::string_view bytes) {
+        int i = reference_index(alphabet, c);
+        if (i >= 0) reference_append(result, alphabet.symbol(reference_index(alphabet, crypto.symbol(i))));
+        else result += bytes;
+    });
+    return result;
+}
+
+inline std::string referenceDecrypt(const Alphabet& alphabet, const Alphabet& crypto, const std::string& text,
+    bool highlightSpaces, bool upperView) {
+    std::string result;
+    reference_characters(text, [&](char32_t c, std::string_view bytes) {
+        int i = reference_index(alphabet, c);
+        if (i >= 0) {
+            int j = 0;
+            while (reference_index(alphabet, crypto.symbol(j)) != i) j++;
+            reference_append(result, alphabet.symbol(j));
+        }
+        else if (highlightSpaces && bytes == " ") {
+            result += '_';
+        }
+        else {
+            result += upperView ? reference_case(std::string(bytes), upper_case) : std::string(bytes);
+        }
+    });
+    return result;
+}
+
+
+// encrypt and decrypt of the baseline lab3 with its key, copied as they
+// were (only made inline), the oracle of --fuzz for the latin alphabet and
+// ASCII text. Both were called on lowercased text, as the lab still does.
+// The lab now differs from them on purpose in these cases only:
+//  - characters past ASCII: the baseline copied single bytes (and
+//    uppercased them in the upper view), the text is now read as UTF-8
+//    (left to referenceEncrypt and referenceDecrypt)
+//  - isStrict is gone: every symbol of the alphabet is in the crypto
+//    alphabet, so it never applied (the check leaves it false)
+namespace baseline {
+using namespace std;
+
+// const char alphabet[] = "abcdefghijklmnopqrstuvwxyz .,;-'";
+inline char originAlphabet[] = {'a','b','c','d','e','f','g','h','i','j','k','l','m','n','o','p','q','r','s','t','u','v','w','x','y','z',' ','.',',',';','-','\'','\0'};
+inline char cryptoAlphabet[] = {'m','t','u','f','v','w','z',' ','.','q','c','d','e','b','j','h','r','i','k','y','x','l','n','a',',','g','\'','o','p','-','s',';','\0' };
+const int alphabetLength = sizeof(originAlphabet) / sizeof(originAlphabet[0]);
+
+
+inline string encrypt(string text) {
+    string result = "";
+    
+    for (char c : text) {
+        bool found = false;
+        for (int i = 0; originAlphabet[i] != '\0'; i++) {
+            if (c == originAlphabet[i]) {
+                result += cryptoAlphabet[i];
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            result += c;
+        }
+    }
+
+    return result;
+}
+
+
+inline string decrypt(string text, bool isStrict = false, bool highLighSpaces = false, bool isUpperView = true) {
+    string result = "";
+
+    for (char c : text) {
+        bool found = false, exist = false;
+        for (int i = 0; cryptoAlphabet[i] != '\0'; i++) {
+            if (c == cryptoAlphabet[i]) {
+                result += originAlphabet[i];
+                found = true;
+                break;
+            }
+        }
+        if (!found) {
+            if (highLighSpaces && c == ' ')
+            {
+				result += '_'; // highlight spaces
+				continue;
+            }
+            if (isStrict) {
+                for (int i = 0; originAlphabet[i] != '\0'; i++) {
+                    if (c == originAlphabet[i]) {
+                        exist = true;
+                        break;
+                    }
+                }
+                if (exist) {
+                    result += '?'; // unknown character
+                    continue;
+                }
+            }
+            if (isUpperView)
+                result += toupper((unsigned char)c);
+            else
+				result += c;
+        }
+    }
+
+    return result;
+}
+
+}
@@ -2,21 +2,28 @@
 #include <string>
 #include <stdexcept>
 #include "auxiliary.h"
+#include "../common/alphabet.h"
+#include "../common/profiler.h"
+#include "../common/read_file.h"
 
 using namespace std;
 
 
 string readFileContent(const string& filePath) {
+    ProfileScope scope("read");
     ifstream file(filePath);
 
     if (!file.is_open())
 		throw runtime_error("Cannot open file to read: " + filePath);
 
-    return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    string content = read_whole_file(file);
+    scope.add_bytes(content.size());
+    return content;
 }
 
 
 void writeFileContent(const string& filePath, const string& content) {
+    ProfileScope scope("write", content.size());
     ofstream out(filePath);
     
     if (!out.is_open())
@@ -26,13 +33,11 @@ void writeFileContent(const string& filePath, const string& content) {
 }
 
 void toUpperCase(string& text) {
-    for (char& c : text) {
-        c = toupper((unsigned char)c);
-    }
+    ProfileScope scope("uppercase", text.size());
+    to_upper_utf8(text);
 }
 
 void toLowerCase(string& text) {
-    for (char& c : text) {
-        c = tolower((unsigned char)c);
-    }
+    ProfileScope scope("lowercase", text.size());
+    to_lower_utf8(text);
 }
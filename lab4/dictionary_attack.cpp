@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "dictionary_attack.h"
+#include "../common/cipher_engines.h"
+#include "../common/profiler.h"
+#include "../common/thread_pool.h"
+
+using namespace std;
+
+
+// Wordlist bytes per task of the pool
+static const size_t CHUNK_BYTES = 64 * 1024;
+
+// The key as the cipher uses it: its symbols in lower case, other
+// characters dropped, so that "Secret" and "secret" are one candidate
+static string normalizedKey(const Alphabet& alphabet, string_view key) {
+    string result;
+    alphabet.scan(key, [&](int i) { result += alphabet.utf8(i); });
+    return result;
+}
+
+// Best candidates so far, as (total quadgram score, normalized key) in a
+// heap with the worst of them on top
+class TopList {
+public:
+    using Entry = pair<double, string>;
+
+    explicit TopList(size_t limit) : limit(limit) {}
+
+    // Total score a candidate needs to be considered for the list
+    double bound() const { return entries.size() < limit ? -HUGE_VAL : entries.front().first; }
+
+    void offer(double score, string key) {
+        Entry entry(score, move(key));
+        if (limit == 0 || (entries.size() == limit && !better(entry, entries.front()))) return;
+        for (const Entry& listed : entries) {
+            if (listed.second == entry.second) return;  // repeated in the wordlist, maybe in another case
+        }
+        if (entries.size() == limit) {
+            pop_heap(entries.begin(), entries.end(), better);
+            entries.pop_back();
+        }
+        entries.push_back(move(entry));
+        push_heap(entries.begin(), entries.end(), better);
+    }
+
+    vector<Entry> sorted() const {
+        vector<Entry> result = entries;
+        sort(result.begin(), result.end(), better);
+        return result;
+    }
+
+private:
+    // Higher score first, then the key in byte order, so that the list does
+    // not depend on which thread got which chunk
+    static bool better(const Entry& a, const Entry& b) {
+        return a.first != b.first ? a.first > b.first : a.second < b.second;
+    }
+
+    size_t limit;
+    vector<Entry> entries;
+};
+
+struct AttackState {
+    const Alphabet& alphabet;
+    const NGramFitness& fitness;
+    vector<uint8_t> cipher;     // symbol indices of the ciphertext prefix
+    double bigramLimit = 0;     // bigram check threshold as a sum
+    size_t top;
+
+    mutex lock;
+    TopList best;
+    atomic<double> bound{ -HUGE_VAL };  // best.bound(), for the other workers
+    atomic<uint64_t> candidates{ 0 };
+    atomic<uint64_t> rejected{ 0 };
+    atomic<uint64_t> pruned{ 0 };
+    atomic<uint64_t> skipped{ 0 };
+
+    AttackState(const Alphabet& alphabet, const NGramFitness& fitness, size_t top)
+        : alphabet(alphabet), fitness(fitness), top(top), best(top) {}
+};
+
+// Tries every key of lines (whole lines of the wordlist)
+template <int Size>
+static void attackLines(AttackState& state, string_view lines) {
+    const Modulo<Size> mod(state.alphabet.size());
+    const int n = mod.size();
+    const NGramFitness& fitness = state.fitness;
+    const uint8_t* cipher = state.cipher.data();
+    const size_t count = state.cipher.size();
+    const size_t checked = min(count, BIGRAM_CHECK);
+
+    vector<int> shifts(count);  // decryption shifts; key letters past the prefix are never used
+    vector<uint8_t> plain(count);
+    TopList best(state.top);
+    uint64_t candidates = 0, rejected = 0, pruned = 0, skipped = 0;
+    double sharedBound = state.bound.load(memory_order_relaxed);
+
+    size_t position = 0;
+    while (position < lines.size()) {
+        size_t lineEnd = min(lines.find('\n', position), lines.size());
+        string_view key = lines.substr(position, lineEnd - position);
+        position = lineEnd + 1;
+        if (!key.empty() && key.back() == '\r') key.remove_suffix(1);
+
+        size_t keyLength = 0;
+        state.alphabet.scan(key, [&](int i) {
+            if (keyLength < count) shifts[keyLength++] = i == 0 ? 0 : n - i;
+        });
+        if (keyLength == 0) {
+            skipped++;
+            continue;
+        }
+        if (++candidates % 64 == 0) sharedBound = state.bound.load(memory_order_relaxed);
+
+        // Bigram check on the first symbols
+        size_t keyIndex = 0;
+        for (size_t i = 0; i < checked; i++) {
+            plain[i] = uint8_t(mod.add(cipher[i], shifts[keyIndex]));
+            keyIndex = keyIndex + 1 == keyLength ? 0 : keyIndex + 1;
+        }
+        double bigramSum = 0;
+        for (size_t i = 1; i < checked; i++) bigramSum += fitness.bigram(plain[i - 1], plain[i]);
+        if (bigramSum < state.bigramLimit) {
+            rejected++;
+            continue;
+        }
+
+        // Quadgrams of the whole prefix, checked against the bound every 16
+        for (size_t i = checked; i < count; i++) {
+            plain[i] = uint8_t(mod.add(cipher[i], shifts[keyIndex]));
+            keyIndex = keyIndex + 1 == keyLength ? 0 : keyIndex + 1;
+        }
+        const double limit = max(sharedBound, best.bound());
+        double sum = 0;
+        bool stopped = false;
+        for (size_t i = 3; i < count; i++) {
+            sum += fitness.quadgram(plain[i - 3], plain[i - 2], plain[i - 1], plain[i]);
+            if (i % 16 == 0 && sum < limit) {
+                stopped = true;
+                break;
+            }
+        }
+        if (stopped || sum < limit) {
+            pruned++;
+            continue;
+        }
+        best.offer(sum, normalizedKey(state.alphabet, key));
+    }
+
+    state.candidates += candidates;
+    state.rejected += rejected;
+    state.pruned += pruned;
+    state.skipped += skipped;
+    lock_guard<mutex> guard(state.lock);
+    for (const TopList::Entry& entry : best.sorted()) state.best.offer(entry.first, entry.second);
+    state.bound.store(state.best.bound(), memory_order_relaxed);
+}
+
+AttackResult dictionaryAttack(const Alphabet& alphabet, const NGramFitness& fitness,
+                              string_view ciphertext, string_view wordlist, const AttackOptions& options) {
+    ProfileScope scope("dictionary attack", wordlist.size());
+    auto start = chrono::steady_clock::now();
+
+    AttackState state(alphabet, fitness, options.top);
+
+    // Symbols of the ciphertext prefix; the text is walked a slice at a
+    // time, as only its beginning is needed
+    const size_t SLICE = 4096;
+    for (size_t offset = 0; offset < ciphertext.size() && state.cipher.size() < options.prefix;) {
+        string_view slice = ciphertext.substr(offset, SLICE);
+        if (offset + slice.size() < ciphertext.size()) slice = slice.substr(0, utf8_complete_length(slice));
+        alphabet.scan(slice, [&](int i) {
+            if (state.cipher.size() < options.prefix) state.cipher.push_back(uint8_t(i));
+        });
+        offset += slice.size();
+    }
+    if (state.cipher.size() < 4) throw runtime_error("The ciphertext has fewer than 4 symbols of the alphabet");
+
+    AttackResult result;
+    result.threshold = options.autoThreshold
+        ? (fitness.reference_bigram_mean() + fitness.random_bigram_mean()) / 2
+        : options.threshold;
+    state.bigramLimit = result.threshold * double(min(state.cipher.size(), BIGRAM_CHECK) - 1);
+
+    {
+        // Runs every chunk before the pool is destroyed
+        ThreadPool pool(options.threads);
+        for (size_t begin = 0; begin < wordlist.size();) {
+            size_t end = begin + CHUNK_BYTES >= wordlist.size() ? wordlist.size() : wordlist.find('\n', begin + CHUNK_BYTES);
+            end = min(end, wordlist.size());
+            string_view lines = wordlist.substr(begin, end - begin);
+            pool.submit([&state, lines] {
+                with_alphabet_size(state.alphabet.size(), [&](auto size) { attackLines<size>(state, lines); });
+            });
+            begin = end + 1;
+        }
+    }
+
+    const double quadgrams = double(state.cipher.size() - 3);
+    for (const TopList::Entry& entry : state.best.sorted()) {
+        result.best.push_back({ entry.second, entry.first / quadgrams });
+    }
+    result.candidates = state.candidates;
+    result.rejected = state.rejected;
+    result.pruned = state.pruned;
+    result.skipped = state.skipped;
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    return result;
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "../common/alphabet.h"
+#include "../common/ngram_fitness.h"
+
+
+// Dictionary attack on the Vigenere cipher: every line of a wordlist is
+// tried as the key.
+//
+// Only a prefix of the ciphertext is decrypted per candidate, straight to
+// symbol indices, and judged in two steps:
+//   - the bigram fitness of its first BIGRAM_CHECK symbols; a candidate
+//     below the threshold is dropped (almost every wrong key is);
+//   - the quadgram fitness of the whole prefix, stopped as soon as the
+//     running sum falls below the K-th best score found so far (the terms
+//     are all negative, so the candidate could not make the list anyway).
+// The wordlist is cut into chunks of lines that the workers of a
+// work-stealing pool take in turn.
+
+const size_t BIGRAM_CHECK = 40;
+
+struct AttackOptions {
+    size_t prefix = 160;        // ciphertext symbols decrypted per candidate
+    size_t top = 10;            // keys reported
+    unsigned threads = 1;
+    bool autoThreshold = true;  // threshold midway between the reference and random text
+    double threshold = 0;       // mean bigram log10 probability
+};
+
+struct AttackCandidate {
+    std::string key;
+    double score;               // mean quadgram log10 probability of the prefix
+};
+
+struct AttackResult {
+    std::vector<AttackCandidate> best;  // best first
+    uint64_t candidates = 0;            // keys tried
+    uint64_t rejected = 0;              // dropped by the bigram check
+    uint64_t pruned = 0;                // fell below the K-th best while scoring quadgrams
+    uint64_t skipped = 0;               // lines without a symbol of the alphabet
+    double threshold = 0;
+    double seconds = 0;
+};
+
+AttackResult dictionaryAttack(const Alphabet& alphabet, const NGramFitness& fitness,
+                              std::string_view ciphertext, std::string_view wordlist, const AttackOptions& options);
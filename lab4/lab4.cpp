@@ -1,23 +1,118 @@
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <stdexcept>
+#include <vector>
 #include "auxiliary.h"
+#include "dictionary_attack.h"
+#include "reference.h"
+#include "../common/alphabet.h"
+#include "../common/batch_files.h"
+#include "../common/cipher_engines.h"
+#include "../common/console_log.h"
+#include "../common/kernel_bench.h"
+#include "../common/profiler.h"
 
 using namespace std;
 
 #define OUTPUT_FILE_NAME "output.txt"
 
-const string alphabet = "abcdefghijklmnopqrstuvwxyz .,;-'";
-const int alphabetSize = alphabet.length();
-
-
 string encrypt(const string& text, const string& key);
 
 string decrypt(const string& text, const string& key);
 
+int runBatch(const string& inputPath, const string& keysPath, bool decrypting);
+
+int runAttack(const string& ciphertextPath, const string& wordlistPath, const string& corpusPath, const AttackOptions& options);
+
+int runBenchmark();
+
+int runFuzz(int cases, uint64_t seed, const string& recordPath);
 
 
-int main()
+
+int main(int argc, char* argv[])
 {
+    profiler_init();
+    console_init();
+
+    string batchInput, batchKeys;
+    string attackInput, attackWordlist, corpusPath;
+    AttackOptions attackOptions;
+    attackOptions.threads = max(1u, thread::hardware_concurrency());
+    bool decrypting = false;
+    bool benchmark = false;
+    int fuzzCases = 0;
+    uint64_t fuzzSeed = fuzz_seed();
+    string recordPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--bench") {
+            benchmark = true;
+        }
+        else if (arg == "--fuzz" && i + 1 < argc) {
+            fuzzCases = stoi(argv[++i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            fuzzSeed = stoull(argv[++i]);
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else if (arg == "--batch" && i + 2 < argc) {
+            batchInput = argv[++i];
+            batchKeys = argv[++i];
+        }
+        else if (arg == "--decrypt") {
+            decrypting = true;
+        }
+        else if (arg == "--attack" && i + 2 < argc) {
+            attackInput = argv[++i];
+            attackWordlist = argv[++i];
+        }
+        else if (arg == "--corpus" && i + 1 < argc) {
+            corpusPath = argv[++i];
+        }
+        else if (arg == "--top" && i + 1 < argc) {
+            attackOptions.top = size_t(stoul(argv[++i]));
+        }
+        else if (arg == "--prefix" && i + 1 < argc) {
+            attackOptions.prefix = max(size_t(4), size_t(stoul(argv[++i])));
+        }
+        else if (arg == "--threshold" && i + 1 < argc) {
+            attackOptions.autoThreshold = false;
+            attackOptions.threshold = stod(argv[++i]);
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            attackOptions.threads = max(1u, unsigned(stoul(argv[++i])));
+        }
+        else {
+            cerr << "Usage: lab4 [--batch INPUT KEYS [--decrypt]]" << endl;
+            cerr << "            [--attack CIPHERTEXT WORDLIST --corpus REFERENCE [--top K] [--prefix N]" << endl;
+            cerr << "             [--threshold LOG10] [--threads N]] [--bench]" << endl;
+            cerr << "            [--fuzz CASES [--seed N] [--record CSV]]" << endl;
+            return 1;
+        }
+    }
+    if (benchmark) {
+        return runBenchmark();
+    }
+    if (fuzzCases > 0) {
+        return runFuzz(fuzzCases, fuzzSeed, recordPath);
+    }
+    if (!batchInput.empty()) {
+        return runBatch(batchInput, batchKeys, decrypting);
+    }
+    if (!attackInput.empty()) {
+        if (corpusPath.empty()) {
+            cerr << "--attack needs --corpus: a reference text in the language of the plaintext" << endl;
+            return 1;
+        }
+        return runAttack(attackInput, attackWordlist, corpusPath, attackOptions);
+    }
+
     int choice;
 
     cout << "=== Vigenere cipher ===" << endl;
@@ -48,10 +143,17 @@ int main()
 		toLowerCase(key);
 
         // Encrypt
-        string encrypted = encrypt(plaintext, key);
+        string encrypted;
+        try {
+            encrypted = encrypt(plaintext, key);
+        }
+        catch (const exception& e) {
+            cerr << "Encryption error: " << e.what() << endl;
+            return 1;
+        }
         toUpperCase(encrypted);
 
-        cout << "\nEncrypted text: \n" << encrypted << endl;
+        console_text("\nEncrypted text: \n", encrypted);
 
         // Save result
 		writeFileContent(OUTPUT_FILE_NAME, encrypted);
@@ -77,10 +179,17 @@ int main()
         toLowerCase(key);
 
         // Decrypt
-        string encrypted = decrypt(ciphertext, key);
+        string encrypted;
+        try {
+            encrypted = decrypt(ciphertext, key);
+        }
+        catch (const exception& e) {
+            cerr << "Decryption error: " << e.what() << endl;
+            return 1;
+        }
         toUpperCase(encrypted);
 
-        cout << "\nDecrypted text: \n" << encrypted << endl;
+        console_text("\nDecrypted text: \n", encrypted);
 
         // Save result
         writeFileContent(OUTPUT_FILE_NAME, encrypted);
@@ -94,48 +203,222 @@ int main()
 }
 
 
-int getCharIndex(char c) {
-    for (int i = 0; i < alphabetSize; i++) {
-        if (alphabet[i] == c) {
-            return i;
-        }
+// Shifts of the key letters; key characters outside the alphabet are dropped
+vector<int> keyShifts(const string& key, bool isEncrypting) {
+    const Alphabet& alphabet = lab_alphabet();
+    const int alphabetSize = alphabet.size();
+
+    vector<int> shifts;
+    alphabet.scan(key, [&](int keyCharIndex) {
+        shifts.push_back(isEncrypting ? keyCharIndex : (alphabetSize - keyCharIndex) % alphabetSize);
+    });
+    if (shifts.empty()) {
+        throw runtime_error("The key has no characters of the alphabet");
     }
-    return -1;
+    return shifts;
 }
 
 
 string vietaChiper(const string& text, const string& key, bool isEncrypting) {
-    string result = "";
-	int textCharIndex, keyCharIndex, resCharIndex;
+    ProfileScope scope(isEncrypting ? "encrypt" : "decrypt", text.size());
+    vector<int> shifts = keyShifts(key, isEncrypting);
+
+    // Characters outside the alphabet are copied and do not advance the key
+    return vigenere(lab_alphabet(), text, shifts);
+}
+
+
+string encrypt(const string& text, const string& key) {
+	return vietaChiper(text, key, true);
+}
+
+
+string decrypt(const string& text, const string& key) {
+    return vietaChiper(text, key, false);
+}
 
-    for (size_t textIndex = 0, keyIndex = 0; text[textIndex] != '\0'; textIndex++) {
-        textCharIndex = getCharIndex(text[textIndex]);
-        keyCharIndex = getCharIndex(key[keyIndex]);
 
-        if (textCharIndex == -1 || keyCharIndex == -1) {
-            result += text[textIndex];
-            continue;
+// Encrypts (decrypts) one file under every key of the list: --batch INPUT KEYS [--decrypt].
+// The text is read and lowercased once and all the keys go over it in one pass
+int runBatch(const string& inputPath, const string& keysPath, bool decrypting) {
+    vector<string> paths;
+    vector<string> keyList;
+    vector<vector<int>> keys;
+    string text;
+    try {
+        text = readFileContent(inputPath);
+        keyList = read_key_list(keysPath);
+    }
+    catch (const exception& e) {
+        cerr << "Batch error: " << e.what() << endl;
+        return 1;
+    }
+    for (string key : keyList) {
+        toLowerCase(key);
+        try {
+            keys.push_back(keyShifts(key, !decrypting));
+        }
+        catch (const exception& e) {
+            cerr << "Batch error: key \"" << key << "\": " << e.what() << endl;
+            return 1;
         }
+        paths.push_back(batch_output_name(OUTPUT_FILE_NAME, paths.size() + 1));
+    }
 
-        if (isEncrypting)
-            resCharIndex = (textCharIndex + keyCharIndex) % alphabetSize;
-        else
-            resCharIndex = (textCharIndex - keyCharIndex + alphabetSize) % alphabetSize;
+    toLowerCase(text);
+    ProfileScope scope(decrypting ? "decrypt batch" : "encrypt batch", text.size() * keys.size());
+    vector<string> results = vigenere_batch(lab_alphabet(), text, keys);
+    scope.stop();
 
-        result += alphabet[resCharIndex];
+    // Uppercasing, like the single-key output, is done by the writer threads
+    try {
+        write_files_concurrently(paths, results, toUpperCase);
+    }
+    catch (const exception& e) {
+        cerr << "Batch error: " << e.what() << endl;
+        return 1;
+    }
+    for (size_t k = 0; k < paths.size(); k++) {
+        cout << paths[k] << ": key " << keyList[k] << endl;
+    }
+    return 0;
+}
 
-        keyIndex = (keyIndex + 1) % key.length();
-	}
 
-	return result;
+// Tries every line of the wordlist as the key; prints the best keys and
+// saves the decryption with the best one
+int runAttack(const string& ciphertextPath, const string& wordlistPath, const string& corpusPath, const AttackOptions& options) {
+    AttackResult result;
+    string ciphertext;
+    try {
+        ciphertext = readFileContent(ciphertextPath);
+        NGramFitness fitness(lab_alphabet(), readFileContent(corpusPath));
+        string wordlist = readFileContent(wordlistPath);
+        result = dictionaryAttack(lab_alphabet(), fitness, ciphertext, wordlist, options);
+    }
+    catch (const exception& e) {
+        cerr << "Attack error: " << e.what() << endl;
+        return 1;
+    }
+
+    double rate = result.seconds > 0 ? double(result.candidates) / result.seconds : 0;
+    double percent = result.candidates ? 100.0 / double(result.candidates) : 0;
+    cout << fixed << setprecision(2) << "Tried " << result.candidates << " keys in " << result.seconds << " s: "
+         << setprecision(0) << rate << " keys/s, " << options.threads << " thread(s)" << endl;
+    cout << setprecision(3) << "Bigram check (threshold " << result.threshold << ") rejected "
+         << setprecision(1) << double(result.rejected) * percent << "%, quadgram bound stopped "
+         << double(result.pruned) * percent << "%";
+    if (result.skipped) cout << ", " << result.skipped << " lines had no letters of the alphabet";
+    cout << endl;
+
+    if (result.best.empty()) {
+        cout << "No key passed the bigram check (try a lower --threshold)" << endl;
+        return 1;
+    }
+
+    cout << "\nBest keys (mean quadgram log10 probability):" << endl;
+    for (size_t i = 0; i < result.best.size(); i++) {
+        string preview = decrypt(ciphertext.substr(0, utf8_complete_length(string_view(ciphertext).substr(0, 60))), result.best[i].key);
+        replace(preview.begin(), preview.end(), '\n', ' ');
+        replace(preview.begin(), preview.end(), '\r', ' ');
+        cout << setw(3) << i + 1 << ". " << setprecision(3) << result.best[i].score << "  " << result.best[i].key
+             << "  \"" << preview << "\"" << endl;
+    }
+
+    string decrypted = decrypt(ciphertext, result.best.front().key);
+    toUpperCase(decrypted);
+    console_text("\nDecrypted with \"" + result.best.front().key + "\": \n", decrypted);
+    console_flush();
+    writeFileContent(OUTPUT_FILE_NAME, decrypted);
+    return 0;
 }
 
 
-string encrypt(const string& text, const string& key) {
-	return vietaChiper(text, key, true);
+// A 3-symbol key, which gets an instantiation of its own, against a
+// 13-symbol one that takes the general path, with both lookups (see kernel_bench.h)
+int runBenchmark() {
+    const size_t SIZE = size_t(8) << 20;
+    const Alphabet& alphabet = lab_alphabet();
+    const string text = bench_text(alphabet, SIZE);
+    vector<int> shortKey = { 3, 1, 4 };
+    vector<int> longKey;
+    for (int i = 0; i < 13; i++) longKey.push_back((i * 7 + 2) % alphabet.size());
+
+    cout << "=== Vigenere cipher lookups (" << SIZE / (1 << 20) << " MB, " << lab_alphabet_name() << " alphabet) ===" << endl;
+    bool ok = bench_lookups("encrypt, 3-symbol key", text.size(), [&](auto lookup) { return vigenere<lookup>(alphabet, text, shortKey); });
+    ok = bench_lookups("encrypt, 13-symbol key", text.size(), [&](auto lookup) { return vigenere<lookup>(alphabet, text, longKey); }) && ok;
+    return ok ? 0 : 1;
 }
 
 
-string decrypt(const string& text, const string& key) {
-    return vietaChiper(text, key, false);
+// vietaChiper, both lookups of vigenere (any alphabet) and vigenere_batch
+// against the reference on random texts and keys, and vietaChiper against
+// the baseline on ASCII text (see reference.h and differential.h)
+int runFuzz(int cases, uint64_t seed, const string& recordPath) {
+    FuzzRun run("lab4", cases, seed);
+    auto caseShifts = [](FuzzRandom& rng, const Alphabet& alphabet, size_t length) {
+        vector<int> shifts(length);
+        for (int& shift : shifts) shift = int(rng() % unsigned(alphabet.size()));
+        return shifts;
+    };
+
+    // Keys as typed: any characters, sometimes none of the alphabet
+    run.check("vietaChiper", [&](FuzzRandom& rng, string& what) {
+        const Alphabet& alphabet = lab_alphabet();
+        string key = fuzz_text(rng, alphabet, 12);
+        bool isEncrypting = rng() % 2;
+        string text = fuzz_text(rng, alphabet, 300);
+        what = string(isEncrypting ? "encrypt" : "decrypt") + ", key \"" + key + "\"";
+        return make_pair(fuzz_outcome([&] { return referenceVietaChiper(alphabet, text, key, isEncrypting); }),
+            fuzz_outcome([&] { return vietaChiper(text, key, isEncrypting); }));
+    });
+    // The baseline knew the latin alphabet only; text and key lowercased as its main did
+    if (lab_alphabet_name() == "latin") {
+        run.check("baseline vietaChiper", [&](FuzzRandom& rng, string& what) {
+            string key = fuzz_ascii(rng, 12);
+            bool isEncrypting = rng() % 2;
+            string text = fuzz_ascii(rng, 300);
+            baseline::toLowerCase(key);
+            baseline::toLowerCase(text);
+            what = string(isEncrypting ? "encrypt" : "decrypt") + ", key \"" + key + "\"";
+            string baselineKey;
+            for (char c : key) {
+                if (baseline::getCharIndex(c) >= 0) baselineKey += c;
+            }
+            string expected = baselineKey.empty() ? FUZZ_THROWS : baseline::vietaChiper(text, baselineKey, isEncrypting);
+            return make_pair(expected, fuzz_outcome([&] { return vietaChiper(text, key, isEncrypting); }));
+        });
+    }
+    auto engineCase = [&](auto lookup) {
+        return [&, lookup](FuzzRandom& rng, string& what) {
+            Alphabet alphabet = fuzz_alphabet(rng);
+            vector<int> shifts = caseShifts(rng, alphabet, 1 + rng() % 20);
+            string text = fuzz_text(rng, alphabet, rng() % 16 == 0 ? 20000 : 300);
+            what = to_string(shifts.size()) + "-symbol key, alphabet \"" + alphabet.str() + "\"";
+            return make_pair(referenceVigenere(alphabet, text, shifts), vigenere<lookup>(alphabet, text, shifts));
+        };
+    };
+    run.check("vigenere, any alphabet", engineCase(integral_constant<Lookup, Lookup::Fast>()));
+    run.check("vigenere, constant-time", engineCase(integral_constant<Lookup, Lookup::ConstantTime>()));
+    // Keys of one length and of mixed lengths take different instantiations
+    run.check("vigenere_batch", [&](FuzzRandom& rng, string& what) {
+        Alphabet alphabet = fuzz_alphabet(rng);
+        bool sameLength = rng() % 2;
+        size_t length = 1 + rng() % 20;
+        vector<vector<int>> keys(1 + rng() % 6);
+        for (vector<int>& shifts : keys) shifts = caseShifts(rng, alphabet, sameLength ? length : 1 + rng() % 20);
+        string text = fuzz_text(rng, alphabet, 10000);
+        what = to_string(keys.size()) + (sameLength ? " keys of one length" : " keys") + ", alphabet \"" + alphabet.str() + "\"";
+        string expected, actual;
+        for (const vector<int>& shifts : keys) expected += referenceVigenere(alphabet, text, shifts) + '\0';
+        for (const string& result : vigenere_batch(alphabet, text, keys)) actual += result + '\0';
+        return make_pair(expected, actual);
+    });
+
+    const string text = bench_text(lab_alphabet(), size_t(2) << 20);
+    const string key = string(lab_alphabet().utf8(3)) + string(lab_alphabet().utf8(1)) + string(lab_alphabet().utf8(4));
+    string sink;
+    run.measure("encrypt", text.size(), [&] { sink = referenceVietaChiper(lab_alphabet(), text, key, true); },
+        [&] { sink = encrypt(text, key); });
+    return run.finish(recordPath);
 }
\ No newline at end of file
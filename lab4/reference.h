@@ -0,0 +1,105 @@
+#pragma once
+#include <cctype>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../common/alphabet.h"
+#include "../common/differential.h"
+
+
+// Reference Vigenere cipher, the oracle of --fuzz for UTF-8 text, any
+// alphabet and any key (see baseline below for the rest): symbols are found by a
+// linear search and shifted with %, the key advancing on symbols only.
+
+// shifts in [0, size): added to the symbol indices in turn
+inline std::string referenceVigenere(const Alphabet& alphabet, const std::string& text, const std::vector<int>& shifts) {
+    std::string result;
+    size_t k = 0;
+    reference_characters(text, [&](char32_t c, std::string_view bytes) {
+        int pos = reference_index(alphabet, c);
+        if (pos >= 0) {
+            reference_append(result, alphabet.symbol((pos + shifts[k % shifts.size()]) % alphabet.size()));
+            k++;
+        }
+        else {
+            result += bytes;
+        }
+    });
+    return result;
+}
+
+// The key as text: characters outside the alphabet are dropped, and a key
+// with none of the alphabet throws
+inline std::string referenceVietaChiper(const Alphabet& alphabet, const std::string& text, const std::string& key, bool isEncrypting) {
+    std::vector<int> shifts;
+    reference_characters(key, [&](char32_t c, std::string_view) {
+        int pos = reference_index(alphabet, c);
+        if (pos >= 0) shifts.push_back(isEncrypting ? pos : (alphabet.size() - pos) % alphabet.size());
+    });
+    if (shifts.empty()) throw std::runtime_error("The key has no characters of the alphabet");
+    return referenceVigenere(alphabet, text, shifts);
+}
+
+
+// vietaChiper of the baseline lab4 and the lowercasing its main did on the
+// text and the key, copied as they were (only made inline), the oracle of
+// --fuzz for the latin alphabet and ASCII text. The lab now differs from
+// them on purpose in these cases only:
+//  - key characters outside the alphabet: the baseline stopped advancing
+//    the key on the first one and copied the rest of the text, they are
+//    now dropped from the key (the check drops them before calling it)
+//  - a key with none of the alphabet: the baseline copied the text, the
+//    lab now refuses the key
+//  - a NUL in the text: the baseline stopped there (fuzz_ascii has none)
+//  - characters past ASCII: the baseline copied single bytes, the text is
+//    now read as UTF-8 (left to referenceVietaChiper)
+namespace baseline {
+using namespace std;
+
+const string alphabet = "abcdefghijklmnopqrstuvwxyz .,;-'";
+const int alphabetSize = alphabet.length();
+
+
+inline int getCharIndex(char c) {
+    for (int i = 0; i < alphabetSize; i++) {
+        if (alphabet[i] == c) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+inline string vietaChiper(const string& text, const string& key, bool isEncrypting) {
+    string result = "";
+	int textCharIndex, keyCharIndex, resCharIndex;
+
+    for (size_t textIndex = 0, keyIndex = 0; text[textIndex] != '\0'; textIndex++) {
+        textCharIndex = getCharIndex(text[textIndex]);
+        keyCharIndex = getCharIndex(key[keyIndex]);
+
+        if (textCharIndex == -1 || keyCharIndex == -1) {
+            result += text[textIndex];
+            continue;
+        }
+
+        if (isEncrypting)
+            resCharIndex = (textCharIndex + keyCharIndex) % alphabetSize;
+        else
+            resCharIndex = (textCharIndex - keyCharIndex + alphabetSize) % alphabetSize;
+
+        result += alphabet[resCharIndex];
+
+        keyIndex = (keyIndex + 1) % key.length();
+	}
+
+	return result;
+}
+
+
+inline void toLowerCase(string& text) {
+    for (char& c : text) {
+        c = tolower((unsigned char)c);
+    }
+}
+}
@@ -0,0 +1,89 @@
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "hill_cipher.h"
+
+using namespace std;
+
+
+// Function to normalize key matrix (mod alphabet size)
+vector<vector<int>> normalizeKeyMatrix(const vector<vector<int>>& keyMatrix, const Alphabet& alphabet) {
+    const int ALPHABET_SIZE = alphabet.size();
+    vector<vector<int>> normalized = keyMatrix;
+    for (auto& row : normalized) {
+        for (auto& val : row) {
+            val = val % ALPHABET_SIZE;
+            if (val < 0) val += ALPHABET_SIZE;
+        }
+    }
+    return normalized;
+}
+
+static bool isKeySpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static string keyPosition(size_t line, size_t column) {
+    return "line " + to_string(line) + ", column " + to_string(column);
+}
+
+// Tokens are read in place with from_chars: no stream or string per line or value
+vector<vector<int>> parseKeyMatrix(const string& keyText, int& n, const Alphabet& alphabet) {
+    const int ALPHABET_SIZE = alphabet.size();
+    vector<vector<int>> keyMatrix;
+    size_t expectedCols = 0;
+    size_t lineNumber = 0;
+
+    const char* p = keyText.data();
+    const char* end = p + keyText.size();
+    while (p < end) {
+        const char* lineStart = p;
+        const char* lineEnd = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+        if (!lineEnd) lineEnd = end;
+        p = lineEnd == end ? end : lineEnd + 1;
+        lineNumber++;
+
+        vector<int> row;
+        row.reserve(expectedCols);
+        const char* q = lineStart;
+        while (true) {
+            while (q < lineEnd && isKeySpace(*q)) q++;
+            if (q == lineEnd) break;
+            const char* token = q;
+            while (q < lineEnd && !isKeySpace(*q)) q++;
+
+            // from_chars takes no '+', stoi did
+            const char* digits = *token == '+' && q - token > 1 && token[1] != '-' ? token + 1 : token;
+            int value = 0;
+            auto [stop, error] = from_chars(digits, q, value);
+            if (error == errc::result_out_of_range) {
+                throw runtime_error("Value out of range in key matrix at " + keyPosition(lineNumber, size_t(token - lineStart) + 1) +
+                    ": '" + string(token, q) + "'");
+            }
+            if (error != errc() || stop != q) {
+                const char* bad = error != errc() ? digits : stop;
+                throw runtime_error("Invalid value in key matrix at " + keyPosition(lineNumber, size_t(bad - lineStart) + 1) +
+                    ": '" + string(token, q) + "'");
+            }
+            value %= ALPHABET_SIZE;
+            row.push_back(value < 0 ? value + ALPHABET_SIZE : value);
+        }
+        if (row.empty()) continue;
+
+        if (keyMatrix.empty()) expectedCols = row.size();
+        else if (row.size() != expectedCols) {
+            throw runtime_error("Non-square key matrix: line " + to_string(lineNumber) + " has " + to_string(row.size()) +
+                " values, the first row has " + to_string(expectedCols));
+        }
+        keyMatrix.push_back(move(row));
+    }
+
+    if (keyMatrix.size() != expectedCols || keyMatrix.empty()) {
+        throw runtime_error("Non-square key matrix: " + to_string(keyMatrix.size()) + " rows of " + to_string(expectedCols) + " values");
+    }
+
+    n = int(keyMatrix.size());
+    return keyMatrix;
+}
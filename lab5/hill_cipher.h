@@ -0,0 +1,473 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdexcept>
+#include "../common/alphabet.h"
+#include "../common/cipher_engines.h"
+#include "../common/parallel_chunks.h"
+
+
+std::vector<std::vector<int>> normalizeKeyMatrix(const std::vector<std::vector<int>>& keyMatrix,
+                                                 const Alphabet& alphabet = lab_alphabet());
+
+// Key matrix from text: one row per line, values separated by spaces or
+// tabs, blank lines skipped; the values are normalized modulo the size of
+// the alphabet the key is for. Errors give the line and column of the
+// offending value
+std::vector<std::vector<int>> parseKeyMatrix(const std::string& keyText, int& n,
+                                             const Alphabet& alphabet = lab_alphabet());
+
+// Largest block lookup table: blocks of N symbols of an alphabet of size S
+// have S^N values, 32^3 = 32768 (128 KB) and 39^3 = 59319 (232 KB), so the
+// latin and ukrainian tables up to N = 3 stay in L2
+const size_t HILL_TABLE_MAX = 65536;
+
+// Hill cipher over an alphabet (LAB_ALPHABET by default); the inverse key matrix is computed once
+// in the constructor (or loaded with the key), after that the object is read-only and can be shared.
+//
+// When S^N <= HILL_TABLE_MAX the constructor also maps every block value
+// through both matrices, and a block is then encrypted by one table load.
+// Larger blocks are multiplied a tile of blocks at a time (see multiplyBlocks),
+// and so are all blocks with Lookup::ConstantTime: the table load's address
+// is the block, the product only reads the matrix in order.
+//
+// Blocks are independent (like ECB), so with several threads encrypt and
+// decrypt cut the text into parts at character boundaries: every part
+// lists its symbols, the symbols are packed into one stream, the stream is
+// encrypted in block-aligned ranges, and every part writes its text back
+// with the symbols replaced. The result is the same as on one thread.
+class HillCipher {
+private:
+    std::vector<std::vector<int>> keyMatrix;
+    std::vector<std::vector<int>> inverseKeyMatrix;
+    const Alphabet* alphabet;
+    int matrixSize;
+    int modValue;
+
+    // Row-major copies of the matrices for multiplyBlocks
+    std::vector<int> keyFlat;
+    std::vector<int> inverseFlat;
+
+    // Block code (the symbols as digits of a base-modValue number, first
+    // symbol highest) -> the output symbols, 6 bits each, first symbol lowest.
+    // Empty when the block has more than HILL_TABLE_MAX values
+    std::vector<uint32_t> encryptTable;
+    std::vector<uint32_t> decryptTable;
+
+    // Modular inverse of a unit a (brute force: the modulus is an alphabet size)
+    int modInverse(int a, int m) const {
+        a = a % m;
+        for (int x = 1; x < m; x++) {
+            if ((a * x) % m == 1) {
+                return x;
+            }
+        }
+        throw std::runtime_error("Inverse element does not exist");
+    }
+
+    // Calculate inverse matrix modulo: Gauss-Jordan elimination on [key | I].
+    // The modulus need not be prime, so a column is brought to a single
+    // nonzero entry by Euclid's algorithm on rows (subtract a multiple, swap),
+    // which changes the determinant only in sign; the key is invertible iff every
+    // pivot is then coprime with the modulus. O(N^3 log m), unlike cofactor
+    // expansion, so large keys are practical
+    void calculateInverseMatrix() {
+        const int n = matrixSize;
+        const int m = modValue;
+        std::vector<std::vector<int>> work = keyMatrix;
+        inverseKeyMatrix.assign(n, std::vector<int>(n, 0));
+        for (int i = 0; i < n; i++) inverseKeyMatrix[i][i] = 1;
+
+        // row[to] -= factor * row[from] (mod m) in both halves
+        auto subtractRow = [&](int to, int from, int factor) {
+            for (int j = 0; j < n; j++) {
+                work[to][j] = ((work[to][j] - factor * work[from][j]) % m + m) % m;
+                inverseKeyMatrix[to][j] = ((inverseKeyMatrix[to][j] - factor * inverseKeyMatrix[from][j]) % m + m) % m;
+            }
+        };
+
+        for (int col = 0; col < n; col++) {
+            for (int row = col + 1; row < n; row++) {
+                while (work[row][col] != 0) {
+                    subtractRow(col, row, work[col][col] / work[row][col]);
+                    std::swap(work[col], work[row]);
+                    std::swap(inverseKeyMatrix[col], inverseKeyMatrix[row]);
+                }
+            }
+            if (gcd(work[col][col], m) != 1) {
+                throw std::runtime_error("Key matrix is not invertible for this alphabet");
+            }
+            const int pivotInverse = modInverse(work[col][col], m);
+            for (int j = 0; j < n; j++) {
+                work[col][j] = work[col][j] * pivotInverse % m;
+                inverseKeyMatrix[col][j] = inverseKeyMatrix[col][j] * pivotInverse % m;
+            }
+            for (int row = 0; row < n; row++) {
+                if (row != col && work[row][col] != 0) subtractRow(row, col, work[row][col]);
+            }
+        }
+    }
+
+    // GCD for invertibility check
+    int gcd(int a, int b) const {
+        while (b != 0) {
+            int temp = b;
+            b = a % b;
+            a = temp;
+        }
+        return a;
+    }
+
+    // Convert text to numerical vector (skip characters not in alphabet).
+    // The vector is reserved for the whole text up front.
+    template <Lookup L>
+    void textToVector(const std::string& text, std::pmr::vector<int>& result) const {
+        result.clear();
+        result.reserve(text.length() + matrixSize);
+        alphabet->scan<L>(text, [&](int pos) { result.push_back(pos); });
+    }
+
+    // Blocks in a tile of multiplyBlocks
+    static const size_t TILE = 256;
+
+    static std::vector<int> flatten(const std::vector<std::vector<int>>& matrix) {
+        std::vector<int> flat;
+        for (const auto& row : matrix) flat.insert(flat.end(), row.begin(), row.end());
+        return flat;
+    }
+
+    // Multiplies blocks consecutive vectors of matrixSize symbols by the
+    // matrix, as one matrix product: a tile of blocks is transposed so that
+    // every matrix entry is applied to a contiguous row of TILE symbols
+    // (a loop the compiler vectorizes), then every output row is reduced
+    // and written back. The entries are in [0, modValue), so the unsigned
+    // sums are never negative
+    template <int Size>
+    void multiplyBlocks(const int* matrix, const int* in, int* out, size_t blocks, const Modulo<Size>& mod,
+        std::pmr::memory_resource* memory) const {
+        const size_t n = size_t(matrixSize);
+        std::pmr::vector<unsigned> columns(n * TILE, memory);  // columns[j * TILE + t]: symbol j of block t
+        unsigned sums[TILE];
+        for (size_t first = 0; first < blocks; first += TILE) {
+            const size_t tile = std::min(TILE, blocks - first);
+            const int* tileIn = in + first * n;
+            int* tileOut = out + first * n;
+            for (size_t t = 0; t < tile; t++) {
+                for (size_t j = 0; j < n; j++) columns[j * TILE + t] = unsigned(tileIn[t * n + j]);
+            }
+            for (size_t i = 0; i < n; i++) {
+                for (size_t t = 0; t < tile; t++) sums[t] = 0;
+                for (size_t j = 0; j < n; j++) {
+                    const unsigned entry = unsigned(matrix[i * n + j]);
+                    const unsigned* column = &columns[j * TILE];
+                    for (size_t t = 0; t < tile; t++) sums[t] += entry * column[t];
+                }
+                for (size_t t = 0; t < tile; t++) tileOut[t * n + i] = mod.reduce(sums[t]);
+            }
+        }
+    }
+
+    // The table for a matrix: every block value multiplied once
+    std::vector<uint32_t> buildTable(const std::vector<int>& matrix) const {
+        size_t values = 1;
+        for (int i = 0; i < matrixSize; i++) values *= size_t(modValue);
+
+        std::vector<int> blocks(values * size_t(matrixSize));
+        for (size_t code = 0; code < values; code++) {
+            size_t rest = code;
+            for (int j = matrixSize - 1; j >= 0; j--) {
+                blocks[code * matrixSize + j] = int(rest % size_t(modValue));
+                rest /= size_t(modValue);
+            }
+        }
+        std::vector<int> products(blocks.size());
+        with_alphabet_size(modValue, [&](auto size) {
+            multiplyBlocks(matrix.data(), blocks.data(), products.data(), values, Modulo<size>(modValue),
+                std::pmr::get_default_resource());
+        });
+
+        std::vector<uint32_t> table(values);
+        for (size_t code = 0; code < values; code++) {
+            uint32_t packed = 0;
+            for (int j = 0; j < matrixSize; j++) packed |= uint32_t(products[code * matrixSize + j]) << (6 * j);
+            table[code] = packed;
+        }
+        return table;
+    }
+
+    // Table lookup for every block; N is the matrix size as a constant
+    template <int N>
+    void lookupBlocks(const std::vector<uint32_t>& table, const int* in, int* out, size_t blocks) const {
+        const uint32_t base = uint32_t(modValue);
+        for (size_t b = 0; b < blocks; b++) {
+            uint32_t code = 0;
+            for (int j = 0; j < N; j++) code = code * base + uint32_t(in[b * N + j]);
+            const uint32_t packed = table[code];
+            for (int j = 0; j < N; j++) out[b * N + j] = int((packed >> (6 * j)) & 63);
+        }
+    }
+
+    // Encrypts blocks consecutive blocks with the table if there is one, with the matrix otherwise.
+    // The table is indexed by the block, so Lookup::ConstantTime always multiplies
+    template <Lookup L>
+    void applyBlocks(const std::vector<int>& matrix, const std::vector<uint32_t>& table, const int* in, int* out,
+        size_t blocks, std::pmr::memory_resource* memory) const {
+        if (L == Lookup::Fast && !table.empty()) {
+            switch (matrixSize) {
+            case 1: lookupBlocks<1>(table, in, out, blocks); break;
+            case 2: lookupBlocks<2>(table, in, out, blocks); break;
+            case 3: lookupBlocks<3>(table, in, out, blocks); break;
+            }
+        }
+        else {
+            with_alphabet_size(modValue, [&](auto size) {
+                multiplyBlocks(matrix.data(), in, out, blocks, Modulo<size>(modValue), memory);
+            });
+        }
+    }
+
+    // Apply matrix to every block of the alphabet characters; the others keep their positions.
+    // Temporary vectors come from memory, e.g. a JobArena released after the job.
+    template <Lookup L>
+    std::string transform(const std::string& text, const std::vector<int>& matrix, const std::vector<uint32_t>& table,
+        std::pmr::memory_resource* memory) const {
+        std::pmr::vector<int> textVector(memory);
+        textToVector<L>(text, textVector);
+
+        // If no characters to process
+        if (textVector.empty()) {
+            return text;
+        }
+
+        // Add padding if needed
+        while (textVector.size() % matrixSize != 0) {
+            textVector.push_back(0); // 'a' as padding
+        }
+
+        std::pmr::vector<int> processed(textVector.size(), memory);
+        applyBlocks<L>(matrix, table, textVector.data(), processed.data(), textVector.size() / matrixSize, memory);
+
+        // Reconstruct text with position preservation: the alphabet characters
+        // are replaced in order (padding is dropped)
+        size_t next = 0;
+        return alphabet->transform<L>(text, [&](int) { return processed[next++]; });
+    }
+
+    // Text bytes (and blocks) per thread below which a thread is not worth starting
+    static const size_t MIN_BYTES_PER_THREAD = 64 * 1024;
+    static const size_t MIN_BLOCKS_PER_THREAD = 16 * 1024;
+
+    // transform on several threads. The vectors are allocated here, on the
+    // calling thread; the workers only fill them (a JobArena is not thread-safe)
+    template <Lookup L>
+    std::string transformParallel(const std::string& text, const std::vector<int>& matrix,
+        const std::vector<uint32_t>& table, std::pmr::memory_resource* memory, unsigned threads) const {
+        const size_t parts = std::min<size_t>(threads, text.size() / MIN_BYTES_PER_THREAD);
+        if (parts <= 1) {
+            return transform<L>(text, matrix, table, memory);
+        }
+        // A part starts at the first character start at or after its even
+        // share. Every byte that is not a UTF-8 continuation byte starts a
+        // character in a walk from the beginning of the text, so the parts
+        // decode exactly as the whole text does
+        const std::string_view view(text);
+        std::vector<size_t> partStart(parts + 1, text.size());
+        partStart[0] = 0;
+        for (size_t part = 1; part < parts; part++) {
+            size_t position = text.size() / parts * part;
+            while (position < text.size() && (static_cast<unsigned char>(text[position]) & 0xC0) == 0x80) position++;
+            partStart[part] = position;
+        }
+        auto forEachPart = [&](auto fn) {
+            parallel_chunks(parts, unsigned(parts), 1, [&](size_t begin, size_t end) {
+                for (size_t part = begin; part < end; part++) {
+                    fn(part, view.substr(partStart[part], partStart[part + 1] - partStart[part]));
+                }
+            });
+        };
+
+        // Symbols of every part, written at the part's byte offset
+        // (a part has no more symbols than bytes), then packed
+        std::pmr::vector<int> scattered(text.size(), memory);
+        std::vector<size_t> symbolStart(parts + 1, 0);
+        forEachPart([&](size_t part, std::string_view partText) {
+            int* out = scattered.data() + partStart[part];
+            size_t count = 0;
+            alphabet->scan<L>(partText, [&](int pos) { out[count++] = pos; });
+            symbolStart[part + 1] = count;
+        });
+        for (size_t part = 0; part < parts; part++) symbolStart[part + 1] += symbolStart[part];
+        const size_t symbols = symbolStart[parts];
+        if (symbols == 0) {
+            return text;
+        }
+
+        // Padded with 'a' to whole blocks, as on one thread
+        const size_t blocks = (symbols + matrixSize - 1) / matrixSize;
+        std::pmr::vector<int> textVector(blocks * matrixSize, 0, memory);
+        forEachPart([&](size_t part, std::string_view) {
+            std::copy_n(scattered.data() + partStart[part], symbolStart[part + 1] - symbolStart[part], textVector.data() + symbolStart[part]);
+        });
+
+        std::pmr::vector<int> processed(textVector.size(), memory);
+        parallel_chunks(blocks, threads, MIN_BLOCKS_PER_THREAD, [&](size_t begin, size_t end) {
+            applyBlocks<L>(matrix, table, textVector.data() + begin * matrixSize, processed.data() + begin * matrixSize, end - begin,
+                std::pmr::new_delete_resource());
+        });
+
+        // Every part rebuilds its text into its own region of a scratch
+        // buffer, then the regions are packed into the result
+        std::vector<size_t> regionStart(parts + 1, 0);
+        for (size_t part = 0; part < parts; part++) {
+            regionStart[part + 1] = regionStart[part] + alphabet->transform_capacity(partStart[part + 1] - partStart[part]);
+        }
+        std::pmr::vector<char> scratch(regionStart[parts], memory);
+        std::vector<size_t> outputStart(parts + 1, 0);
+        forEachPart([&](size_t part, std::string_view partText) {
+            size_t next = symbolStart[part];
+            outputStart[part + 1] = alphabet->transform_to<L>(partText, scratch.data() + regionStart[part], [&](int) { return processed[next++]; });
+        });
+        for (size_t part = 0; part < parts; part++) outputStart[part + 1] += outputStart[part];
+
+        std::string result(outputStart[parts], '\0');
+        forEachPart([&](size_t part, std::string_view) {
+            std::copy_n(scratch.data() + regionStart[part], outputStart[part + 1] - outputStart[part], result.data() + outputStart[part]);
+        });
+        return result;
+    }
+
+    // Flat matrices and, for small blocks, the lookup tables
+    void prepare() {
+        keyFlat = flatten(keyMatrix);
+        inverseFlat = flatten(inverseKeyMatrix);
+
+        size_t values = 1;
+        for (int i = 0; i < matrixSize && values <= HILL_TABLE_MAX; i++) values *= size_t(modValue);
+        if (matrixSize <= 3 && values <= HILL_TABLE_MAX) {
+            encryptTable = buildTable(keyFlat);
+            decryptTable = buildTable(inverseFlat);
+        }
+    }
+
+public:
+    HillCipher(const std::vector<std::vector<int>>& key, const Alphabet& cipherAlphabet = lab_alphabet())
+        : keyMatrix(key), alphabet(&cipherAlphabet), matrixSize(key.size()), modValue(cipherAlphabet.size()) {
+        for (auto& row : keyMatrix) {
+            for (auto& val : row) val = (val % modValue + modValue) % modValue;
+        }
+        calculateInverseMatrix();
+        prepare();
+    }
+
+    // Key with its inverse already known (a binary key file, see key_file.h):
+    // both must be normalized; the inverse is taken as is, not recomputed
+    HillCipher(std::vector<std::vector<int>> key, std::vector<std::vector<int>> inverse,
+        const Alphabet& cipherAlphabet = lab_alphabet())
+        : keyMatrix(std::move(key)), inverseKeyMatrix(std::move(inverse)), alphabet(&cipherAlphabet),
+          matrixSize(int(keyMatrix.size())), modValue(cipherAlphabet.size()) {
+        prepare();
+    }
+
+    int size() const { return matrixSize; }
+    int modulus() const { return modValue; }
+    const std::vector<std::vector<int>>& key() const { return keyMatrix; }
+    const std::vector<std::vector<int>>& inverse() const { return inverseKeyMatrix; }
+    const Alphabet& symbols() const { return *alphabet; }
+
+    // Bytes of temporary vectors that encrypt/decrypt need for a text (arena size hint);
+    // with several threads there is also the per-part symbol lists and the scratch text
+    size_t workspaceSize(size_t textLength, unsigned threads = 1) const {
+        size_t size = (textLength + matrixSize) * 2 * sizeof(int) + matrixSize * TILE * sizeof(unsigned) + 256;
+        if (threads > 1) size += textLength * sizeof(int) + alphabet->transform_capacity(textLength) + threads * 64;
+        return size;
+    }
+
+    // Encryption with preservation of non-alphabet characters
+    template <Lookup L>
+    std::string encrypt(const std::string& plaintext,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource(), unsigned threads = 1) const {
+        return transformParallel<L>(plaintext, keyFlat, encryptTable, memory, threads);
+    }
+
+    // Decryption with preservation of non-alphabet characters
+    template <Lookup L>
+    std::string decrypt(const std::string& ciphertext,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource(), unsigned threads = 1) const {
+        return transformParallel<L>(ciphertext, inverseFlat, decryptTable, memory, threads);
+    }
+
+    // The same with the lookup selected for the process (LAB_CONSTANT_TIME)
+    std::string encrypt(const std::string& plaintext,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource(), unsigned threads = 1) const {
+        return with_lookup([&](auto lookup) { return encrypt<lookup>(plaintext, memory, threads); });
+    }
+
+    std::string decrypt(const std::string& ciphertext,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource(), unsigned threads = 1) const {
+        return with_lookup([&](auto lookup) { return decrypt<lookup>(ciphertext, memory, threads); });
+    }
+};
+
+
+// Encryption (decryption) of a text that comes in pieces of any size, split
+// anywhere, even inside a UTF-8 sequence: update() returns the text whose
+// blocks are complete, finalize() the rest, padded like the whole text would
+// be. Together they give exactly encrypt() (decrypt()) of the whole text.
+//
+// Between pieces only the tail of the text is kept: the bytes of a split
+// character and everything from the first symbol of the incomplete block on
+// (its fewer than N symbols and the characters between them), so a file of
+// any size runs in memory for a piece plus that tail.
+class HillStream {
+private:
+    const HillCipher* cipher;
+    bool decrypting;
+    unsigned threads;
+    std::string pending;
+
+    std::string apply(const std::string& text) const {
+        return decrypting ? cipher->decrypt(text, std::pmr::get_default_resource(), threads)
+                          : cipher->encrypt(text, std::pmr::get_default_resource(), threads);
+    }
+
+    // Bytes of the complete prefix of pending that hold whole blocks only:
+    // up to the first symbol of the incomplete block, or all of it
+    template <Lookup L>
+    size_t readyLength(size_t complete) const {
+        const size_t n = size_t(cipher->size());
+        const char* start = pending.data();
+        size_t symbols = 0;
+        size_t blockStart = 0;
+        cipher->symbols().for_each<L>(std::string_view(start, complete),
+            [&](int, std::string_view c) {
+                if (symbols % n == 0) blockStart = size_t(c.data() - start);
+                symbols++;
+            },
+            [](std::string_view) {});
+        return symbols % n == 0 ? complete : blockStart;
+    }
+
+public:
+    // The cipher must outlive the stream
+    HillStream(const HillCipher& cipher, bool decrypting, unsigned threads = 1)
+        : cipher(&cipher), decrypting(decrypting), threads(threads) {}
+
+    std::string update(std::string_view piece) {
+        pending += piece;
+        const size_t complete = utf8_complete_length(pending);
+        const size_t ready = with_lookup([&](auto lookup) { return readyLength<lookup>(complete); });
+        std::string output = apply(pending.substr(0, ready));
+        pending.erase(0, ready);
+        return output;
+    }
+
+    std::string finalize() {
+        std::string output = apply(pending);
+        pending.clear();
+        return output;
+    }
+};
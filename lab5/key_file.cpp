@@ -0,0 +1,111 @@
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "key_file.h"
+#include "../common/profiler.h"
+
+using namespace std;
+
+
+static uint64_t fnv1a(const char* data, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= uint8_t(data[i]);
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+static void putLE(string& out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++) out += char((value >> (8 * i)) & 0xFF);
+}
+
+static uint64_t getLE(const char* data, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | uint8_t(data[i]);
+    return value;
+}
+
+bool isBinaryKey(const string& data) {
+    return data.size() >= sizeof(KEY_FILE_MAGIC) && memcmp(data.data(), KEY_FILE_MAGIC, sizeof(KEY_FILE_MAGIC)) == 0;
+}
+
+string encodeBinaryKey(const HillCipher& cipher) {
+    const size_t n = size_t(cipher.size());
+    string out;
+    out.reserve(KEY_FILE_HEADER_SIZE + 2 * n * n + 8);
+    out.append(reinterpret_cast<const char*>(KEY_FILE_MAGIC), sizeof(KEY_FILE_MAGIC));
+    out += char(KEY_FILE_VERSION);
+    out.append(3, '\0');
+    putLE(out, n, 4);
+    putLE(out, uint64_t(cipher.modulus()), 4);
+    for (const auto* matrix : { &cipher.key(), &cipher.inverse() }) {
+        for (const auto& row : *matrix) {
+            for (int value : row) out += char(value);
+        }
+    }
+    putLE(out, fnv1a(out.data(), out.size()), 8);
+    return out;
+}
+
+HillCipher decodeBinaryKey(const string& data, const Alphabet& alphabet) {
+    if (!isBinaryKey(data)) throw runtime_error("Not a binary key file");
+    if (data.size() < KEY_FILE_HEADER_SIZE + 8) throw runtime_error("Key file is truncated");
+    if (uint8_t(data[4]) != KEY_FILE_VERSION) throw runtime_error("Unsupported key file version " + to_string(uint8_t(data[4])));
+
+    const uint64_t n = getLE(data.data() + 8, 4);
+    const uint64_t modulus = getLE(data.data() + 12, 4);
+    if (n == 0 || n > 0xFFFF || KEY_FILE_HEADER_SIZE + 2 * n * n + 8 != data.size()) throw runtime_error("Key file is damaged");
+    const size_t checked = data.size() - 8;
+    if (fnv1a(data.data(), checked) != getLE(data.data() + checked, 8)) throw runtime_error("Key file checksum mismatch");
+    if (modulus != uint64_t(alphabet.size())) {
+        throw runtime_error("Key file is for an alphabet of " + to_string(modulus) + " symbols, the current one has " +
+            to_string(alphabet.size()));
+    }
+
+    const char* entries = data.data() + KEY_FILE_HEADER_SIZE;
+    auto readMatrix = [&] {
+        vector<vector<int>> matrix(n, vector<int>(n));
+        for (auto& row : matrix) {
+            for (int& value : row) {
+                value = uint8_t(*entries++);
+                if (uint64_t(value) >= modulus) throw runtime_error("Key file is damaged");
+            }
+        }
+        return matrix;
+    };
+    vector<vector<int>> key = readMatrix();
+    vector<vector<int>> inverse = readMatrix();
+    return HillCipher(move(key), move(inverse), alphabet);
+}
+
+string readKeyFile(const string& path) {
+    ProfileScope scope("read");
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file.is_open()) throw runtime_error("Cannot open file to read: " + path);
+    string data(size_t(file.tellg()), '\0');
+    file.seekg(0);
+    if (!file.read(data.data(), streamsize(data.size()))) throw runtime_error("Cannot read key file: " + path);
+    scope.add_bytes(data.size());
+    return data;
+}
+
+HillCipher keyFromData(const string& data, const Alphabet& alphabet) {
+    if (isBinaryKey(data)) return decodeBinaryKey(data, alphabet);
+    int n;
+    return HillCipher(parseKeyMatrix(data, n, alphabet), alphabet);
+}
+
+HillCipher loadKeyFile(const string& path, const Alphabet& alphabet) {
+    return keyFromData(readKeyFile(path), alphabet);
+}
+
+void saveBinaryKey(const string& path, const HillCipher& cipher) {
+    string data = encodeBinaryKey(cipher);
+    ofstream out(path, ios::binary);
+    if (!out.is_open() || !out.write(data.data(), streamsize(data.size()))) {
+        throw runtime_error("Cannot open file to write: " + path);
+    }
+}
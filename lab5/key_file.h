@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "hill_cipher.h"
+
+
+// Binary Hill key file, with the inverse matrix precomputed:
+//
+//   offset     size  field
+//        0        4  magic "HILK"
+//        4        1  version
+//        5        3  reserved
+//        8        4  matrix size N
+//       12        4  alphabet size (the modulus the inverse is for)
+//       16      N*N  key matrix, row-major, one byte per entry
+//   16+N*N      N*N  inverse key matrix
+//  16+2N*N        8  checksum: FNV-1a 64 of all the bytes before it
+//
+// All header integers are little-endian. The file is read with one read and
+// checked by the checksum only: the inverse is not recomputed (that is the
+// point of storing it), so a key file is trusted like the text one.
+
+const uint8_t KEY_FILE_MAGIC[4] = { 'H', 'I', 'L', 'K' };
+const uint8_t KEY_FILE_VERSION = 1;
+const size_t KEY_FILE_HEADER_SIZE = 16;
+
+bool isBinaryKey(const std::string& data);
+
+std::string encodeBinaryKey(const HillCipher& cipher);
+
+// Throws runtime_error if the data is damaged or is for an alphabet of another size
+HillCipher decodeBinaryKey(const std::string& data, const Alphabet& alphabet = lab_alphabet());
+
+// Whole key file in one read, as bytes (no newline translation)
+std::string readKeyFile(const std::string& path);
+
+// A key in either format: binary if it starts with the magic, the text matrix otherwise
+HillCipher keyFromData(const std::string& data, const Alphabet& alphabet = lab_alphabet());
+
+HillCipher loadKeyFile(const std::string& path, const Alphabet& alphabet = lab_alphabet());
+
+void saveBinaryKey(const std::string& path, const HillCipher& cipher);
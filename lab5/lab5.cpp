@@ -1,353 +1,374 @@
+#include <fstream>
 #include <iostream>
+#include <iomanip>
+#include <optional>
+#include <chrono>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
 #include "auxiliary.h"
+#include "hill_cipher.h"
+#include "key_file.h"
+#include "reference.h"
+#include "../common/arena.h"
+#include "../common/console_log.h"
+#include "../common/kernel_bench.h"
+#include "../common/profiler.h"
 
 using namespace std;
 
 #define OUTPUT_FILE_NAME "output.txt"
 #define KEY_FILE_NAME "key.txt"
 
-const string alphabet = "abcdefghijklmnopqrstuvwxyz .,;-'";
-const int ALPHABET_SIZE = alphabet.length();
-
-vector<vector<int>> parseKeyMatrix(const string& keyText, int& n);
-string encrypt(const string& text, const vector<vector<int>>& key);
-string decrypt(const string& text, const vector<vector<int>>& key);
-
-class HillCipher {
-private:
-    std::vector<std::vector<int>> keyMatrix;
-    std::vector<std::vector<int>> inverseKeyMatrix;
-    int matrixSize;
-    int modValue;
-
-    // Extended Euclidean algorithm for finding modular inverse
-    int modInverse(int a, int m) {
-        a = a % m;
-        for (int x = 1; x < m; x++) {
-            if ((a * x) % m == 1) {
-                return x;
-            }
-        }
-        throw std::runtime_error("Inverse element does not exist");
-    }
-
-    // Calculate matrix determinant
-    int determinant(const std::vector<std::vector<int>>& matrix, int n) {
-        if (n == 1) {
-            return matrix[0][0];
-        }
-        if (n == 2) {
-            return matrix[0][0] * matrix[1][1] - matrix[0][1] * matrix[1][0];
-        }
+string encrypt(const string& text, const HillCipher& cipher, unsigned threads);
+string decrypt(const string& text, const HillCipher& cipher, unsigned threads);
 
-        int det = 0;
-        for (int p = 0; p < n; p++) {
-            std::vector<std::vector<int>> submatrix(n - 1, std::vector<int>(n - 1));
-            for (int i = 1; i < n; i++) {
-                int col = 0;
-                for (int j = 0; j < n; j++) {
-                    if (j == p) continue;
-                    submatrix[i - 1][col] = matrix[i][j];
-                    col++;
-                }
-            }
-            det += (p % 2 == 0 ? 1 : -1) * matrix[0][p] * determinant(submatrix, n - 1);
-        }
-        return det;
+string encrypt(const string& text, const HillCipher& cipher, unsigned threads) {
+    try {
+        ProfileScope stage("block multiply", text.size());
+        JobArena arena(cipher.workspaceSize(text.size(), threads));
+        return cipher.encrypt(text, arena.get(), threads);
     }
-
-    // Matrix transposition
-    std::vector<std::vector<int>> transpose(const std::vector<std::vector<int>>& matrix) {
-        int n = matrix.size();
-        std::vector<std::vector<int>> result(n, std::vector<int>(n));
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < n; j++) {
-                result[j][i] = matrix[i][j];
-            }
-        }
-        return result;
+    catch (const exception& e) {
+        cerr << "Encryption error: " << e.what() << endl;
+        return text; // Return original text in case of error
     }
+}
 
-    // Calculate adjugate matrix
-    std::vector<std::vector<int>> adjugate(const std::vector<std::vector<int>>& matrix) {
-        int n = matrix.size();
-        std::vector<std::vector<int>> adj(n, std::vector<int>(n));
-
-        if (n == 1) {
-            adj[0][0] = 1;
-            return adj;
-        }
-
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < n; j++) {
-                std::vector<std::vector<int>> submatrix(n - 1, std::vector<int>(n - 1));
-                for (int x = 0; x < n; x++) {
-                    for (int y = 0; y < n; y++) {
-                        if (x != i && y != j) {
-                            int subX = x < i ? x : x - 1;
-                            int subY = y < j ? y : y - 1;
-                            submatrix[subX][subY] = matrix[x][y];
-                        }
-                    }
-                }
-                adj[j][i] = ((i + j) % 2 == 0 ? 1 : -1) * determinant(submatrix, n - 1);
-            }
-        }
-        return adj;
+string decrypt(const string& text, const HillCipher& cipher, unsigned threads) {
+    try {
+        ProfileScope stage("block multiply", text.size());
+        JobArena arena(cipher.workspaceSize(text.size(), threads));
+        return cipher.decrypt(text, arena.get(), threads);
     }
-
-    // Calculate inverse matrix modulo
-    void calculateInverseMatrix() {
-        int n = matrixSize;
-        int det = determinant(keyMatrix, n);
-        det = det % modValue;
-        if (det < 0) det += modValue;
-
-        // Check if determinant is coprime with modValue
-        if (det == 0 || gcd(det, modValue) != 1) {
-            throw std::runtime_error("Key matrix is not invertible for this alphabet");
-        }
-
-        int detInverse = modInverse(det, modValue);
-
-        std::vector<std::vector<int>> adj = adjugate(keyMatrix);
-
-        inverseKeyMatrix.resize(n, std::vector<int>(n));
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < n; j++) {
-                inverseKeyMatrix[i][j] = (adj[i][j] * detInverse) % modValue;
-                if (inverseKeyMatrix[i][j] < 0) {
-                    inverseKeyMatrix[i][j] += modValue;
-                }
-            }
-        }
+    catch (const exception& e) {
+        cerr << "Decryption error: " << e.what() << endl;
+        return text; // Return original text in case of error
     }
+}
 
-    // GCD for invertibility check
-    int gcd(int a, int b) {
-        while (b != 0) {
-            int temp = b;
-            b = a % b;
-            a = temp;
-        }
-        return a;
+// Bytes read at a time by --stream
+const size_t STREAM_CHUNK_BYTES = size_t(1) << 20;
+
+// The menu's encryption (decryption) of a file of any size, a piece at a
+// time (see HillStream): lowercased, transformed, uppercased and written to
+// OUTPUT_FILE_NAME. The text is not shown
+int runStream(const string& inputPath, const HillCipher& cipher, bool decrypting, unsigned threads) {
+    ifstream in(inputPath);
+    ofstream out(OUTPUT_FILE_NAME);
+    if (!in.is_open() || !out.is_open()) {
+        cerr << "Cannot open " << (in.is_open() ? OUTPUT_FILE_NAME : inputPath) << endl;
+        return 1;
     }
 
-    // Convert text to numerical vector (skip characters not in alphabet)
-    std::vector<int> textToVector(const std::string& text, std::vector<int>& validIndices) {
-        std::vector<int> result;
-        validIndices.clear();
-
-        for (size_t i = 0; i < text.length(); i++) {
-            char c = text[i];
-            size_t pos = alphabet.find(c);
-            if (pos != std::string::npos) {
-                result.push_back(static_cast<int>(pos));
-                validIndices.push_back(static_cast<int>(i));
-            }
-        }
-        return result;
+    ProfileScope scope(decrypting ? "decrypt stream" : "encrypt stream");
+    HillStream stream(cipher, decrypting, threads);
+    vector<char> buffer(STREAM_CHUNK_BYTES);
+    string piece;
+    size_t total = 0;
+    auto write = [&](string text) {
+        toUpperCase(text);
+        out << text;
+    };
+    // A character split by the read is lowercased with the next piece
+    while (in.read(buffer.data(), streamsize(buffer.size())) || in.gcount() > 0) {
+        piece.append(buffer.data(), size_t(in.gcount()));
+        total += size_t(in.gcount());
+        string complete = piece.substr(0, utf8_complete_length(piece));
+        piece.erase(0, complete.size());
+        toLowerCase(complete);
+        write(stream.update(complete));
     }
+    write(stream.update(piece));
+    write(stream.finalize());
+    scope.add_bytes(total);
+    if (!out) {
+        cerr << "Cannot write file: " << OUTPUT_FILE_NAME << endl;
+        return 1;
+    }
+    cout << (decrypting ? "Decrypted " : "Encrypted ") << total << " bytes to " OUTPUT_FILE_NAME << endl;
+    return 0;
+}
 
-    // Matrix-vector multiplication
-    std::vector<int> multiplyMatrixVector(const std::vector<std::vector<int>>& matrix,
-        const std::vector<int>& vector) {
-        int n = matrix.size();
-        std::vector<int> result(n, 0);
-        for (int i = 0; i < n; i++) {
-            for (int j = 0; j < n; j++) {
-                result[i] += matrix[i][j] * vector[j];
+// Encryption speed of a generated text on 1, 2, 4, ... threads up to maxThreads,
+// for table keys (N = 2, 3) and a multiplied one (N = 5); every result and
+// its decryption are checked against the one-thread ones; then the fast
+// and the constant-time lookups side by side. The keys have determinant 1,
+// so they are invertible for any alphabet
+int runBenchmark(unsigned maxThreads) {
+    const size_t SIZE = size_t(32) << 20;
+    const int REPEATS = 3;
+    const Alphabet& alphabet = lab_alphabet();
+
+    const string text = bench_text(alphabet, SIZE);
+
+    vector<unsigned> threadCounts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    const vector<vector<vector<int>>> keys = {
+        { { 1, 2 }, { 3, 7 } },
+        { { 2, 3, 1 }, { 1, 2, 1 }, { 1, 1, 1 } },
+        { { 1, 2, 3, 4, 5 }, { 0, 1, 2, 3, 4 }, { 0, 0, 1, 2, 3 }, { 0, 0, 0, 1, 2 }, { 1, 0, 0, 0, 1 } },
+    };
+    cout << "=== Hill cipher thread scaling (" << text.size() / (1 << 20) << " MB, " << lab_alphabet_name()
+         << " alphabet, " << thread::hardware_concurrency() << " cores) ===" << endl;
+    for (const auto& key : keys) {
+        HillCipher cipher(key);
+        string expected = cipher.encrypt(text);
+        string expectedDecrypted = cipher.decrypt(expected);
+        double oneThread = 0;
+        for (unsigned threads : threadCounts) {
+            double seconds = 1e9;
+            string encrypted;
+            for (int r = 0; r < REPEATS; r++) {
+                JobArena arena(cipher.workspaceSize(text.size(), threads));
+                auto start = chrono::steady_clock::now();
+                encrypted = cipher.encrypt(text, arena.get(), threads);
+                seconds = min(seconds, chrono::duration<double>(chrono::steady_clock::now() - start).count());
             }
-            result[i] = result[i] % modValue;
-            if (result[i] < 0) result[i] += modValue;
+            bool ok = encrypted == expected && cipher.decrypt(encrypted, std::pmr::get_default_resource(), threads) == expectedDecrypted;
+            if (threads == 1) oneThread = seconds;
+            cout << fixed << setprecision(1) << "N=" << key.size() << setw(4) << threads << " thread(s): "
+                 << setw(7) << double(text.size()) / seconds / 1e6 << " MB/s, x" << setprecision(2) << oneThread / seconds
+                 << (ok ? "" : "  [MISMATCH]") << endl;
+            if (!ok) return 1;
         }
-        return result;
     }
 
-public:
-    HillCipher(const std::vector<std::vector<int>>& key, int mod = ALPHABET_SIZE)
-        : keyMatrix(key), matrixSize(key.size()), modValue(mod) {
-        calculateInverseMatrix();
+    // The constant-time lookups (LAB_CONSTANT_TIME) multiply every block, table keys too
+    cout << "=== Hill cipher lookups (1 thread) ===" << endl;
+    bool ok = true;
+    for (const auto& key : keys) {
+        HillCipher cipher(key);
+        ok = bench_lookups("N=" + to_string(key.size()) + " encrypt", text.size(),
+            [&](auto lookup) { return cipher.encrypt<lookup>(text); }) && ok;
     }
+    return ok ? 0 : 1;
+}
 
-    // Encryption with preservation of non-alphabet characters
-    std::string encrypt(const std::string& plaintext) {
-        std::vector<int> validIndices;
-        std::vector<int> textVector = textToVector(plaintext, validIndices);
+// Matrix as text, for comparing inverses
+string matrixText(const vector<vector<int>>& matrix) {
+    ostringstream out;
+    for (const auto& row : matrix) {
+        for (int val : row) out << val << ' ';
+        out << '\n';
+    }
+    return out.str();
+}
 
-        // If no characters to encrypt
-        if (textVector.empty()) {
-            return plaintext;
+// Keys of 1 x 1 to 6 x 6 over random alphabets, half of them random (often
+// not invertible) and half with determinant 1 (lower times upper unit
+// triangular); inverses, both lookups, several threads and the binary and
+// text key files against ReferenceHill (see differential.h)
+int runFuzz(int cases, uint64_t seed, const string& recordPath) {
+    FuzzRun run("lab5", cases, seed);
+
+    struct Case {
+        Alphabet alphabet;
+        vector<vector<int>> key;
+        string text;
+        unsigned threads = 1;
+    };
+    auto makeCase = [](FuzzRandom& rng, string& what) {
+        Case c{ fuzz_alphabet(rng), {}, {} };
+        const int n = 1 + int(rng() % 6);
+        auto entry = [&] { return int(rng() % 201) - 100; };
+        c.key.assign(n, vector<int>(n));
+        if (rng() % 2) {
+            for (auto& row : c.key) {
+                for (int& val : row) val = entry();
+            }
         }
-
-        // Add padding if needed
-        size_t originalSize = textVector.size();
-        while (textVector.size() % matrixSize != 0) {
-            textVector.push_back(0); // 'a' as padding
+        else {
+            vector<vector<int>> lower(n, vector<int>(n, 0)), upper(n, vector<int>(n, 0));
+            for (int i = 0; i < n; i++) {
+                lower[i][i] = upper[i][i] = 1;
+                for (int j = 0; j < i; j++) lower[i][j] = entry(), upper[j][i] = entry();
+            }
+            for (int i = 0; i < n; i++) {
+                for (int j = 0; j < n; j++) {
+                    for (int k = 0; k < n; k++) c.key[i][j] += lower[i][k] * upper[k][j];
+                }
+            }
         }
-
-        std::vector<int> encryptedVector;
-
-        for (size_t i = 0; i < textVector.size(); i += matrixSize) {
-            std::vector<int> block(textVector.begin() + i,
-                textVector.begin() + i + matrixSize);
-            std::vector<int> encryptedBlock = multiplyMatrixVector(keyMatrix, block);
-            encryptedVector.insert(encryptedVector.end(),
-                encryptedBlock.begin(), encryptedBlock.end());
+        // Now and then a text long enough to be cut into parts
+        if (rng() % 32 == 0) {
+            c.text = fuzz_text(rng, c.alphabet, 250000);
+            c.threads = 2 + unsigned(rng() % 3);
         }
-
-        // Remove padding from encrypted vector
-        if (encryptedVector.size() > originalSize) {
-            encryptedVector.resize(originalSize);
+        else {
+            c.text = fuzz_text(rng, c.alphabet, 300);
         }
-
-        // Reconstruct text with position preservation
-        std::string result = plaintext;
-        size_t encryptedIndex = 0;
-
-        for (size_t i = 0; i < validIndices.size() && encryptedIndex < encryptedVector.size(); i++) {
-            if (encryptedIndex < encryptedVector.size()) {
-                size_t pos = static_cast<size_t>(validIndices[i]);
-                if (pos < result.length()) {
-                    result[pos] = alphabet[encryptedVector[encryptedIndex]];
-                    encryptedIndex++;
-                }
+        what = "N=" + to_string(n) + ", " + to_string(c.threads) + " thread(s), alphabet \"" + c.alphabet.str() + "\", key\n" + matrixText(c.key);
+        return c;
+    };
+
+    run.check("inverse", [&](FuzzRandom& rng, string& what) {
+        Case c = makeCase(rng, what);
+        return make_pair(fuzz_outcome([&] { return matrixText(ReferenceHill(c.key, c.alphabet).inverse()); }),
+            fuzz_outcome([&] { return matrixText(HillCipher(c.key, c.alphabet).inverse()); }));
+    });
+    // Runs fn(reference, cipher) on the invertible keys
+    auto invertibleCase = [&](auto fn) {
+        return [&, fn](FuzzRandom& rng, string& what) {
+            Case c = makeCase(rng, what);
+            try {
+                ReferenceHill reference(c.key, c.alphabet);
+                HillCipher cipher(c.key, c.alphabet);
+                return fn(c, reference, cipher);
+            }
+            catch (const exception&) {
+                return make_pair(FUZZ_THROWS, FUZZ_THROWS);
+            }
+        };
+    };
+    auto lookupCases = [&](auto lookup, const string& suffix) {
+        run.check("encrypt" + suffix, invertibleCase([lookup](const Case& c, const ReferenceHill& reference, const HillCipher& cipher) {
+            return make_pair(reference.encrypt(c.text), cipher.encrypt<lookup>(c.text, std::pmr::get_default_resource(), c.threads));
+        }));
+        run.check("decrypt" + suffix, invertibleCase([lookup](const Case& c, const ReferenceHill& reference, const HillCipher& cipher) {
+            return make_pair(reference.decrypt(c.text), cipher.decrypt<lookup>(c.text, std::pmr::get_default_resource(), c.threads));
+        }));
+    };
+    lookupCases(integral_constant<Lookup, Lookup::Fast>(), "");
+    lookupCases(integral_constant<Lookup, Lookup::ConstantTime>(), ", constant-time");
+    // The text cut into random pieces, some inside a character
+    run.check("stream", invertibleCase([](const Case& c, const ReferenceHill& reference, const HillCipher& cipher) {
+        FuzzRandom cuts(c.text.size());
+        string expected, actual;
+        for (bool decrypting : { false, true }) {
+            expected += decrypting ? reference.decrypt(c.text) : reference.encrypt(c.text);
+            HillStream stream(cipher, decrypting, c.threads);
+            for (size_t at = 0; at < c.text.size();) {
+                size_t length = min<size_t>(c.text.size() - at, cuts() % (cuts() % 4 == 0 ? 200000 : 20));
+                actual += stream.update(string_view(c.text).substr(at, length));
+                at += length;
             }
+            actual += stream.finalize();
         }
-
-        return result;
+        return make_pair(expected, actual);
+    }));
+    run.check("binary key file", invertibleCase([](const Case& c, const ReferenceHill& reference, const HillCipher& cipher) {
+        HillCipher loaded = decodeBinaryKey(encodeBinaryKey(cipher), c.alphabet);
+        return make_pair(reference.encrypt(c.text) + reference.decrypt(c.text), loaded.encrypt(c.text) + loaded.decrypt(c.text));
+    }));
+    // The key as text, entries outside [0, S) included: reduced modulo the case's alphabet
+    run.check("text key file", invertibleCase([](const Case& c, const ReferenceHill& reference, const HillCipher&) {
+        HillCipher loaded = keyFromData(matrixText(c.key), c.alphabet);
+        return make_pair(reference.encrypt(c.text) + reference.decrypt(c.text), loaded.encrypt(c.text) + loaded.decrypt(c.text));
+    }));
+    // The baseline: the key as text, up to 4 x 4, the latin alphabet and text lowercased as its main did
+    run.check("baseline HillCipher", [&](FuzzRandom& rng, string& what) {
+        const int n = 1 + int(rng() % 4);
+        vector<vector<int>> key(n, vector<int>(n));
+        for (auto& row : key) {
+            for (int& val : row) val = int(rng() % 201) - 100;
+        }
+        const string keyText = matrixText(key);
+        string text = fuzz_ascii(rng, 300);
+        baseline::toLowerCase(text);
+        what = "N=" + to_string(n) + ", key\n" + keyText;
+        return make_pair(
+            fuzz_outcome([&] {
+                int size;
+                baseline::HillCipher cipher(baseline::parseKeyMatrix(keyText, size));
+                return cipher.encrypt(text) + cipher.decrypt(text);
+            }),
+            fuzz_outcome([&] {
+                HillCipher cipher = keyFromData(keyText, LATIN_ALPHABET);
+                return cipher.encrypt(text) + cipher.decrypt(text);
+            }));
+    });
+
+    const string text = bench_text(lab_alphabet(), size_t(1) << 20);
+    const vector<vector<vector<int>>> keys = {
+        { { 2, 3, 1 }, { 1, 2, 1 }, { 1, 1, 1 } },
+        { { 1, 2, 3, 4, 5 }, { 0, 1, 2, 3, 4 }, { 0, 0, 1, 2, 3 }, { 0, 0, 0, 1, 2 }, { 1, 0, 0, 0, 1 } },
+    };
+    string sink;
+    for (const auto& key : keys) {
+        ReferenceHill reference(key, lab_alphabet());
+        HillCipher cipher(key);
+        run.measure("N=" + to_string(key.size()) + " encrypt", text.size(), [&] { sink = reference.encrypt(text); },
+            [&] { sink = cipher.encrypt(text); });
     }
+    return run.finish(recordPath);
+}
 
-    // Decryption with preservation of non-alphabet characters
-    std::string decrypt(const std::string& ciphertext) {
-        std::vector<int> validIndices;
-        std::vector<int> textVector = textToVector(ciphertext, validIndices);
-
-        // If no characters to decrypt
-        if (textVector.empty()) {
-            return ciphertext;
+int main(int argc, char* argv[])
+{
+    profiler_init();
+    console_init();
+
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    bool benchmark = false;
+    int fuzzCases = 0;
+    uint64_t fuzzSeed = fuzz_seed();
+    string recordPath;
+    string keyPath = KEY_FILE_NAME;
+    string streamPath;
+    bool decrypting = false;
+    string saveKeyPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--threads" && i + 1 < argc) {
+            threads = max(1u, unsigned(stoul(argv[++i])));
         }
-
-        // Add padding if needed for decryption
-        size_t originalSize = textVector.size();
-        while (textVector.size() % matrixSize != 0) {
-            textVector.push_back(0); // 'a' as padding
+        else if (arg == "--bench") {
+            benchmark = true;
         }
-
-        std::vector<int> decryptedVector;
-
-        for (size_t i = 0; i < textVector.size(); i += matrixSize) {
-            std::vector<int> block(textVector.begin() + i,
-                textVector.begin() + i + matrixSize);
-            std::vector<int> decryptedBlock = multiplyMatrixVector(inverseKeyMatrix, block);
-            decryptedVector.insert(decryptedVector.end(),
-                decryptedBlock.begin(), decryptedBlock.end());
+        else if (arg == "--fuzz" && i + 1 < argc) {
+            fuzzCases = stoi(argv[++i]);
         }
-
-        // Remove padding from decrypted vector
-        if (decryptedVector.size() > originalSize) {
-            decryptedVector.resize(originalSize);
+        else if (arg == "--seed" && i + 1 < argc) {
+            fuzzSeed = stoull(argv[++i]);
         }
-
-        // Reconstruct text with position preservation
-        std::string result = ciphertext;
-        size_t decryptedIndex = 0;
-
-        for (size_t i = 0; i < validIndices.size() && decryptedIndex < decryptedVector.size(); i++) {
-            if (decryptedIndex < decryptedVector.size()) {
-                size_t pos = static_cast<size_t>(validIndices[i]);
-                if (pos < result.length()) {
-                    result[pos] = alphabet[decryptedVector[decryptedIndex]];
-                    decryptedIndex++;
-                }
-            }
+        else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
         }
-
-        return result;
-    }
-};
-
-// Function to normalize key matrix (mod ALPHABET_SIZE)
-vector<vector<int>> normalizeKeyMatrix(const vector<vector<int>>& keyMatrix) {
-    vector<vector<int>> normalized = keyMatrix;
-    for (auto& row : normalized) {
-        for (auto& val : row) {
-            val = val % ALPHABET_SIZE;
-            if (val < 0) val += ALPHABET_SIZE;
+        else if (arg == "--stream" && i + 1 < argc) {
+            streamPath = argv[++i];
         }
-    }
-    return normalized;
-}
-
-vector<vector<int>> parseKeyMatrix(const string& keyText, int& n) {
-    vector<vector<int>> keyMatrix;
-    stringstream ss(keyText);
-    string line;
-    int rowCount = 0;
-    int expectedCols = -1;
-
-    while (getline(ss, line)) {
-        if (line.empty()) continue;
-        stringstream lineStream(line);
-        vector<int> row;
-        string token;
-
-        while (lineStream >> token) {
-            try {
-                int value = stoi(token);
-                row.push_back(value);
-            }
-            catch (...) {
-                throw runtime_error("Invalid value in key matrix: '" + token + "'");
-            }
+        else if (arg == "--decrypt") {
+            decrypting = true;
+        }
+        else if (arg == "--key" && i + 1 < argc) {
+            keyPath = argv[++i];
+        }
+        else if (arg == "--save-key" && i + 1 < argc) {
+            saveKeyPath = argv[++i];
+        }
+        else {
+            cerr << "Usage: lab5 [--threads N] [--bench] [--key PATH] [--save-key PATH] [--stream INPUT [--decrypt]]" << endl;
+            cerr << "  --key PATH       key matrix file, text or binary (default " KEY_FILE_NAME ")" << endl;
+            cerr << "  --save-key PATH  also save the key with its inverse as a binary key file" << endl;
+            cerr << "  --stream INPUT [--decrypt]  encrypt (decrypt) a file of any size in pieces, no menu" << endl;
+            cerr << "  --fuzz CASES [--seed N] [--record CSV]  kernels against the reference implementation" << endl;
+            return 1;
         }
-
-        if (expectedCols == -1) expectedCols = row.size();
-        else if (row.size() != expectedCols)
-            throw runtime_error("Non-square key matrix: inconsistent number of columns");
-
-        keyMatrix.push_back(row);
-        rowCount++;
-    }
-
-    if (rowCount != expectedCols)
-        throw runtime_error("Non-square key matrix: number of rows != number of columns");
-
-    n = rowCount;
-
-    // Normalize key matrix
-    return normalizeKeyMatrix(keyMatrix);
-}
-
-string encrypt(const string& text, const vector<vector<int>>& key) {
-    try {
-        HillCipher cipher(key, ALPHABET_SIZE);
-        return cipher.encrypt(text);
     }
-    catch (const exception& e) {
-        cerr << "Encryption error: " << e.what() << endl;
-        return text; // Return original text in case of error
+    if (benchmark) {
+        return runBenchmark(threads);
     }
-}
-
-string decrypt(const string& text, const vector<vector<int>>& key) {
-    try {
-        HillCipher cipher(key, ALPHABET_SIZE);
-        return cipher.decrypt(text);
+    if (fuzzCases > 0) {
+        return runFuzz(fuzzCases, fuzzSeed, recordPath);
     }
-    catch (const exception& e) {
-        cerr << "Decryption error: " << e.what() << endl;
-        return text; // Return original text in case of error
+    if (!streamPath.empty()) {
+        optional<HillCipher> cipher;
+        try {
+            cipher.emplace(loadKeyFile(keyPath));
+        }
+        catch (const exception& e) {
+            cerr << "Error loading key file: " << e.what() << endl;
+            return 1;
+        }
+        return runStream(streamPath, *cipher, decrypting, threads);
     }
-}
 
-int main()
-{
     int n;
     int choice;
 
@@ -355,14 +376,21 @@ int main()
 
     // --- --- --- KEY MATRIX --- --- ---
     cout << "--- Key matrix ---" << endl;
-    cout << "Getting key from file '" << KEY_FILE_NAME << "'...\n" << endl;
+    cout << "Getting key from file '" << keyPath << "'...\n" << endl;
 
-    // Check if the key file is empty
-    string keyText = readFileContent(KEY_FILE_NAME);
+    // Check if the key file is empty (read once, as bytes: it may be a binary key)
+    string keyText;
+    try {
+        keyText = readKeyFile(keyPath);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
 
     if (keyText == "") {
         // If the key file is empty, fill it
-        cout << "Key file '" << KEY_FILE_NAME << "' is empty!\n" << endl;
+        cout << "Key file '" << keyPath << "' is empty!\n" << endl;
 
         cout << "Enter the Matrix key size N: ";
         cin >> n;
@@ -378,7 +406,7 @@ int main()
             int r;
             for (int i = 0; i < n; i++) {
                 for (int j = 0; j < n; j++) {
-                    r = rand() % ALPHABET_SIZE;
+                    r = rand() % lab_alphabet().size();
                     keyText += to_string(r) + "\t";
                 }
                 keyText += "\n";
@@ -404,42 +432,76 @@ int main()
             return 1;
         }
 
-        writeFileContent(KEY_FILE_NAME, keyText);
-        cout << "Key matrix saved to file '" << KEY_FILE_NAME << "'." << endl << endl;
+        writeFileContent(keyPath, keyText);
+        cout << "Key matrix saved to file '" << keyPath << "'." << endl << endl;
+    }
+
+    // A binary key has its inverse stored; a text one is parsed and inverted.
+    // The cipher is set up once for the whole run
+    optional<HillCipher> cipher;
+    if (isBinaryKey(keyText)) {
+        try {
+            ProfileScope scope("key load", keyText.size());
+            cipher.emplace(decodeBinaryKey(keyText));
+        }
+        catch (const exception& e) {
+            cerr << "Error loading key file: " << e.what() << endl;
+            return 1;
+        }
+        cout << keyPath << ": binary key, " << cipher->size() << "x" << cipher->size() << " with its inverse" << endl;
     }
+    else {
+        // Display key matrix
+        console_text(keyPath + ":\n", keyText);
 
-    // Display key matrix
-    cout << KEY_FILE_NAME << ":\n" << keyText << endl;
+        // Parse key matrix
+        vector<vector<int>> keyMatrix;
 
-    // Parse key matrix
-    vector<vector<int>> keyMatrix;
+        try {
+            ProfileScope scope("key parse", keyText.size());
+            keyMatrix = parseKeyMatrix(keyText, n);
+        }
+        catch (const runtime_error& e) {
+            console_flush();
+            cerr << "Error parsing key matrix: " << e.what() << endl;
+            return 1;
+        }
 
-    try {
-        keyMatrix = parseKeyMatrix(keyText, n);
-    }
-    catch (const runtime_error& e) {
-        cerr << "Error parsing key matrix: " << e.what() << endl;
-        return 1;
-    }
+        // Display parsed matrix
+        string parsed;
+        for (auto& row : keyMatrix) {
+            for (auto val : row) {
+                parsed += to_string(val) + "\t";
+            }
+            parsed += "\n";
+        }
+        console_text("Parsed key matrix:\n", parsed);
 
-    // Display parsed matrix
-    cout << "Parsed key matrix:" << endl;
-    for (auto& row : keyMatrix) {
-        for (auto val : row) {
-            cout << val << "\t";
+        // Check invertibility
+        try {
+            ProfileScope scope("inverse");
+            cipher.emplace(keyMatrix);
+        }
+        catch (const exception& e) {
+            console_flush();
+            cerr << "\nKey matrix error: " << e.what() << endl;
+            return 1;
         }
-        cout << endl;
     }
 
-	// Check invertibility
-    try {
-        HillCipher testCipher(keyMatrix, ALPHABET_SIZE);
+    if (!saveKeyPath.empty()) {
+        try {
+            saveBinaryKey(saveKeyPath, *cipher);
+        }
+        catch (const exception& e) {
+            console_flush();
+            cerr << "Error saving key file: " << e.what() << endl;
+            return 1;
+        }
+        console_write("Binary key saved to file '" + saveKeyPath + "'.\n");
     }
-    catch (const exception& e) {
-        cerr << "\nKey matrix error: " << e.what() << endl;
-        return 1;
-	}
 
+    console_flush();
     cout << "--- --- ------ ---\n" << endl;
 
     // --- --- --- CIPHER --- --- ---
@@ -460,15 +522,16 @@ int main()
 
         string plaintext = readFileContent(plaintextPath);
 
-        cout << "\nPlaintext read from file:\n" << plaintext << endl << endl;
+        console_text("\nPlaintext read from file:\n", plaintext);
+        console_write("\n");
 
         toLowerCase(plaintext);
 
         // Encrypt
-        string encrypted = encrypt(plaintext, keyMatrix);
+        string encrypted = encrypt(plaintext, *cipher, threads);
         toUpperCase(encrypted);
 
-        cout << "\nEncrypted text: \n" << encrypted << endl;
+        console_text("\nEncrypted text: \n", encrypted);
 
         // Save result
         writeFileContent(OUTPUT_FILE_NAME, encrypted);
@@ -483,15 +546,16 @@ int main()
 
         string ciphertext = readFileContent(ciphertextPath);
 
-        cout << "\nCiphertext read from file:\n" << ciphertext << endl << endl;
+        console_text("\nCiphertext read from file:\n", ciphertext);
+        console_write("\n");
 
         toLowerCase(ciphertext);
 
         // Decrypt
-        string decrypted = decrypt(ciphertext, keyMatrix);
+        string decrypted = decrypt(ciphertext, *cipher, threads);
         toUpperCase(decrypted);
 
-        cout << "\nDecrypted text: \n" << decrypted << endl;
+        console_text("\nDecrypted text: \n", decrypted);
 
         // Save result
         writeFileContent(OUTPUT_FILE_NAME, decrypted);
@@ -500,7 +564,7 @@ int main()
         cerr << "Invalid option!" << endl;
         return 1;
     }
-    cout << "--- ------- ---" << endl;
+    console_write("--- ------- ---\n");
 
     return 0;
 }
\ No newline at end of file
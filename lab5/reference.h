@@ -0,0 +1,457 @@
+#pragma once
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../common/alphabet.h"
+#include "../common/differential.h"
+
+
+// Reference Hill cipher, the oracle of --fuzz for UTF-8 text, any alphabet
+// and keys past 4 x 4 (see baseline below for the rest): the inverse by the adjugate
+// (cofactor determinants, O(N!)), every block multiplied on its own, every
+// symbol found by a linear search. Past 6 x 6 keys the cofactors get too
+// slow to fuzz.
+class ReferenceHill {
+private:
+    std::vector<std::vector<int>> keyMatrix;
+    std::vector<std::vector<int>> inverseKeyMatrix;
+    const Alphabet* alphabet;
+    int matrixSize;
+    int modValue;
+
+    int mod(long long value) const {
+        return int((value % modValue + modValue) % modValue);
+    }
+
+    // Matrix without row and column
+    static std::vector<std::vector<int>> minor(const std::vector<std::vector<int>>& matrix, int row, int column) {
+        std::vector<std::vector<int>> result;
+        for (int i = 0; i < int(matrix.size()); i++) {
+            if (i == row) continue;
+            result.emplace_back();
+            for (int j = 0; j < int(matrix.size()); j++) {
+                if (j != column) result.back().push_back(matrix[i][j]);
+            }
+        }
+        return result;
+    }
+
+    // Determinant modulo modValue, by cofactor expansion along the first row
+    int determinant(const std::vector<std::vector<int>>& matrix) const {
+        const int n = int(matrix.size());
+        if (n == 0) return 1;
+        if (n == 1) return mod(matrix[0][0]);
+
+        long long det = 0;
+        for (int p = 0; p < n; p++) {
+            det += (p % 2 == 0 ? 1 : -1) * matrix[0][p] * determinant(minor(matrix, 0, p));
+            det = mod(det);
+        }
+        return int(det);
+    }
+
+    static int gcd(int a, int b) {
+        while (b != 0) {
+            int temp = b;
+            b = a % b;
+            a = temp;
+        }
+        return a;
+    }
+
+    // Inverse = adjugate / determinant (mod modValue)
+    void calculateInverseMatrix() {
+        const int n = matrixSize;
+        int det = determinant(keyMatrix);
+        if (gcd(det, modValue) != 1) {
+            throw std::runtime_error("Key matrix is not invertible for this alphabet");
+        }
+        int detInverse = 1;
+        while (detInverse * det % modValue != 1) detInverse++;
+
+        inverseKeyMatrix.assign(n, std::vector<int>(n));
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                int cofactor = ((i + j) % 2 == 0 ? 1 : -1) * determinant(minor(keyMatrix, i, j));
+                inverseKeyMatrix[j][i] = mod((long long)cofactor * detInverse);
+            }
+        }
+    }
+
+    // Symbols padded with 0 to whole blocks, each block multiplied by matrix,
+    // written back in place of the symbols (the padding is dropped)
+    std::string transform(const std::string& text, const std::vector<std::vector<int>>& matrix) const {
+        std::vector<int> symbols;
+        reference_characters(text, [&](char32_t c, std::string_view) {
+            int pos = reference_index(*alphabet, c);
+            if (pos >= 0) symbols.push_back(pos);
+        });
+        while (symbols.size() % matrixSize != 0) symbols.push_back(0);
+
+        std::vector<int> processed;
+        for (size_t b = 0; b < symbols.size(); b += matrixSize) {
+            for (int i = 0; i < matrixSize; i++) {
+                long long sum = 0;
+                for (int j = 0; j < matrixSize; j++) sum += matrix[i][j] * symbols[b + j];
+                processed.push_back(mod(sum));
+            }
+        }
+
+        std::string result;
+        size_t next = 0;
+        reference_characters(text, [&](char32_t c, std::string_view bytes) {
+            if (reference_index(*alphabet, c) >= 0) reference_append(result, alphabet->symbol(processed[next++]));
+            else result += bytes;
+        });
+        return result;
+    }
+
+public:
+    // Entries of key are taken modulo the alphabet size; throws if it is not invertible
+    ReferenceHill(const std::vector<std::vector<int>>& key, const Alphabet& cipherAlphabet)
+        : keyMatrix(key), alphabet(&cipherAlphabet), matrixSize(int(key.size())), modValue(cipherAlphabet.size()) {
+        for (auto& row : keyMatrix) {
+            for (auto& val : row) val = mod(val);
+        }
+        calculateInverseMatrix();
+    }
+
+    const std::vector<std::vector<int>>& inverse() const { return inverseKeyMatrix; }
+
+    std::string encrypt(const std::string& plaintext) const { return transform(plaintext, keyMatrix); }
+    std::string decrypt(const std::string& ciphertext) const { return transform(ciphertext, inverseKeyMatrix); }
+};
+
+
+// HillCipher, the key parsing of the baseline lab5 and the lowercasing its
+// main did on the text, copied as they were (only made inline, and the
+// column count compared as int, as the compiler warned), the oracle
+// of --fuzz for the latin alphabet and ASCII text. Its padding with 'a' to
+// whole blocks, cut off again after the multiplication, is kept as it was.
+// The lab now differs from them on purpose in these cases only:
+//  - keys past 4 x 4: the baseline determinant, taken modulo the alphabet
+//    size only at the end, overflowed int; the lab reduces it all the way
+//    (the check stays at 4 x 4)
+//  - characters past ASCII: the baseline copied single bytes, the text is
+//    now read as UTF-8 (left to ReferenceHill)
+namespace baseline {
+using namespace std;
+
+const string alphabet = "abcdefghijklmnopqrstuvwxyz .,;-'";
+const int ALPHABET_SIZE = alphabet.length();
+
+class HillCipher {
+private:
+    std::vector<std::vector<int>> keyMatrix;
+    std::vector<std::vector<int>> inverseKeyMatrix;
+    int matrixSize;
+    int modValue;
+
+    // Extended Euclidean algorithm for finding modular inverse
+    int modInverse(int a, int m) {
+        a = a % m;
+        for (int x = 1; x < m; x++) {
+            if ((a * x) % m == 1) {
+                return x;
+            }
+        }
+        throw std::runtime_error("Inverse element does not exist");
+    }
+
+    // Calculate matrix determinant
+    int determinant(const std::vector<std::vector<int>>& matrix, int n) {
+        if (n == 1) {
+            return matrix[0][0];
+        }
+        if (n == 2) {
+            return matrix[0][0] * matrix[1][1] - matrix[0][1] * matrix[1][0];
+        }
+
+        int det = 0;
+        for (int p = 0; p < n; p++) {
+            std::vector<std::vector<int>> submatrix(n - 1, std::vector<int>(n - 1));
+            for (int i = 1; i < n; i++) {
+                int col = 0;
+                for (int j = 0; j < n; j++) {
+                    if (j == p) continue;
+                    submatrix[i - 1][col] = matrix[i][j];
+                    col++;
+                }
+            }
+            det += (p % 2 == 0 ? 1 : -1) * matrix[0][p] * determinant(submatrix, n - 1);
+        }
+        return det;
+    }
+
+    // Matrix transposition
+    std::vector<std::vector<int>> transpose(const std::vector<std::vector<int>>& matrix) {
+        int n = matrix.size();
+        std::vector<std::vector<int>> result(n, std::vector<int>(n));
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                result[j][i] = matrix[i][j];
+            }
+        }
+        return result;
+    }
+
+    // Calculate adjugate matrix
+    std::vector<std::vector<int>> adjugate(const std::vector<std::vector<int>>& matrix) {
+        int n = matrix.size();
+        std::vector<std::vector<int>> adj(n, std::vector<int>(n));
+
+        if (n == 1) {
+            adj[0][0] = 1;
+            return adj;
+        }
+
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                std::vector<std::vector<int>> submatrix(n - 1, std::vector<int>(n - 1));
+                for (int x = 0; x < n; x++) {
+                    for (int y = 0; y < n; y++) {
+                        if (x != i && y != j) {
+                            int subX = x < i ? x : x - 1;
+                            int subY = y < j ? y : y - 1;
+                            submatrix[subX][subY] = matrix[x][y];
+                        }
+                    }
+                }
+                adj[j][i] = ((i + j) % 2 == 0 ? 1 : -1) * determinant(submatrix, n - 1);
+            }
+        }
+        return adj;
+    }
+
+    // Calculate inverse matrix modulo
+    void calculateInverseMatrix() {
+        int n = matrixSize;
+        int det = determinant(keyMatrix, n);
+        det = det % modValue;
+        if (det < 0) det += modValue;
+
+        // Check if determinant is coprime with modValue
+        if (det == 0 || gcd(det, modValue) != 1) {
+            throw std::runtime_error("Key matrix is not invertible for this alphabet");
+        }
+
+        int detInverse = modInverse(det, modValue);
+
+        std::vector<std::vector<int>> adj = adjugate(keyMatrix);
+
+        inverseKeyMatrix.resize(n, std::vector<int>(n));
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                inverseKeyMatrix[i][j] = (adj[i][j] * detInverse) % modValue;
+                if (inverseKeyMatrix[i][j] < 0) {
+                    inverseKeyMatrix[i][j] += modValue;
+                }
+            }
+        }
+    }
+
+    // GCD for invertibility check
+    int gcd(int a, int b) {
+        while (b != 0) {
+            int temp = b;
+            b = a % b;
+            a = temp;
+        }
+        return a;
+    }
+
+    // Convert text to numerical vector (skip characters not in alphabet)
+    std::vector<int> textToVector(const std::string& text, std::vector<int>& validIndices) {
+        std::vector<int> result;
+        validIndices.clear();
+
+        for (size_t i = 0; i < text.length(); i++) {
+            char c = text[i];
+            size_t pos = alphabet.find(c);
+            if (pos != std::string::npos) {
+                result.push_back(static_cast<int>(pos));
+                validIndices.push_back(static_cast<int>(i));
+            }
+        }
+        return result;
+    }
+
+    // Matrix-vector multiplication
+    std::vector<int> multiplyMatrixVector(const std::vector<std::vector<int>>& matrix,
+        const std::vector<int>& vector) {
+        int n = matrix.size();
+        std::vector<int> result(n, 0);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                result[i] += matrix[i][j] * vector[j];
+            }
+            result[i] = result[i] % modValue;
+            if (result[i] < 0) result[i] += modValue;
+        }
+        return result;
+    }
+
+public:
+    HillCipher(const std::vector<std::vector<int>>& key, int mod = ALPHABET_SIZE)
+        : keyMatrix(key), matrixSize(key.size()), modValue(mod) {
+        calculateInverseMatrix();
+    }
+
+    // Encryption with preservation of non-alphabet characters
+    std::string encrypt(const std::string& plaintext) {
+        std::vector<int> validIndices;
+        std::vector<int> textVector = textToVector(plaintext, validIndices);
+
+        // If no characters to encrypt
+        if (textVector.empty()) {
+            return plaintext;
+        }
+
+        // Add padding if needed
+        size_t originalSize = textVector.size();
+        while (textVector.size() % matrixSize != 0) {
+            textVector.push_back(0); // 'a' as padding
+        }
+
+        std::vector<int> encryptedVector;
+
+        for (size_t i = 0; i < textVector.size(); i += matrixSize) {
+            std::vector<int> block(textVector.begin() + i,
+                textVector.begin() + i + matrixSize);
+            std::vector<int> encryptedBlock = multiplyMatrixVector(keyMatrix, block);
+            encryptedVector.insert(encryptedVector.end(),
+                encryptedBlock.begin(), encryptedBlock.end());
+        }
+
+        // Remove padding from encrypted vector
+        if (encryptedVector.size() > originalSize) {
+            encryptedVector.resize(originalSize);
+        }
+
+        // Reconstruct text with position preservation
+        std::string result = plaintext;
+        size_t encryptedIndex = 0;
+
+        for (size_t i = 0; i < validIndices.size() && encryptedIndex < encryptedVector.size(); i++) {
+            if (encryptedIndex < encryptedVector.size()) {
+                size_t pos = static_cast<size_t>(validIndices[i]);
+                if (pos < result.length()) {
+                    result[pos] = alphabet[encryptedVector[encryptedIndex]];
+                    encryptedIndex++;
+                }
+            }
+        }
+
+        return result;
+    }
+
+    // Decryption with preservation of non-alphabet characters
+    std::string decrypt(const std::string& ciphertext) {
+        std::vector<int> validIndices;
+        std::vector<int> textVector = textToVector(ciphertext, validIndices);
+
+        // If no characters to decrypt
+        if (textVector.empty()) {
+            return ciphertext;
+        }
+
+        // Add padding if needed for decryption
+        size_t originalSize = textVector.size();
+        while (textVector.size() % matrixSize != 0) {
+            textVector.push_back(0); // 'a' as padding
+        }
+
+        std::vector<int> decryptedVector;
+
+        for (size_t i = 0; i < textVector.size(); i += matrixSize) {
+            std::vector<int> block(textVector.begin() + i,
+                textVector.begin() + i + matrixSize);
+            std::vector<int> decryptedBlock = multiplyMatrixVector(inverseKeyMatrix, block);
+            decryptedVector.insert(decryptedVector.end(),
+                decryptedBlock.begin(), decryptedBlock.end());
+        }
+
+        // Remove padding from decrypted vector
+        if (decryptedVector.size() > originalSize) {
+            decryptedVector.resize(originalSize);
+        }
+
+        // Reconstruct text with position preservation
+        std::string result = ciphertext;
+        size_t decryptedIndex = 0;
+
+        for (size_t i = 0; i < validIndices.size() && decryptedIndex < decryptedVector.size(); i++) {
+            if (decryptedIndex < decryptedVector.size()) {
+                size_t pos = static_cast<size_t>(validIndices[i]);
+                if (pos < result.length()) {
+                    result[pos] = alphabet[decryptedVector[decryptedIndex]];
+                    decryptedIndex++;
+                }
+            }
+        }
+
+        return result;
+    }
+};
+
+// Function to normalize key matrix (mod ALPHABET_SIZE)
+inline vector<vector<int>> normalizeKeyMatrix(const vector<vector<int>>& keyMatrix) {
+    vector<vector<int>> normalized = keyMatrix;
+    for (auto& row : normalized) {
+        for (auto& val : row) {
+            val = val % ALPHABET_SIZE;
+            if (val < 0) val += ALPHABET_SIZE;
+        }
+    }
+    return normalized;
+}
+
+inline vector<vector<int>> parseKeyMatrix(const string& keyText, int& n) {
+    vector<vector<int>> keyMatrix;
+    stringstream ss(keyText);
+    string line;
+    int rowCount = 0;
+    int expectedCols = -1;
+
+    while (getline(ss, line)) {
+        if (line.empty()) continue;
+        stringstream lineStream(line);
+        vector<int> row;
+        string token;
+
+        while (lineStream >> token) {
+            try {
+                int value = stoi(token);
+                row.push_back(value);
+            }
+            catch (...) {
+                throw runtime_error("Invalid value in key matrix: '" + token + "'");
+            }
+        }
+
+        if (expectedCols == -1) expectedCols = row.size();
+        else if (int(row.size()) != expectedCols)
+            throw runtime_error("Non-square key matrix: inconsistent number of columns");
+
+        keyMatrix.push_back(row);
+        rowCount++;
+    }
+
+    if (rowCount != expectedCols)
+        throw runtime_error("Non-square key matrix: number of rows != number of columns");
+
+    n = rowCount;
+
+    // Normalize key matrix
+    return normalizeKeyMatrix(keyMatrix);
+}
+
+
+inline void toLowerCase(string& text) {
+    for (char& c : text) {
+        c = tolower((unsigned char)c);
+    }
+}
+}
@@ -0,0 +1,58 @@
+#include <algorithm>
+#include "container.h"
+
+using namespace std;
+
+
+static void put_le(uint8_t* p, uint64_t v, size_t bytes) {
+    for (size_t i = 0; i < bytes; i++) p[i] = uint8_t(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t* p, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < bytes; i++) v |= uint64_t(p[i]) << (8 * i);
+    return v;
+}
+
+
+void encode_container_header(const ContainerHeader& header, uint8_t out[CONTAINER_HEADER_SIZE]) {
+    fill(out, out + CONTAINER_HEADER_SIZE, 0);
+    copy(begin(CONTAINER_MAGIC), end(CONTAINER_MAGIC), out);
+    out[4] = header.version;
+    out[5] = uint8_t(header.mode);
+    put_le(out + 6, header.blockBits, 2);
+    put_le(out + 8, header.length, 8);
+    put_le(out + 16, header.blockCount, 8);
+    copy(begin(header.iv), end(header.iv), out + 24);
+    put_le(out + 40, header.flags, 4);
+}
+
+bool is_container(const uint8_t* data, size_t size) {
+    return size >= CONTAINER_HEADER_SIZE && equal(begin(CONTAINER_MAGIC), end(CONTAINER_MAGIC), data);
+}
+
+ContainerHeader decode_container_header(const uint8_t* data, size_t size) {
+    if (!is_container(data, size)) throw runtime_error("Not a ciphertext container");
+
+    ContainerHeader header;
+    header.version = data[4];
+    if (header.version != CONTAINER_VERSION)
+        throw runtime_error("Unsupported container version " + to_string(header.version));
+
+    if (data[5] > uint8_t(Mode::CTR)) throw runtime_error("Unknown cipher mode in container");
+    header.mode = Mode(data[5]);
+    header.blockBits = uint16_t(get_le(data + 6, 2));
+    header.length = get_le(data + 8, 8);
+    header.blockCount = get_le(data + 16, 8);
+    copy(data + 24, data + 40, header.iv);
+    header.flags = uint32_t(get_le(data + 40, 4));
+
+    if (header.flags & ~CONTAINER_FLAG_MAC) throw runtime_error("Unknown container flags");
+    if (header.blockBits != 16 && header.blockBits != 32 && header.blockBits != 64 && header.blockBits != 128)
+        throw runtime_error("Unsupported block size in container");
+    if (header.blockCount > (size - CONTAINER_HEADER_SIZE) / (header.blockBits / 8))
+        throw runtime_error("Container is truncated");
+    if (header.length > header.blockCount * (header.blockBits / 8))
+        throw runtime_error("Container length exceeds its blocks");
+    return header;
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include "feistel.h"
+#include "modes.h"
+#include "siphash.h"
+
+
+// Binary ciphertext container:
+//
+//   offset  size  field
+//        0     4  magic "FSTL"
+//        4     1  version
+//        5     1  mode (Mode)
+//        6     2  block size in bits
+//        8     8  plaintext length in bytes
+//       16     8  number of ciphertext blocks
+//       24    16  IV (little-endian, zero padded to 16 bytes)
+//       40     4  flags
+//       44     4  reserved
+//       48        ciphertext blocks, raw little-endian
+//                 MAC tag (MAC_TAG_SIZE bytes) if CONTAINER_FLAG_MAC is set
+//
+// All header integers are little-endian. The block area starts 16-byte
+// aligned in a mapped file, so it is read in place without parsing.
+
+const uint8_t CONTAINER_MAGIC[4] = { 'F', 'S', 'T', 'L' };
+const uint8_t CONTAINER_VERSION = 1;
+const size_t CONTAINER_HEADER_SIZE = 48;
+
+// Encrypt-then-MAC: the tag covers the encoded header and all ciphertext blocks
+const uint32_t CONTAINER_FLAG_MAC = 1;
+
+struct ContainerHeader {
+    uint8_t version = CONTAINER_VERSION;
+    Mode mode = Mode::CBC;
+    uint16_t blockBits = 16;
+    uint64_t length = 0;
+    uint64_t blockCount = 0;
+    uint8_t iv[16] = {};
+    uint32_t flags = 0;
+};
+
+void encode_container_header(const ContainerHeader& header, uint8_t out[CONTAINER_HEADER_SIZE]);
+
+// Throws runtime_error if the data is not a valid container
+ContainerHeader decode_container_header(const uint8_t* data, size_t size);
+
+bool is_container(const uint8_t* data, size_t size);
+
+
+// Blocks are stored as they are laid out in memory on a little-endian host
+static_assert(std::endian::native == std::endian::little, "container I/O assumes a little-endian host");
+
+template <unsigned BlockBits>
+ContainerHeader make_container_header(Mode mode, typename BlockTraits<BlockBits>::Block iv, uint64_t blockCount,
+    uint64_t length, uint32_t flags = 0) {
+    ContainerHeader header;
+    header.mode = mode;
+    header.blockBits = BlockBits;
+    header.length = length;
+    header.blockCount = blockCount;
+    std::memcpy(header.iv, &iv, sizeof(iv));
+    header.flags = flags;
+    return header;
+}
+
+// tag is required when the header has CONTAINER_FLAG_MAC
+template <unsigned BlockBits>
+void write_container(const std::string& filePath, const ContainerHeader& header,
+    std::span<const typename BlockTraits<BlockBits>::Block> blocks, const MacTag* tag = nullptr) {
+    if (header.blockCount != blocks.size()) throw std::invalid_argument("write_container: block count mismatch");
+    if ((header.flags & CONTAINER_FLAG_MAC) && !tag) throw std::invalid_argument("write_container: missing MAC tag");
+
+    uint8_t raw[CONTAINER_HEADER_SIZE];
+    encode_container_header(header, raw);
+
+    std::ofstream out(filePath, std::ios::binary);
+    if (!out.is_open()) throw std::runtime_error("Cannot open file to write: " + filePath);
+    out.write(reinterpret_cast<const char*>(raw), sizeof(raw));
+    out.write(reinterpret_cast<const char*>(blocks.data()), std::streamsize(blocks.size_bytes()));
+    if (header.flags & CONTAINER_FLAG_MAC) out.write(reinterpret_cast<const char*>(tag->data()), MAC_TAG_SIZE);
+    if (!out) throw std::runtime_error("Cannot write file: " + filePath);
+}
+
+template <unsigned BlockBits>
+typename BlockTraits<BlockBits>::Block container_iv(const ContainerHeader& header) {
+    typename BlockTraits<BlockBits>::Block iv;
+    std::memcpy(&iv, header.iv, sizeof(iv));
+    return iv;
+}
+
+// View of the block area of a container that is already in memory (mapped)
+template <unsigned BlockBits>
+std::span<const typename BlockTraits<BlockBits>::Block> container_blocks(const ContainerHeader& header,
+    const uint8_t* data, size_t size) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    if (header.blockBits != BlockBits) throw std::runtime_error("Container block size mismatch");
+    size_t trailer = (header.flags & CONTAINER_FLAG_MAC) ? MAC_TAG_SIZE : 0;
+    if (size < CONTAINER_HEADER_SIZE + header.blockCount * sizeof(Block) + trailer)
+        throw std::runtime_error("Container is truncated");
+    return { reinterpret_cast<const Block*>(data + CONTAINER_HEADER_SIZE), size_t(header.blockCount) };
+}
+
+// Whether a container may be decrypted when a tag is required. The flag is
+// only covered by the tag it announces: with the flag cleared and the tag
+// cut off the file still parses, so the reader has to insist on it
+inline bool container_authenticated(const ContainerHeader& header, bool requireMac) {
+    return !requireMac || (header.flags & CONTAINER_FLAG_MAC);
+}
+
+// MAC tag stored after the blocks (container_blocks has checked the size)
+inline const uint8_t* container_tag(const ContainerHeader& header, const uint8_t* data) {
+    return data + CONTAINER_HEADER_SIZE + header.blockCount * (header.blockBits / 8);
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include "feistel_simd.h"
+
+
+// 128-bit block kept as two 64-bit halves (MSVC has no native uint128).
+// Low half first, so the in-memory layout is little-endian 128-bit.
+struct Block128 {
+    uint64_t lo;
+    uint64_t hi;
+};
+
+inline bool operator==(const Block128& a, const Block128& b) { return a.hi == b.hi && a.lo == b.lo; }
+inline bool operator!=(const Block128& a, const Block128& b) { return !(a == b); }
+inline Block128 operator^(const Block128& a, const Block128& b) { return { a.lo ^ b.lo, a.hi ^ b.hi }; }
+
+
+// Block layout for every supported width: the block is split into
+// a left (high) and a right (low) half of equal size
+template <unsigned BlockBits> struct BlockTraits;
+
+template <> struct BlockTraits<16> {
+    using Block = uint16_t;
+    using Half = uint8_t;
+    static Half left(Block b) { return Half(b >> 8); }
+    static Half right(Block b) { return Half(b); }
+    static Block join(Half L, Half R) { return Block((Block(L) << 8) | R); }
+};
+
+template <> struct BlockTraits<32> {
+    using Block = uint32_t;
+    using Half = uint16_t;
+    static Half left(Block b) { return Half(b >> 16); }
+    static Half right(Block b) { return Half(b); }
+    static Block join(Half L, Half R) { return (Block(L) << 16) | R; }
+};
+
+template <> struct BlockTraits<64> {
+    using Block = uint64_t;
+    using Half = uint32_t;
+    static Half left(Block b) { return Half(b >> 32); }
+    static Half right(Block b) { return Half(b); }
+    static Block join(Half L, Half R) { return (Block(L) << 32) | R; }
+};
+
+template <> struct BlockTraits<128> {
+    using Block = Block128;
+    using Half = uint64_t;
+    static Half left(Block b) { return b.hi; }
+    static Half right(Block b) { return b.lo; }
+    static Block join(Half L, Half R) { return { R, L }; }
+};
+
+
+// Big-endian load/store of one half (the first text byte is the most significant one)
+template <typename Half>
+Half load_half(const uint8_t* p) {
+    Half v = 0;
+    for (size_t i = 0; i < sizeof(Half); i++) v = Half((uint64_t(v) << 8) | p[i]);
+    return v;
+}
+
+template <typename Half>
+void store_half(uint8_t* p, Half v) {
+    for (size_t i = sizeof(Half); i-- > 0;) {
+        p[i] = uint8_t(v);
+        v = Half(uint64_t(v) >> 8);
+    }
+}
+
+template <unsigned BlockBits>
+typename BlockTraits<BlockBits>::Block load_block(const uint8_t* p) {
+    using T = BlockTraits<BlockBits>;
+    using Half = typename T::Half;
+    return T::join(load_half<Half>(p), load_half<Half>(p + sizeof(Half)));
+}
+
+template <unsigned BlockBits>
+void store_block(uint8_t* p, typename BlockTraits<BlockBits>::Block block) {
+    using T = BlockTraits<BlockBits>;
+    using Half = typename T::Half;
+    store_half<Half>(p, T::left(block));
+    store_half<Half>(p + sizeof(Half), T::right(block));
+}
+
+
+// Round function: (half ^ key) + rotl1(half)
+template <typename Half>
+inline Half F(Half half, Half key) {
+    constexpr unsigned bits = sizeof(Half) * 8;
+    return Half((half ^ key) + Half((half << 1) | (half >> (bits - 1))));
+}
+
+
+// Feistel network over BlockBits-wide blocks with a compile-time number of rounds.
+// The round loop is unrolled and the keys are copied to a local array before
+// processing a span, so they stay in registers for the whole batch.
+// Spans of 16-bit blocks go through the vectorized kernels (feistel_simd.h).
+template <unsigned BlockBits, size_t Rounds = 8>
+class FeistelCipher {
+public:
+    using Traits = BlockTraits<BlockBits>;
+    using Block = typename Traits::Block;
+    using Half = typename Traits::Half;
+    using RoundKeys = std::array<Half, Rounds>;
+
+    static constexpr unsigned blockBits = BlockBits;
+    static constexpr size_t blockBytes = BlockBits / 8;
+    static constexpr size_t rounds = Rounds;
+
+    explicit FeistelCipher(const RoundKeys& keys) : keys(keys) {}
+
+    const RoundKeys& roundKeys() const { return keys; }
+
+    Block encrypt_block(Block block) const {
+        return encrypt_rounds(block, keys, std::make_index_sequence<Rounds>());
+    }
+
+    Block decrypt_block(Block block) const {
+        return decrypt_rounds(block, keys, std::make_index_sequence<Rounds>());
+    }
+
+    void encrypt_blocks(std::span<Block> blocks) const {
+        if constexpr (BlockBits == 16 && Rounds <= SIMD_MAX_ROUNDS) {
+            feistel16_encrypt_blocks(blocks.data(), blocks.size(), keys.data(), Rounds);
+            return;
+        }
+        const RoundKeys k = keys;
+        for (Block& b : blocks) b = encrypt_rounds(b, k, std::make_index_sequence<Rounds>());
+    }
+
+    void decrypt_blocks(std::span<Block> blocks) const {
+        if constexpr (BlockBits == 16 && Rounds <= SIMD_MAX_ROUNDS) {
+            feistel16_decrypt_blocks(blocks.data(), blocks.size(), keys.data(), Rounds);
+            return;
+        }
+        const RoundKeys k = keys;
+        for (Block& b : blocks) b = decrypt_rounds(b, k, std::make_index_sequence<Rounds>());
+    }
+
+private:
+    RoundKeys keys;
+
+    template <size_t... I>
+    static Block encrypt_rounds(Block block, const RoundKeys& k, std::index_sequence<I...>) {
+        Half L = Traits::left(block);
+        Half R = Traits::right(block);
+        auto round = [&](Half key) {
+            Half newR = Half(L ^ F(R, key));
+            L = R;
+            R = newR;
+        };
+        (round(k[I]), ...);
+        return Traits::join(L, R);
+    }
+
+    template <size_t... I>
+    static Block decrypt_rounds(Block block, const RoundKeys& k, std::index_sequence<I...>) {
+        Half L = Traits::left(block);
+        Half R = Traits::right(block);
+        auto round = [&](Half key) {
+            Half newL = Half(R ^ F(L, key));
+            R = L;
+            L = newL;
+        };
+        (round(k[Rounds - 1 - I]), ...);
+        return Traits::join(L, R);
+    }
+};
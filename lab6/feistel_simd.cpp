@@ -0,0 +1,223 @@
+#include <atomic>
+#include "feistel.h"
+#include "feistel_simd.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define FEISTEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+using namespace std;
+
+
+// --- scalar ---
+static void encrypt_scalar(uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t L = blocks[i] >> 8;
+        uint8_t R = blocks[i] & 0xFF;
+        for (size_t r = 0; r < rounds; r++) {
+            uint8_t newR = L ^ F(R, keys[r]);
+            L = R;
+            R = newR;
+        }
+        blocks[i] = (uint16_t(L) << 8) | R;
+    }
+}
+
+static void decrypt_scalar(uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    for (size_t i = 0; i < count; i++) {
+        uint8_t L = blocks[i] >> 8;
+        uint8_t R = blocks[i] & 0xFF;
+        for (size_t r = rounds; r-- > 0;) {
+            uint8_t newL = R ^ F(L, keys[r]);
+            R = L;
+            L = newL;
+        }
+        blocks[i] = (uint16_t(L) << 8) | R;
+    }
+}
+
+
+#ifdef FEISTEL_X86
+// --- SSE2: 16 blocks per iteration ---
+// rotl1 on bytes: x + x gives the per-byte shift left,
+// bit 7 of every byte is brought down by a 16-bit shift and masked
+static inline __m128i F_sse2(__m128i half, __m128i key, __m128i one) {
+    __m128i rot = _mm_or_si128(_mm_add_epi8(half, half), _mm_and_si128(_mm_srli_epi16(half, 7), one));
+    return _mm_add_epi8(_mm_xor_si128(half, key), rot);
+}
+
+template <bool Encrypt>
+static void crypt_sse2(uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    const __m128i lowMask = _mm_set1_epi16(0x00FF);
+    const __m128i one = _mm_set1_epi8(1);
+    __m128i k[SIMD_MAX_ROUNDS];
+    for (size_t r = 0; r < rounds; r++) k[r] = _mm_set1_epi8(char(keys[Encrypt ? r : rounds - 1 - r]));
+
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(blocks + i + 8));
+
+        // Deinterleave: one register of left halves, one of right halves
+        __m128i R = _mm_packus_epi16(_mm_and_si128(a, lowMask), _mm_and_si128(b, lowMask));
+        __m128i L = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+
+        for (size_t r = 0; r < rounds; r++) {
+            if (Encrypt) {
+                __m128i newR = _mm_xor_si128(L, F_sse2(R, k[r], one));
+                L = R;
+                R = newR;
+            }
+            else {
+                __m128i newL = _mm_xor_si128(R, F_sse2(L, k[r], one));
+                R = L;
+                L = newL;
+            }
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(blocks + i), _mm_unpacklo_epi8(R, L));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(blocks + i + 8), _mm_unpackhi_epi8(R, L));
+    }
+
+    if (Encrypt) encrypt_scalar(blocks + i, count - i, keys, rounds);
+    else decrypt_scalar(blocks + i, count - i, keys, rounds);
+}
+
+
+// --- AVX2: 32 blocks per iteration ---
+// packus/unpack work inside 128-bit lanes, so the lane order they
+// introduce is undone by the matching unpack on the way out
+TARGET_AVX2 static inline __m256i F_avx2(__m256i half, __m256i key, __m256i one) {
+    __m256i rot = _mm256_or_si256(_mm256_add_epi8(half, half), _mm256_and_si256(_mm256_srli_epi16(half, 7), one));
+    return _mm256_add_epi8(_mm256_xor_si256(half, key), rot);
+}
+
+template <bool Encrypt>
+TARGET_AVX2 static void crypt_avx2(uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    const __m256i lowMask = _mm256_set1_epi16(0x00FF);
+    const __m256i one = _mm256_set1_epi8(1);
+    __m256i k[SIMD_MAX_ROUNDS];
+    for (size_t r = 0; r < rounds; r++) k[r] = _mm256_set1_epi8(char(keys[Encrypt ? r : rounds - 1 - r]));
+
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(blocks + i + 16));
+
+        __m256i R = _mm256_packus_epi16(_mm256_and_si256(a, lowMask), _mm256_and_si256(b, lowMask));
+        __m256i L = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+
+        for (size_t r = 0; r < rounds; r++) {
+            if (Encrypt) {
+                __m256i newR = _mm256_xor_si256(L, F_avx2(R, k[r], one));
+                L = R;
+                R = newR;
+            }
+            else {
+                __m256i newL = _mm256_xor_si256(R, F_avx2(L, k[r], one));
+                R = L;
+                L = newL;
+            }
+        }
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(blocks + i), _mm256_unpacklo_epi8(R, L));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(blocks + i + 16), _mm256_unpackhi_epi8(R, L));
+    }
+
+    crypt_sse2<Encrypt>(blocks + i, count - i, keys, rounds);
+}
+
+
+static bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    // OS must save the YMM registers
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+
+// --- dispatch ---
+const char* simd_kernel_name(SimdKernel kernel) {
+    switch (kernel) {
+    case SimdKernel::Scalar: return "scalar";
+    case SimdKernel::SSE2: return "sse2";
+    case SimdKernel::AVX2: return "avx2";
+    }
+    return "?";
+}
+
+bool simd_kernel_supported(SimdKernel kernel) {
+    switch (kernel) {
+    case SimdKernel::Scalar: return true;
+#ifdef FEISTEL_X86
+    case SimdKernel::SSE2: return true;
+    case SimdKernel::AVX2: {
+        static const bool avx2 = cpu_has_avx2();
+        return avx2;
+    }
+#endif
+    default: return false;
+    }
+}
+
+SimdKernel best_simd_kernel() {
+    if (simd_kernel_supported(SimdKernel::AVX2)) return SimdKernel::AVX2;
+    if (simd_kernel_supported(SimdKernel::SSE2)) return SimdKernel::SSE2;
+    return SimdKernel::Scalar;
+}
+
+static atomic<SimdKernel>& active_kernel_slot() {
+    static atomic<SimdKernel> slot{ best_simd_kernel() };
+    return slot;
+}
+
+SimdKernel active_simd_kernel() {
+    return active_kernel_slot().load(memory_order_relaxed);
+}
+
+bool set_simd_kernel(SimdKernel kernel) {
+    if (!simd_kernel_supported(kernel)) return false;
+    active_kernel_slot().store(kernel, memory_order_relaxed);
+    return true;
+}
+
+void feistel16_encrypt(SimdKernel kernel, uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    if (rounds > SIMD_MAX_ROUNDS) kernel = SimdKernel::Scalar;
+    switch (kernel) {
+#ifdef FEISTEL_X86
+    case SimdKernel::AVX2: crypt_avx2<true>(blocks, count, keys, rounds); return;
+    case SimdKernel::SSE2: crypt_sse2<true>(blocks, count, keys, rounds); return;
+#endif
+    default: encrypt_scalar(blocks, count, keys, rounds); return;
+    }
+}
+
+void feistel16_decrypt(SimdKernel kernel, uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    if (rounds > SIMD_MAX_ROUNDS) kernel = SimdKernel::Scalar;
+    switch (kernel) {
+#ifdef FEISTEL_X86
+    case SimdKernel::AVX2: crypt_avx2<false>(blocks, count, keys, rounds); return;
+    case SimdKernel::SSE2: crypt_sse2<false>(blocks, count, keys, rounds); return;
+#endif
+    default: decrypt_scalar(blocks, count, keys, rounds); return;
+    }
+}
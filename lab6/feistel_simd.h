@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+
+// Vectorized kernels for 16-bit blocks (8-bit halves).
+// Every byte lane of a vector register holds one Feistel half, so an AVX2
+// register runs one round for 32 blocks at once.
+
+enum class SimdKernel { Scalar, SSE2, AVX2 };
+
+// Longest key schedule the vector kernels keep in registers
+const size_t SIMD_MAX_ROUNDS = 32;
+
+const char* simd_kernel_name(SimdKernel kernel);
+bool simd_kernel_supported(SimdKernel kernel);
+
+// Best kernel for this CPU (detected once)
+SimdKernel best_simd_kernel();
+
+// Kernel used by feistel16_encrypt_blocks/feistel16_decrypt_blocks.
+// Defaults to best_simd_kernel(); unsupported kernels are rejected.
+SimdKernel active_simd_kernel();
+bool set_simd_kernel(SimdKernel kernel);
+
+void feistel16_encrypt(SimdKernel kernel, uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds);
+void feistel16_decrypt(SimdKernel kernel, uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds);
+
+inline void feistel16_encrypt_blocks(uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    feistel16_encrypt(active_simd_kernel(), blocks, count, keys, rounds);
+}
+
+inline void feistel16_decrypt_blocks(uint16_t* blocks, size_t count, const uint8_t* keys, size_t rounds) {
+    feistel16_decrypt(active_simd_kernel(), blocks, count, keys, rounds);
+}
@@ -0,0 +1,82 @@
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+#include "key_schedule.h"
+
+using namespace std;
+
+
+// Passes over the state after absorbing the key; makes every passphrase
+// guess cost a few milliseconds
+const uint64_t KDF_ITERATIONS = 1 << 18;
+
+// SplitMix64 finalizer
+static uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+
+// Round keys come from the built-in key as is; the state is still derived
+// from it so the MAC key exists for the built-in key too
+KeySchedule KeySchedule::legacy() {
+    KeySchedule schedule = from_bytes(LEGACY_KEY.data(), LEGACY_KEY.size());
+    schedule.legacyKey = true;
+    return schedule;
+}
+
+KeySchedule KeySchedule::from_passphrase(const string& passphrase) {
+    if (passphrase.empty()) throw runtime_error("Passphrase is empty");
+    return from_bytes(reinterpret_cast<const uint8_t*>(passphrase.data()), passphrase.size());
+}
+
+KeySchedule KeySchedule::from_key_file(const string& filePath) {
+    ifstream file(filePath, ios::binary);
+    if (!file.is_open()) throw runtime_error("Cannot open file to read: " + filePath);
+    vector<uint8_t> bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (bytes.empty()) throw runtime_error("Key file is empty: " + filePath);
+    return from_bytes(bytes.data(), bytes.size());
+}
+
+// Not a standardized KDF: the key is absorbed into four 64-bit lanes
+// (length-prefixed, so "ab" and "ab\0" differ) and the lanes are then
+// stirred into each other KDF_ITERATIONS times
+KeySchedule KeySchedule::from_bytes(const uint8_t* data, size_t size) {
+    KeySchedule schedule;
+    auto& s = schedule.state;
+    s = { 0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL };
+
+    s[0] = mix64(s[0] ^ size);
+    for (size_t i = 0; i < size; i++) {
+        uint64_t& lane = s[i % 4];
+        lane = mix64(lane ^ (uint64_t(data[i]) << (8 * (i % 8))) ^ i);
+    }
+
+    for (uint64_t it = 0; it < KDF_ITERATIONS; it++) {
+        for (size_t j = 0; j < 4; j++) {
+            s[j] = mix64(s[j] + s[(j + 1) % 4] + it);
+        }
+    }
+    return schedule;
+}
+
+uint64_t KeySchedule::legacy_word(size_t pos, size_t bytes) {
+    uint64_t v = 0;
+    for (size_t j = 0; j < bytes; j++) v = (v << 8) | LEGACY_KEY[(pos + j) % LEGACY_KEY.size()];
+    return v;
+}
+
+MacKey KeySchedule::mac_key() const {
+    // Domain "MAC" never collides with round-key domains (block width << 32)
+    const uint64_t MAC_DOMAIN = 0x4d4143ULL << 40;
+    return { derive(MAC_DOMAIN), derive(MAC_DOMAIN + 1) };
+}
+
+uint64_t KeySchedule::derive(uint64_t index) const {
+    uint64_t v = mix64(index ^ state[0]);
+    v = mix64(v ^ state[1]);
+    v = mix64(v ^ state[2]);
+    return mix64(v ^ state[3]);
+}
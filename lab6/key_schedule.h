@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include "feistel.h"
+#include "siphash.h"
+
+
+// Rounds used by the tool (one round key per round)
+const size_t FEISTEL_ROUNDS = 8;
+
+// Built-in key of the original tool: 8 keys (by 1 byte)
+const std::array<uint8_t, 8> LEGACY_KEY = { 15, 23, 71, 99, 201, 50, 77, 5 };
+
+// Constant IV of the original tool
+const uint16_t LEGACY_IV = 0x1234;
+
+
+// Round-key source: either the built-in key or a 256-bit state derived
+// from a passphrase / key file. Round keys are produced per block width
+// into a fixed-size array, so a cipher never touches heap memory for them.
+class KeySchedule {
+public:
+    static KeySchedule legacy();
+    static KeySchedule from_passphrase(const std::string& passphrase);
+    static KeySchedule from_key_file(const std::string& filePath);
+
+    bool is_legacy() const { return legacyKey; }
+
+    // Key of the authentication tag, independent of the round keys
+    MacKey mac_key() const;
+
+    template <unsigned BlockBits, size_t Rounds = FEISTEL_ROUNDS>
+    std::array<typename BlockTraits<BlockBits>::Half, Rounds> round_keys() const {
+        using Half = typename BlockTraits<BlockBits>::Half;
+        std::array<Half, Rounds> keys{};
+        for (size_t r = 0; r < Rounds; r++) {
+            keys[r] = legacyKey ? Half(legacy_word(r * sizeof(Half), sizeof(Half)))
+                : Half(derive((uint64_t(BlockBits) << 32) | r));
+        }
+        return keys;
+    }
+
+private:
+    bool legacyKey = false;
+    std::array<uint64_t, 4> state{};
+
+    // Built-in key bytes from pos on, repeated cyclically (big-endian word)
+    static uint64_t legacy_word(size_t pos, size_t bytes);
+
+    // Independent 64-bit key word for a domain/index pair
+    uint64_t derive(uint64_t index) const;
+
+    static KeySchedule from_bytes(const uint8_t* data, size_t size);
+};
+
+
+template <unsigned BlockBits, size_t Rounds = FEISTEL_ROUNDS>
+FeistelCipher<BlockBits, Rounds> make_cipher(const KeySchedule& schedule) {
+    return FeistelCipher<BlockBits, Rounds>(schedule.round_keys<BlockBits, Rounds>());
+}
+
+// Fresh IV for every message
+template <unsigned BlockBits>
+typename BlockTraits<BlockBits>::Block random_iv() {
+    std::random_device rd;
+    uint8_t bytes[BlockBits / 8];
+    for (uint8_t& b : bytes) b = uint8_t(rd());
+    return load_block<BlockBits>(bytes);
+}
+
+// The original constant IV repeated over the block (0x1234 -> 0x12341234...)
+template <unsigned BlockBits>
+typename BlockTraits<BlockBits>::Block legacy_iv() {
+    uint8_t bytes[BlockBits / 8];
+    for (size_t i = 0; i < sizeof(bytes); i += 2) {
+        bytes[i] = uint8_t(LEGACY_IV >> 8);
+        bytes[i + 1] = uint8_t(LEGACY_IV);
+    }
+    return load_block<BlockBits>(bytes);
+}
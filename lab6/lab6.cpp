@@ -5,29 +5,75 @@
 #include <fstream>
 #include <sstream>
 #include <cctype>
+#include <filesystem>
 #include <random>
 #include <chrono>
+#include <algorithm>
+#include <thread>
+#include "feistel.h"
+#include "modes.h"
+#include "feistel_simd.h"
+#include "container.h"
+#include "mapped_file.h"
+#include "key_schedule.h"
+#include "siphash.h"
+#include "message.h"
+#include "reference.h"
+#include "../common/console_log.h"
+#include "../common/profiler.h"
+#include "../common/read_file.h"
 using namespace std;
 
 #define OUTPUT_FILE_NAME "output.txt"
+#define CONTAINER_FILE_NAME "output.bin"
 
-// 8 keys (by 1 byte)
-vector<uint8_t> KEYS = { 15, 23, 71, 99, 201, 50, 77, 5 };
 
-// Add Initialization Vector (IV)
-const uint16_t INITIALIZATION_VECTOR = 0x1234; // Or generate randomly
-
-std::string readFileContent(const std::string& filePath);
-void writeFileContent(const std::string& filePath, const std::string& content);
-void writeFileContent(const std::string& filePath, const std::vector<uint16_t>& content);
+std::string readFileContent(const std::string& filePath, bool binary = false);
+void writeFileContent(const std::string& filePath, const std::string& content, bool binary = false);
+template <typename Block>
+void writeFileContent(const std::string& filePath, const std::vector<Block>& content);
 void toUpperCase(std::string& text);
 void toLowerCase(std::string& text);
 
-void printHexVector(const vector<uint16_t>& vec) {
-    for (uint16_t b : vec) {
-        cout << hex << setw(4) << setfill('0') << b << " ";
+span<const uint8_t> as_bytes_span(const string& s) {
+    return { reinterpret_cast<const uint8_t*>(s.data()), s.size() };
+}
+
+span<uint8_t> as_writable_bytes_span(string& s) {
+    return { reinterpret_cast<uint8_t*>(s.data()), s.size() };
+}
+
+template <typename Block>
+void append_hex(string& out, Block b) {
+    static const char digits[] = "0123456789abcdef";
+    for (int shift = int(sizeof(Block)) * 8 - 4; shift >= 0; shift -= 4) {
+        out += digits[(uint64_t(b) >> shift) & 0xF];
     }
-    cout << endl;
+}
+
+void append_hex(string& out, const Block128& b) {
+    append_hex(out, b.hi);
+    append_hex(out, b.lo);
+}
+
+// Only the blocks the console mode shows are formatted
+template <typename Block>
+void printHexVector(const vector<Block>& vec) {
+    ProfileScope scope("print", vec.size() * sizeof(Block));
+    const size_t width = sizeof(Block) * 2 + 1;
+    size_t shown = vec.size();
+    if (console_mode() == ConsoleMode::Quiet) shown = 0;
+    else if (console_mode() == ConsoleMode::Preview) shown = min(shown, PREVIEW_BYTES / width);
+
+    string line;
+    line.reserve(shown * width + 32);
+    for (size_t i = 0; i < shown; i++) {
+        append_hex(line, vec[i]);
+        line += ' ';
+    }
+    if (shown < vec.size()) line += "... [" + to_string(vec.size() - shown) + " more blocks]";
+    line += '\n';
+    console_write(move(line));
 }
 
 bool is_hex_encrypted(const string& s) {
@@ -37,95 +83,733 @@ bool is_hex_encrypted(const string& s) {
     return true;
 }
 
-uint8_t F(uint8_t half, uint8_t key) {
-    return (half ^ key) + ((half << 1) | (half >> 7));
+template <unsigned BlockBits>
+typename BlockTraits<BlockBits>::Block parse_hex_block(const string& token) {
+    if constexpr (BlockBits == 128) {
+        return { stoull(token.substr(16), nullptr, 16), stoull(token.substr(0, 16), nullptr, 16) };
+    }
+    else {
+        return typename BlockTraits<BlockBits>::Block(stoull(token, nullptr, 16));
+    }
+}
+
+// The hex format does not store the plaintext length: only the zero
+// padding of the last block is trimmed (the first byte of a block is always data)
+template <unsigned BlockBits>
+size_t unpadded_length(const string& decrypted) {
+    constexpr size_t blockBytes = BlockBits / 8;
+    size_t length = decrypted.size();
+    size_t lastBlockStart = length >= blockBytes ? length - blockBytes : 0;
+    while (length > lastBlockStart + 1 && decrypted[length - 1] == '\0') length--;
+    return length;
+}
+
+template <unsigned BlockBits>
+int run_encrypt(const string& plaintextPath, const KeySchedule& schedule, Mode mode, unsigned threads,
+    bool hexOutput, bool fixedIv, bool binaryInput, bool authenticate) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+
+    if (hexOutput && authenticate) {
+        cerr << "Authenticated encryption needs the binary container (drop --hex)!" << endl;
+        return 1;
+    }
+
+    string plaintext = readFileContent(plaintextPath, binaryInput);
+    if (!binaryInput) toLowerCase(plaintext);
+
+    ProfileScope stage("print", plaintext.size());
+    console_text("\nPlaintext:\n", plaintext);
+
+    // Encrypt
+    stage.next("encrypt", plaintext.size());
+    auto iv = fixedIv ? legacy_iv<BlockBits>() : random_iv<BlockBits>();
+    vector<Block> encrypted(ciphertext_blocks<BlockBits>(plaintext.size()) + 1);
+    FeistelCipher<BlockBits> cipher = make_cipher<BlockBits>(schedule);
+
+    if (hexOutput) {
+        encrypt<BlockBits>(as_bytes_span(plaintext), encrypted, cipher, iv, mode, threads);
+        stage.stop();
+
+        // Save result
+        console_write("\nEncrypted blocks (hex) [First block is IV]:\n");
+        printHexVector(encrypted);
+        writeFileContent(OUTPUT_FILE_NAME, encrypted);
+        return 0;
+    }
+
+    span<const Block> blocks(encrypted.data() + 1, encrypted.size() - 1);
+    ContainerHeader header = make_container_header<BlockBits>(mode, iv, blocks.size(), plaintext.size(),
+        authenticate ? CONTAINER_FLAG_MAC : 0);
+
+    if (authenticate) {
+        // Encrypt-then-MAC over the header and the ciphertext, in the encryption pass
+        uint8_t rawHeader[CONTAINER_HEADER_SIZE];
+        encode_container_header(header, rawHeader);
+        SipHash mac(schedule.mac_key());
+        mac.update(rawHeader, sizeof(rawHeader));
+
+        encrypt<BlockBits>(as_bytes_span(plaintext), encrypted, cipher, iv, mode, threads, &mac);
+        MacTag tag = mac.finalize();
+        stage.next("write", CONTAINER_HEADER_SIZE + blocks.size_bytes());
+        write_container<BlockBits>(CONTAINER_FILE_NAME, header, blocks, &tag);
+    }
+    else {
+        encrypt<BlockBits>(as_bytes_span(plaintext), encrypted, cipher, iv, mode, threads);
+        stage.next("write", CONTAINER_HEADER_SIZE + blocks.size_bytes());
+        write_container<BlockBits>(CONTAINER_FILE_NAME, header, blocks);
+    }
+    stage.stop();
+
+    // Save result
+    console_write("\nEncrypted " + to_string(blocks.size()) + " blocks saved to " CONTAINER_FILE_NAME
+        + (authenticate ? " (authenticated)" : "") + "\n");
+    return 0;
+}
+
+// Container encryption of a file of any size, STREAM_CHUNK_BYTES at a time
+// (see EncryptStream): the blocks are written as they are made, the
+// plaintext is not shown. A text file is read twice, the first time to count
+// its bytes after newline translation, since the header comes first
+template <unsigned BlockBits>
+int run_encrypt_stream(const string& plaintextPath, const KeySchedule& schedule, Mode mode, unsigned threads,
+    bool fixedIv, bool binaryInput, bool authenticate) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    const ios::openmode inputMode = binaryInput ? ios::binary : ios::in;
+    vector<char> buffer(STREAM_CHUNK_BYTES);
+
+    uint64_t length = 0;
+    {
+        ProfileScope stage("count");
+        ifstream in(plaintextPath, inputMode);
+        if (!in.is_open()) throw runtime_error("Cannot open file to read: " + plaintextPath);
+        while (in.read(buffer.data(), streamsize(buffer.size())) || in.gcount() > 0) length += uint64_t(in.gcount());
+        stage.add_bytes(length);
+    }
+
+    auto iv = fixedIv ? legacy_iv<BlockBits>() : random_iv<BlockBits>();
+    FeistelCipher<BlockBits> cipher = make_cipher<BlockBits>(schedule);
+    ContainerHeader header = make_container_header<BlockBits>(mode, iv, ciphertext_blocks<BlockBits>(size_t(length)), length,
+        authenticate ? CONTAINER_FLAG_MAC : 0);
+    uint8_t rawHeader[CONTAINER_HEADER_SIZE];
+    encode_container_header(header, rawHeader);
+    SipHash mac(schedule.mac_key());
+    mac.update(rawHeader, sizeof(rawHeader));
+
+    ifstream in(plaintextPath, inputMode);
+    ofstream out(CONTAINER_FILE_NAME, ios::binary);
+    if (!in.is_open()) throw runtime_error("Cannot open file to read: " + plaintextPath);
+    if (!out.is_open()) throw runtime_error("Cannot open file to write: " CONTAINER_FILE_NAME);
+    out.write(reinterpret_cast<const char*>(rawHeader), sizeof(rawHeader));
+
+    ProfileScope stage("encrypt stream", size_t(length));
+    EncryptStream<BlockBits> stream(cipher, iv, mode, threads, authenticate ? &mac : nullptr);
+    vector<Block> blocks;
+    auto write = [&] { out.write(reinterpret_cast<const char*>(blocks.data()), streamsize(blocks.size() * sizeof(Block))); };
+    uint64_t read = 0;
+    while (in.read(buffer.data(), streamsize(buffer.size())) || in.gcount() > 0) {
+        string piece(buffer.data(), size_t(in.gcount()));
+        read += piece.size();
+        if (!binaryInput) toLowerCase(piece);
+        stream.update(as_bytes_span(piece), blocks);
+        write();
+    }
+    stream.finalize(blocks);
+    write();
+    if (authenticate) {
+        MacTag tag = mac.finalize();
+        out.write(reinterpret_cast<const char*>(tag.data()), MAC_TAG_SIZE);
+    }
+    stage.stop();
+    if (read != length) throw runtime_error("The plaintext file changed while it was read: " + plaintextPath);
+    if (!out) throw runtime_error("Cannot write file: " CONTAINER_FILE_NAME);
+
+    console_write("\nEncrypted " + to_string(header.blockCount) + " blocks saved to " CONTAINER_FILE_NAME
+        + (authenticate ? " (authenticated)" : "") + "\n");
+    return 0;
 }
 
-uint16_t feistel_encrypt_block(uint16_t block, const vector<uint8_t>& keys) {
-    uint8_t L = block >> 8;
-    uint8_t R = block & 0xFF;
+// Legacy hex text: IV followed by the ciphertext blocks
+template <unsigned BlockBits>
+int run_decrypt_hex(const string& ciphertext, const KeySchedule& schedule, Mode mode, unsigned threads) {
+    // Parse hex data into blocks
+    ProfileScope stage("hex parse", ciphertext.size());
+    vector<typename BlockTraits<BlockBits>::Block> blocks;
+    stringstream ss(ciphertext);
+    string hexblock;
+    while (ss >> hexblock) {
+        if (hexblock.size() != BlockBits / 4) {
+            cerr << "Inconsistent block width in the ciphertext file!" << endl;
+            return 1;
+        }
+        blocks.push_back(parse_hex_block<BlockBits>(hexblock));
+    }
+    stage.stop();
+
+    console_write("\nCiphertext [Encrypted blocks (hex)]:\n");
+    printHexVector(blocks);
+
+    // Decrypt
+    span<const typename BlockTraits<BlockBits>::Block> data(blocks.data() + 1, blocks.size() - 1);
+    string decrypted(data.size() * (BlockBits / 8), '\0');
+    stage.next("decrypt", decrypted.size());
+    decrypt<BlockBits>(data, blocks[0], as_writable_bytes_span(decrypted), make_cipher<BlockBits>(schedule), mode, threads);
+    decrypted.resize(unpadded_length<BlockBits>(decrypted));
+    stage.next("print", decrypted.size());
+    console_text("\nDecrypted text: \n", decrypted);
+    stage.stop();
+
+    // Save result
+    writeFileContent(OUTPUT_FILE_NAME, decrypted);
+    return 0;
+}
 
-    for (uint8_t key : keys) {
-        uint8_t newL = R;
-        uint8_t newR = L ^ F(R, key);
-        L = newL;
-        R = newR;
+// Binary container: mode, IV and length come from the header,
+// the blocks are decrypted straight from the mapping
+template <unsigned BlockBits>
+int run_decrypt_container(const MappedFile& file, const ContainerHeader& header, const KeySchedule& schedule,
+    unsigned threads) {
+    auto blocks = container_blocks<BlockBits>(header, file.data(), file.size());
+
+    console_write("\nCiphertext: " + to_string(blocks.size()) + " blocks, " + mode_name(header.mode) + " mode\n");
+
+    // Decrypt (the MAC is checked in the same pass, nothing is released before it matches)
+    string decrypted(size_t(header.length), '\0');
+    ProfileScope stage("decrypt", decrypted.size());
+    if (header.flags & CONTAINER_FLAG_MAC) {
+        SipHash mac(schedule.mac_key());
+        mac.update(file.data(), CONTAINER_HEADER_SIZE);
+        decrypt<BlockBits>(blocks, container_iv<BlockBits>(header), as_writable_bytes_span(decrypted),
+            make_cipher<BlockBits>(schedule), header.mode, threads, &mac);
+
+        if (!tags_equal(mac.finalize(), container_tag(header, file.data()))) {
+            cerr << "Authentication failed: the ciphertext was modified or the key is wrong!" << endl;
+            return 1;
+        }
+        console_write("Authentication tag verified.\n");
     }
-    return (uint16_t(L) << 8) | R;
+    else {
+        decrypt<BlockBits>(blocks, container_iv<BlockBits>(header), as_writable_bytes_span(decrypted),
+            make_cipher<BlockBits>(schedule), header.mode, threads);
+    }
+    stage.next("print", decrypted.size());
+    console_text("\nDecrypted text: \n", decrypted);
+    stage.stop();
+
+    // Save result
+    writeFileContent(OUTPUT_FILE_NAME, decrypted, true);
+    return 0;
 }
 
-uint16_t feistel_decrypt_block(uint16_t block, const vector<uint8_t>& keys) {
-    uint8_t L = block >> 8;
-    uint8_t R = block & 0xFF;
+// Container decryption straight from the mapping to the output file,
+// STREAM_CHUNK_BYTES at a time (see DecryptStream); the text is not shown.
+// The plaintext goes to a temporary file that replaces the output only
+// once the tag has matched, so a forged container leaves nothing behind
+template <unsigned BlockBits>
+int run_decrypt_container_stream(const MappedFile& file, const ContainerHeader& header, const KeySchedule& schedule,
+    unsigned threads) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    auto blocks = container_blocks<BlockBits>(header, file.data(), file.size());
+    const bool authenticated = header.flags & CONTAINER_FLAG_MAC;
+
+    console_write("\nCiphertext: " + to_string(blocks.size()) + " blocks, " + mode_name(header.mode) + " mode\n");
+
+    const string temporaryPath = OUTPUT_FILE_NAME ".tmp";
+    ofstream out(temporaryPath, ios::binary);
+    if (!out.is_open()) throw runtime_error("Cannot open file to write: " + temporaryPath);
+
+    ProfileScope stage("decrypt stream", size_t(header.length));
+    FeistelCipher<BlockBits> cipher = make_cipher<BlockBits>(schedule);
+    SipHash mac(schedule.mac_key());
+    mac.update(file.data(), CONTAINER_HEADER_SIZE);
+    DecryptStream<BlockBits> stream(cipher, container_iv<BlockBits>(header), header.length, header.mode, threads,
+        authenticated ? &mac : nullptr);
+    const size_t chunkBlocks = STREAM_CHUNK_BYTES / sizeof(Block);
+    vector<uint8_t> bytes;
+    for (size_t begin = 0; begin < blocks.size(); begin += chunkBlocks) {
+        stream.update(blocks.subspan(begin, min(chunkBlocks, blocks.size() - begin)), bytes);
+        out.write(reinterpret_cast<const char*>(bytes.data()), streamsize(bytes.size()));
+    }
+    stream.finalize();
+    stage.stop();
+    out.close();
+    if (!out) {
+        filesystem::remove(temporaryPath);
+        throw runtime_error("Cannot write file: " + temporaryPath);
+    }
 
-    for (int i = keys.size() - 1; i >= 0; i--) {
-        uint8_t newR = L;
-        uint8_t newL = R ^ F(L, keys[i]);
-        L = newL;
-        R = newR;
+    if (authenticated) {
+        if (!tags_equal(mac.finalize(), container_tag(header, file.data()))) {
+            filesystem::remove(temporaryPath);
+            cerr << "Authentication failed: the ciphertext was modified or the key is wrong!" << endl;
+            return 1;
+        }
+        console_write("Authentication tag verified.\n");
     }
-    return (uint16_t(L) << 8) | R;
+    filesystem::rename(temporaryPath, OUTPUT_FILE_NAME);
+    console_write("Decrypted " + to_string(header.length) + " bytes saved to " OUTPUT_FILE_NAME "\n");
+    return 0;
 }
 
-// CBC mode encryption
-vector<uint16_t> encrypt(const string& text, const vector<uint8_t>& keys) {
-    vector<uint16_t> blocks;
-    uint16_t previous = INITIALIZATION_VECTOR;
+// Hex export of a container (IV first, like the legacy text format)
+template <unsigned BlockBits>
+int run_export_hex(const MappedFile& file, const ContainerHeader& header) {
+    auto blocks = container_blocks<BlockBits>(header, file.data(), file.size());
+
+    vector<typename BlockTraits<BlockBits>::Block> hexBlocks;
+    hexBlocks.reserve(blocks.size() + 1);
+    hexBlocks.push_back(container_iv<BlockBits>(header));
+    hexBlocks.insert(hexBlocks.end(), blocks.begin(), blocks.end());
 
-    for (size_t i = 0; i < text.size(); i += 2) {
-        uint8_t c1 = text[i];
-        uint8_t c2 = (i + 1 < text.size()) ? text[i + 1] : 0;
-        uint16_t block = (uint16_t(c1) << 8) | c2;
+    writeFileContent(OUTPUT_FILE_NAME, hexBlocks);
+    console_write("\n" + to_string(blocks.size()) + " blocks (" + mode_name(header.mode) + " mode) exported to "
+        OUTPUT_FILE_NAME "\n");
+    return 0;
+}
 
-        // XOR with previous ciphertext block (or IV for first block)
-        uint16_t xored = block ^ previous;
+// Throughput of every 16-bit kernel available on this CPU
+int run_benchmark() {
+    const size_t COUNT = size_t(1) << 22; // 8 MB of blocks
+    const int REPEATS = 5;
+
+    vector<uint16_t> source(COUNT);
+    mt19937 rng(12345);
+    for (uint16_t& b : source) b = uint16_t(rng());
+
+    auto keys = KeySchedule::legacy().round_keys<16>();
+    vector<uint16_t> expected = source;
+    feistel16_encrypt(SimdKernel::Scalar, expected.data(), COUNT, keys.data(), keys.size());
+
+    cout << "=== Feistel 16-bit kernel benchmark (" << COUNT << " blocks x " << REPEATS << ") ===" << endl;
+    for (SimdKernel kernel : { SimdKernel::Scalar, SimdKernel::SSE2, SimdKernel::AVX2 }) {
+        cout << setw(8) << setfill(' ') << simd_kernel_name(kernel) << ": ";
+        if (!simd_kernel_supported(kernel)) {
+            cout << "not supported" << endl;
+            continue;
+        }
 
-        // Encrypt the XORed block
-        uint16_t encrypted = feistel_encrypt_block(xored, keys);
-        blocks.push_back(encrypted);
+        vector<uint16_t> work = source;
+        double encryptSeconds = 0, decryptSeconds = 0;
+        bool ok = true;
+        for (int r = 0; r < REPEATS; r++) {
+            auto t0 = chrono::steady_clock::now();
+            feistel16_encrypt(kernel, work.data(), COUNT, keys.data(), keys.size());
+            auto t1 = chrono::steady_clock::now();
+            ok = ok && work == expected;
+            feistel16_decrypt(kernel, work.data(), COUNT, keys.data(), keys.size());
+            auto t2 = chrono::steady_clock::now();
+            ok = ok && work == source;
+            encryptSeconds += chrono::duration<double>(t1 - t0).count();
+            decryptSeconds += chrono::duration<double>(t2 - t1).count();
+        }
 
-        // Update previous for next iteration
-        previous = encrypted;
+        cout << fixed << setprecision(1)
+            << "encrypt " << COUNT * REPEATS / encryptSeconds / 1e6 << " Mblocks/s, "
+            << "decrypt " << COUNT * REPEATS / decryptSeconds / 1e6 << " Mblocks/s"
+            << (ok ? "" : "  [MISMATCH]") << endl;
+        if (!ok) return 1;
     }
+    cout << "Active kernel: " << simd_kernel_name(active_simd_kernel()) << endl;
+    return 0;
+}
 
-    // Add IV as first block for decryption
-    blocks.insert(blocks.begin(), INITIALIZATION_VECTOR);
+template <unsigned BlockBits>
+string blocks_to_bytes(span<const typename BlockTraits<BlockBits>::Block> blocks) {
+    string bytes(blocks.size() * (BlockBits / 8), '\0');
+    for (size_t i = 0; i < blocks.size(); i++) store_block<BlockBits>(reinterpret_cast<uint8_t*>(bytes.data()) + i * (BlockBits / 8), blocks[i]);
+    return bytes;
+}
+
+template <unsigned BlockBits>
+vector<typename BlockTraits<BlockBits>::Block> bytes_to_blocks(const string& bytes) {
+    vector<typename BlockTraits<BlockBits>::Block> blocks(bytes.size() / (BlockBits / 8));
+    for (size_t i = 0; i < blocks.size(); i++) blocks[i] = load_block<BlockBits>(reinterpret_cast<const uint8_t*>(bytes.data()) + i * (BlockBits / 8));
     return blocks;
 }
 
-// CBC mode decryption
-string decrypt(const vector<uint16_t>& blocks_with_iv, const vector<uint8_t>& keys) {
-    if (blocks_with_iv.empty()) return "";
+string random_bytes(FuzzRandom& rng, size_t size) {
+    string bytes(size, '\0');
+    for (char& b : bytes) b = char(rng());
+    return bytes;
+}
 
-    string result;
-    uint16_t previous = blocks_with_iv[0]; // First block is IV
+// One of the supported 16-bit kernels, named in what
+void fuzz_simd_kernel(FuzzRandom& rng, string& what) {
+    vector<SimdKernel> kernels;
+    for (SimdKernel kernel : { SimdKernel::Scalar, SimdKernel::SSE2, SimdKernel::AVX2 }) {
+        if (simd_kernel_supported(kernel)) kernels.push_back(kernel);
+    }
+    set_simd_kernel(kernels[rng() % kernels.size()]);
+    what += string(", ") + simd_kernel_name(active_simd_kernel());
+}
 
-    for (size_t i = 1; i < blocks_with_iv.size(); i++) {
-        uint16_t encrypted = blocks_with_iv[i];
+// A random message of one block width: key (legacy or from a passphrase),
+// IV, mode, threads and, for 16-bit blocks, the SIMD kernel. Now and then
+// a message of a few MB, processed in chunks with a MAC
+template <unsigned BlockBits>
+struct FuzzMessage {
+    using Half = typename BlockTraits<BlockBits>::Half;
+
+    KeySchedule schedule = KeySchedule::legacy();
+    vector<Half> keys;
+    string iv;
+    string plaintext;
+    Mode mode = Mode::CBC;
+    unsigned threads = 1;
+    bool authenticate = false;
+    MacKey macKey{};
+
+    FuzzMessage(FuzzRandom& rng, string& what) {
+        if (rng() % 4 != 0) schedule = KeySchedule::from_passphrase(random_bytes(rng, 1 + rng() % 16));
+        auto roundKeys = schedule.round_keys<BlockBits>();
+        keys.assign(roundKeys.begin(), roundKeys.end());
+        iv = random_bytes(rng, BlockBits / 8);
+        mode = Mode(rng() % 3);
+        threads = 1 + unsigned(rng() % 4);
+        authenticate = rng() % 64 == 0;
+        plaintext = random_bytes(rng, authenticate ? (size_t(1) << 20) + rng() % (size_t(3) << 19) : rng() % 2000);
+        macKey = { rng(), rng() };
+        what = to_string(BlockBits) + "-bit " + mode_name(mode) + ", " + to_string(plaintext.size()) + " bytes, "
+            + to_string(threads) + " thread(s)" + (schedule.is_legacy() ? ", legacy key" : "") + (authenticate ? ", MAC" : "");
+        if constexpr (BlockBits == 16) fuzz_simd_kernel(rng, what);
+    }
 
-        // Decrypt the block
-        uint16_t decrypted = feistel_decrypt_block(encrypted, keys);
+    typename BlockTraits<BlockBits>::Block iv_block() const {
+        return load_block<BlockBits>(reinterpret_cast<const uint8_t*>(iv.data()));
+    }
 
-        // XOR with previous ciphertext block (or IV for first data block)
-        uint16_t xored = decrypted ^ previous;
+    // SipHash of the ciphertext blocks in one piece
+    string tag(span<const typename BlockTraits<BlockBits>::Block> blocks) const {
+        if (!authenticate) return "";
+        SipHash mac(macKey);
+        mac.update(reinterpret_cast<const uint8_t*>(blocks.data()), blocks.size_bytes());
+        MacTag tag = mac.finalize();
+        return string(tag.begin(), tag.end());
+    }
+};
+
+// encrypt and decrypt of message.h with one block width against the reference
+template <unsigned BlockBits>
+void fuzz_block_bits(FuzzRun& run) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    const string width = to_string(BlockBits) + "-bit ";
+
+    run.check(width + "encrypt", [](FuzzRandom& rng, string& what) {
+        FuzzMessage<BlockBits> m(rng, what);
+        string expected = reference_encrypt(m.plaintext, m.keys, m.iv, m.mode);
+        vector<Block> out(ciphertext_blocks<BlockBits>(m.plaintext.size()) + 1);
+        SipHash mac(m.macKey);
+        encrypt<BlockBits>(as_bytes_span(m.plaintext), out, make_cipher<BlockBits>(m.schedule), m.iv_block(), m.mode, m.threads,
+            m.authenticate ? &mac : nullptr);
+        span<const Block> blocks = span<const Block>(out).subspan(1);
+        string tag;
+        if (m.authenticate) {
+            MacTag t = mac.finalize();
+            tag.assign(t.begin(), t.end());
+        }
+        return make_pair(expected + m.tag(blocks), blocks_to_bytes<BlockBits>(out) + tag);
+    });
+    run.check(width + "decrypt", [](FuzzRandom& rng, string& what) {
+        FuzzMessage<BlockBits> m(rng, what);
+        string message = reference_encrypt(m.plaintext, m.keys, m.iv, m.mode);
+        vector<Block> blocks = bytes_to_blocks<BlockBits>(message.substr(BlockBits / 8));
+        string expected = reference_decrypt(message, m.keys, m.mode).substr(0, m.plaintext.size());
+        string out(m.plaintext.size(), '\0');
+        SipHash mac(m.macKey);
+        decrypt<BlockBits>(span<const Block>(blocks), m.iv_block(), as_writable_bytes_span(out), make_cipher<BlockBits>(m.schedule),
+            m.mode, m.threads, m.authenticate ? &mac : nullptr);
+        string tag;
+        if (m.authenticate) {
+            MacTag t = mac.finalize();
+            tag.assign(t.begin(), t.end());
+        }
+        return make_pair(expected + m.tag(blocks), out + tag);
+    });
+    // The hex format keeps no length: the whole blocks are decrypted and the zero padding trimmed
+    run.check(width + "hex trim", [](FuzzRandom& rng, string& what) {
+        FuzzMessage<BlockBits> m(rng, what);
+        string message = reference_encrypt(m.plaintext, m.keys, m.iv, m.mode);
+        vector<Block> blocks = bytes_to_blocks<BlockBits>(message.substr(BlockBits / 8));
+        string out(blocks.size() * (BlockBits / 8), '\0');
+        decrypt<BlockBits>(span<const Block>(blocks), m.iv_block(), as_writable_bytes_span(out), make_cipher<BlockBits>(m.schedule),
+            m.mode, m.threads);
+        out.resize(unpadded_length<BlockBits>(out));
+        return make_pair(reference_unpad(reference_decrypt(message, m.keys, m.mode), BlockBits / 8), out);
+    });
+    // The message in random pieces through EncryptStream, then the blocks through DecryptStream
+    run.check(width + "stream", [](FuzzRandom& rng, string& what) {
+        FuzzMessage<BlockBits> m(rng, what);
+        const auto cipher = make_cipher<BlockBits>(m.schedule);
+        auto pieceSize = [&] { return size_t(rng() % (rng() % 4 == 0 ? 100000 : 40)); };
+
+        string message = reference_encrypt(m.plaintext, m.keys, m.iv, m.mode);
+        vector<Block> expectedBlocks = bytes_to_blocks<BlockBits>(message.substr(BlockBits / 8));
+        string expected = message.substr(BlockBits / 8) + m.tag(expectedBlocks) + m.plaintext + m.tag(expectedBlocks);
+
+        string actual;
+        vector<Block> blocks, out;
+        SipHash encryptMac(m.macKey);
+        EncryptStream<BlockBits> encryptor(cipher, m.iv_block(), m.mode, m.threads, m.authenticate ? &encryptMac : nullptr);
+        for (size_t at = 0; at < m.plaintext.size();) {
+            size_t length = min(m.plaintext.size() - at, pieceSize());
+            encryptor.update(as_bytes_span(m.plaintext).subspan(at, length), out);
+            blocks.insert(blocks.end(), out.begin(), out.end());
+            at += length;
+        }
+        encryptor.finalize(out);
+        blocks.insert(blocks.end(), out.begin(), out.end());
+        actual += blocks_to_bytes<BlockBits>(blocks);
+        if (m.authenticate) {
+            MacTag t = encryptMac.finalize();
+            actual.append(t.begin(), t.end());
+        }
+
+        vector<uint8_t> bytes;
+        SipHash decryptMac(m.macKey);
+        DecryptStream<BlockBits> decryptor(cipher, m.iv_block(), m.plaintext.size(), m.mode, m.threads,
+            m.authenticate ? &decryptMac : nullptr);
+        for (size_t at = 0; at < expectedBlocks.size();) {
+            size_t count = min(expectedBlocks.size() - at, pieceSize());
+            decryptor.update(span<const Block>(expectedBlocks).subspan(at, count), bytes);
+            actual.append(bytes.begin(), bytes.end());
+            at += count;
+        }
+        decryptor.finalize();
+        if (m.authenticate) {
+            MacTag t = decryptMac.finalize();
+            actual.append(t.begin(), t.end());
+        }
+        return make_pair(expected, actual);
+    });
+    // An authenticated container with the flag cleared, the tag cut off and a
+    // ciphertext bit flipped still parses, and is refused once --auth asks for a tag
+    run.check(width + "tag strip", [](FuzzRandom& rng, string& what) {
+        FuzzMessage<BlockBits> m(rng, what);
+        vector<Block> out(ciphertext_blocks<BlockBits>(m.plaintext.size()) + 1);
+        span<const Block> blocks = span<const Block>(out).subspan(1);
+        ContainerHeader header = make_container_header<BlockBits>(m.mode, m.iv_block(), blocks.size(),
+            m.plaintext.size(), CONTAINER_FLAG_MAC);
+        string file(CONTAINER_HEADER_SIZE, '\0');
+        encode_container_header(header, reinterpret_cast<uint8_t*>(file.data()));
+        SipHash mac(m.schedule.mac_key());
+        mac.update(reinterpret_cast<const uint8_t*>(file.data()), file.size());
+        encrypt<BlockBits>(as_bytes_span(m.plaintext), out, make_cipher<BlockBits>(m.schedule), m.iv_block(), m.mode,
+            m.threads, &mac);
+        file += blocks_to_bytes<BlockBits>(blocks);
+        MacTag tag = mac.finalize();
+        string stripped = file;
+        file.append(tag.begin(), tag.end());
+
+        stripped[40] &= ~char(CONTAINER_FLAG_MAC);
+        if (!blocks.empty())
+            stripped[CONTAINER_HEADER_SIZE + rng() % blocks.size_bytes()] ^= char(1 << rng() % 8);
+
+        auto verdict = [](const string& bytes, bool requireMac) {
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(bytes.data());
+            ContainerHeader decoded = decode_container_header(data, bytes.size());
+            container_blocks<BlockBits>(decoded, data, bytes.size());
+            return string(container_authenticated(decoded, requireMac) ? "accepted " : "refused ");
+        };
+        return make_pair(string("accepted accepted refused "),
+            verdict(file, true) + verdict(stripped, false) + verdict(stripped, true));
+    });
+    set_simd_kernel(best_simd_kernel());
+}
 
-        char c1 = xored >> 8;
-        char c2 = xored & 0xFF;
-        result.push_back(c1);
-        if (c2 != '\0') result.push_back(c2);
+// encrypt and the hex decryption of 16-bit CBC blocks under the legacy key
+// and IV against the baseline (see reference.h)
+void fuzz_baseline(FuzzRun& run) {
+    using Block = BlockTraits<16>::Block;
+    const auto cipher = make_cipher<16>(KeySchedule::legacy());
+
+    run.check("baseline encrypt", [&](FuzzRandom& rng, string& what) {
+        string plaintext = random_bytes(rng, rng() % 2000);
+        unsigned threads = 1 + unsigned(rng() % 4);
+        what = to_string(plaintext.size()) + " bytes, " + to_string(threads) + " thread(s)";
+        fuzz_simd_kernel(rng, what);
+        vector<uint16_t> expected = baseline::encrypt(plaintext, baseline::KEYS);
+        vector<Block> out(ciphertext_blocks<16>(plaintext.size()) + 1);
+        encrypt<16>(as_bytes_span(plaintext), out, cipher, legacy_iv<16>(), Mode::CBC, threads);
+        return make_pair(blocks_to_bytes<16>(expected), blocks_to_bytes<16>(out));
+    });
+    run.check("baseline decrypt", [&](FuzzRandom& rng, string& what) {
+        string plaintext(rng() % 2000, '\0');
+        for (char& b : plaintext) b = char(1 + rng() % 255);
+        unsigned threads = 1 + unsigned(rng() % 4);
+        what = to_string(plaintext.size()) + " bytes without zeros, " + to_string(threads) + " thread(s)";
+        fuzz_simd_kernel(rng, what);
+        vector<uint16_t> message = baseline::encrypt(plaintext, baseline::KEYS);
+        span<const Block> blocks = span<const Block>(message).subspan(1);
+        string out(blocks.size() * 2, '\0');
+        decrypt<16>(blocks, message[0], as_writable_bytes_span(out), cipher, Mode::CBC, threads);
+        out.resize(unpadded_length<16>(out));
+        return make_pair(baseline::decrypt(message, baseline::KEYS), out);
+    });
+    set_simd_kernel(best_simd_kernel());
+}
 
-        // Update previous for next iteration
-        previous = encrypted;
+// Times a message of bytes bytes against the reference
+template <unsigned BlockBits>
+void measure_block_bits(FuzzRun& run, Mode mode, bool decrypting, const string& text, unsigned threads) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    const KeySchedule schedule = KeySchedule::legacy();
+    const auto roundKeys = schedule.round_keys<BlockBits>();
+    const vector<typename BlockTraits<BlockBits>::Half> keys(roundKeys.begin(), roundKeys.end());
+    const auto cipher = make_cipher<BlockBits>(schedule);
+    const Block iv = legacy_iv<BlockBits>();
+    const string ivBytes = blocks_to_bytes<BlockBits>(span<const Block>(&iv, 1));
+
+    const string message = reference_encrypt(text, keys, ivBytes, mode);
+    const vector<Block> blocks = bytes_to_blocks<BlockBits>(message.substr(BlockBits / 8));
+    vector<Block> out(blocks.size() + 1);
+    string plaintext(text.size(), '\0');
+    string sink;
+    const string kernel = to_string(BlockBits) + "-bit " + mode_name(mode) + (decrypting ? " decrypt" : " encrypt");
+    if (decrypting) {
+        run.measure(kernel, text.size(), [&] { sink = reference_decrypt(message, keys, mode); },
+            [&] { decrypt<BlockBits>(span<const Block>(blocks), iv, as_writable_bytes_span(plaintext), cipher, mode, threads); });
     }
-    return result;
+    else {
+        run.measure(kernel, text.size(), [&] { sink = reference_encrypt(text, keys, ivBytes, mode); },
+            [&] { encrypt<BlockBits>(as_bytes_span(text), out, cipher, iv, mode, threads); });
+    }
+}
+
+// Every block width and mode against the reference, and the legacy format
+// against the baseline (see reference.h and differential.h)
+int run_fuzz(int cases, uint64_t seed, const string& recordPath) {
+    FuzzRun run("lab6", cases, seed, "byte messages");
+    fuzz_block_bits<16>(run);
+    fuzz_block_bits<32>(run);
+    fuzz_block_bits<64>(run);
+    fuzz_block_bits<128>(run);
+    fuzz_baseline(run);
+
+    FuzzRandom rng(seed);
+    const string text = random_bytes(rng, size_t(4) << 20);
+    const unsigned threads = max(1u, thread::hardware_concurrency());
+    measure_block_bits<16>(run, Mode::CBC, false, text, threads);
+    measure_block_bits<16>(run, Mode::CBC, true, text, threads);
+    measure_block_bits<64>(run, Mode::CBC, false, text, threads);
+    measure_block_bits<128>(run, Mode::CTR, false, text, threads);
+    return run.finish(recordPath);
 }
 
-int main() {
+// Run fn with the block width as a compile-time constant
+template <typename Fn>
+int with_block_bits(unsigned blockBits, Fn fn) {
+    switch (blockBits) {
+    case 16: return fn(integral_constant<unsigned, 16>());
+    case 32: return fn(integral_constant<unsigned, 32>());
+    case 64: return fn(integral_constant<unsigned, 64>());
+    case 128: return fn(integral_constant<unsigned, 128>());
+    }
+    cerr << "Unsupported block size: " << blockBits << " (use 16, 32, 64 or 128)" << endl;
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    profiler_init();
+    console_init();
+
+    // 16-bit blocks keep the original file format
+    unsigned blockBits = 16;
+    Mode mode = Mode::CBC;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    bool hexOutput = false;
+    bool fixedIv = false;
+    bool binaryInput = false;
+    bool authenticate = false;
+    bool streaming = false;
+    KeySchedule schedule = KeySchedule::legacy();
+    int fuzzCases = 0;
+    uint64_t fuzzSeed = fuzz_seed();
+    string recordPath;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--block" && i + 1 < argc) {
+            blockBits = stoul(argv[++i]);
+        }
+        else if (arg == "--mode" && i + 1 < argc && parse_mode(argv[i + 1], mode)) {
+            i++;
+        }
+        else if (arg == "--threads" && i + 1 < argc) {
+            threads = max(1ul, stoul(argv[++i]));
+        }
+        else if (arg == "--kernel" && i + 1 < argc) {
+            string name = argv[++i];
+            bool found = false;
+            for (SimdKernel kernel : { SimdKernel::Scalar, SimdKernel::SSE2, SimdKernel::AVX2 }) {
+                if (name == simd_kernel_name(kernel)) found = set_simd_kernel(kernel);
+            }
+            if (!found) {
+                cerr << "Kernel '" << name << "' is not supported on this CPU" << endl;
+                return 1;
+            }
+        }
+        else if (arg == "--key" && i + 1 < argc) {
+            schedule = KeySchedule::from_passphrase(argv[++i]);
+        }
+        else if (arg == "--key-file" && i + 1 < argc) {
+            schedule = KeySchedule::from_key_file(argv[++i]);
+        }
+        else if (arg == "--fixed-iv") {
+            fixedIv = true;
+        }
+        else if (arg == "--auth") {
+            authenticate = true;
+        }
+        else if (arg == "--binary") {
+            binaryInput = true;
+        }
+        else if (arg == "--hex") {
+            hexOutput = true;
+        }
+        else if (arg == "--stream") {
+            streaming = true;
+        }
+        else if (arg == "--profile" && i + 1 < argc) {
+            string format = argv[++i];
+            profiler_enable(format == "json" ? ProfileFormat::Json : ProfileFormat::Text);
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            ConsoleMode consoleMode;
+            if (!parse_console_mode(argv[++i], consoleMode)) {
+                cerr << "Unknown output mode: " << argv[i] << " (use full, preview or quiet)" << endl;
+                return 1;
+            }
+            set_console_mode(consoleMode);
+        }
+        else if (arg == "--bench") {
+            return run_benchmark();
+        }
+        else if (arg == "--fuzz" && i + 1 < argc) {
+            fuzzCases = stoi(argv[++i]);
+        }
+        else if (arg == "--seed" && i + 1 < argc) {
+            fuzzSeed = stoull(argv[++i]);
+        }
+        else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        }
+        else {
+            cerr << "Usage: lab6 [--block 16|32|64|128] [--mode cbc|ecb|ctr] [--threads N]" << endl;
+            cerr << "            [--key PASSPHRASE | --key-file PATH] [--fixed-iv]" << endl;
+            cerr << "            [--auth] [--binary] [--hex | --stream] [--kernel scalar|sse2|avx2] [--bench]" << endl;
+            cerr << "            [--profile text|json] [--output full|preview|quiet]" << endl;
+            cerr << "            [--fuzz CASES [--seed N] [--record CSV]]" << endl;
+            return 1;
+        }
+    }
+    if (fuzzCases > 0) {
+        return run_fuzz(fuzzCases, fuzzSeed, recordPath);
+    }
+
     int choice;
-    cout << "=== Feistel cipher with CBC mode ===" << endl;
+    cout << "=== Feistel cipher with " << mode_name(mode) << " mode ===" << endl;
     cout << "1. Encryption" << endl;
     cout << "2. Decryption" << endl;
-    cout << "Choose an option (1 or 2): ";
+    cout << "3. Export binary ciphertext to hex" << endl;
+    cout << "Choose an option (1, 2 or 3): ";
     cin >> choice;
     cin.ignore();
 
@@ -135,28 +819,44 @@ int main() {
         string plaintextPath;
         cout << "\nEnter the path to the plaintext file: ";
         getline(cin, plaintextPath);
-        string plaintext = readFileContent(plaintextPath);
-        toLowerCase(plaintext);
-
-        cout << "\nPlaintext:\n" << plaintext << endl;
-
-        // Encrypt
-        vector<uint16_t> encrypted = encrypt(plaintext, KEYS);
-
-        cout << "\nEncrypted blocks (hex) [First block is IV]:\n";
-        printHexVector(encrypted);
-
-        // Save result
-        writeFileContent(OUTPUT_FILE_NAME, encrypted);
 
+        if (streaming && !hexOutput)
+            return with_block_bits(blockBits, [&](auto bits) { return run_encrypt_stream<bits>(plaintextPath, schedule, mode, threads, fixedIv, binaryInput, authenticate); });
+        return with_block_bits(blockBits, [&](auto bits) { return run_encrypt<bits>(plaintextPath, schedule, mode, threads, hexOutput, fixedIv, binaryInput, authenticate); });
     }
-    else if (choice == 2) {
+    else if (choice == 2 || choice == 3) {
         // --- Decrypting ---
         // Get the ciphertext
         string ciphertextPath;
         cout << "\nEnter the path to the ciphertext file: ";
         getline(cin, ciphertextPath);
-        string ciphertext = readFileContent(ciphertextPath);
+        ProfileScope mapStage("map");
+        MappedFile file(ciphertextPath);
+        mapStage.add_bytes(file.size());
+        mapStage.stop();
+
+        if (is_container(file.data(), file.size())) {
+            ContainerHeader header = decode_container_header(file.data(), file.size());
+            if (choice == 3)
+                return with_block_bits(header.blockBits, [&](auto bits) { return run_export_hex<bits>(file, header); });
+            if (!container_authenticated(header, authenticate)) {
+                cerr << "The container has no authentication tag!" << endl;
+                return 1;
+            }
+            if (streaming)
+                return with_block_bits(header.blockBits, [&](auto bits) { return run_decrypt_container_stream<bits>(file, header, schedule, threads); });
+            return with_block_bits(header.blockBits, [&](auto bits) { return run_decrypt_container<bits>(file, header, schedule, threads); });
+        }
+        if (choice == 3) {
+            cerr << "The ciphertext file is not a binary container!" << endl;
+            return 1;
+        }
+        if (authenticate) {
+            cerr << "The hex format has no authentication tag!" << endl;
+            return 1;
+        }
+
+        string ciphertext(reinterpret_cast<const char*>(file.data()), file.size());
 
         // Validate hex data
         if (!is_hex_encrypted(ciphertext)) {
@@ -164,25 +864,15 @@ int main() {
             return 1;
         }
 
-        // Parse hex data into blocks
-        vector<uint16_t> blocks;
+        // Block width is given by the width of the hex words
         stringstream ss(ciphertext);
-        string hexblock;
-        while (ss >> hexblock) {
-            uint16_t value = stoi(hexblock, nullptr, 16);
-            blocks.push_back(value);
+        string first;
+        if (!(ss >> first)) {
+            cerr << "The ciphertext file is empty!" << endl;
+            return 1;
         }
 
-        cout << "\nCiphertext [Encrypted blocks (hex)]:\n";
-        printHexVector(blocks);
-
-        // Decrypt
-        string decrypted = decrypt(blocks, KEYS);
-        cout << "\nDecrypted text: \n" << decrypted << endl;
-
-        // Save result
-        writeFileContent(OUTPUT_FILE_NAME, decrypted);
-
+        return with_block_bits(unsigned(first.size() * 4), [&](auto bits) { return run_decrypt_hex<bits>(ciphertext, schedule, mode, threads); });
     }
     else {
         cerr << "Invalid option!" << endl;
@@ -193,24 +883,34 @@ int main() {
 }
 
 // --- auxiliary ---
-string readFileContent(const string& filePath) {
-    ifstream file(filePath);
+string readFileContent(const string& filePath, bool binary) {
+    ProfileScope scope("read");
+    ifstream file(filePath, binary ? ios::binary : ios::in);
     if (!file.is_open()) throw runtime_error("Cannot open file to read: " + filePath);
-    return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    string content = read_whole_file(file);
+    scope.add_bytes(content.size());
+    return content;
 }
 
-void writeFileContent(const string& filePath, const string& content) {
-    ofstream out(filePath);
+void writeFileContent(const string& filePath, const string& content, bool binary) {
+    ProfileScope scope("write", content.size());
+    ofstream out(filePath, binary ? ios::binary : ios::out);
     if (!out.is_open()) throw runtime_error("Cannot open file to write: " + filePath);
     out << content;
 }
 
-void writeFileContent(const std::string& filePath, const std::vector<uint16_t>& blocks) {
+template <typename Block>
+void writeFileContent(const std::string& filePath, const std::vector<Block>& blocks) {
+    ProfileScope scope("write", blocks.size() * sizeof(Block));
     ofstream out(filePath);
     if (!out.is_open()) throw runtime_error("Cannot open file to write: " + filePath);
-    for (uint16_t b : blocks) {
-        out << hex << setw(4) << setfill('0') << b << " ";
+    string text;
+    text.reserve(blocks.size() * (sizeof(Block) * 2 + 1));
+    for (const Block& b : blocks) {
+        append_hex(text, b);
+        text += ' ';
     }
+    out << text;
 }
 
 void toUpperCase(string& text) {
@@ -220,6 +920,7 @@ void toUpperCase(string& text) {
 }
 
 void toLowerCase(string& text) {
+    ProfileScope scope("lowercase", text.size());
     for (char& c : text) {
         c = tolower((unsigned char)c);
     }
@@ -0,0 +1,69 @@
+#include <stdexcept>
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+#ifdef _WIN32
+MappedFile::MappedFile(const string& filePath) {
+    file = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        throw runtime_error("Cannot open file to read: " + filePath);
+    }
+
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length = size_t(fileSize.QuadPart);
+    if (length == 0) return; // empty files cannot be mapped
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping) bytes = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!bytes) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        throw runtime_error("Cannot map file: " + filePath);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+}
+#else
+MappedFile::MappedFile(const string& filePath) {
+    fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("Cannot open file to read: " + filePath);
+
+    struct stat st;
+    fstat(fd, &st);
+    length = size_t(st.st_size);
+    if (length == 0) return; // empty files cannot be mapped
+
+    void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        throw runtime_error("Cannot map file: " + filePath);
+    }
+    madvise(p, length, MADV_SEQUENTIAL);
+    bytes = static_cast<const uint8_t*>(p);
+}
+
+MappedFile::~MappedFile() {
+    if (bytes) munmap(const_cast<uint8_t*>(bytes), length);
+    if (fd >= 0) close(fd);
+}
+#endif
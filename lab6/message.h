@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+#include "feistel.h"
+#include "modes.h"
+#include "siphash.h"
+
+
+// Message-level encryption: byte message <-> IV + ciphertext blocks in one of
+// the block modes. Shared by the command-line tool and the lab7 service.
+
+// Ciphertext blocks (without the IV) for a plaintext of length bytes
+template <unsigned BlockBits>
+size_t ciphertext_blocks(size_t length) {
+    return (length + BlockBits / 8 - 1) / (BlockBits / 8);
+}
+
+// With a MAC the message is processed in chunks of this size: each chunk is
+// encrypted and fed to the MAC while it is still in cache
+const size_t STREAM_CHUNK_BYTES = size_t(1) << 20;
+
+// Encryption in the selected mode.
+// out must hold exactly ciphertext_blocks(plaintext.size()) + 1 blocks: IV slot first.
+// If mac is given, the ciphertext blocks are fed to it in the same pass.
+template <unsigned BlockBits>
+void encrypt(std::span<const uint8_t> plaintext, std::span<typename BlockTraits<BlockBits>::Block> out,
+    const FeistelCipher<BlockBits>& cipher, typename BlockTraits<BlockBits>::Block iv, Mode mode, unsigned threads,
+    SipHash* mac = nullptr) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    constexpr size_t blockBytes = BlockBits / 8;
+
+    if (out.size() != ciphertext_blocks<BlockBits>(plaintext.size()) + 1)
+        throw std::invalid_argument("encrypt: output span has the wrong size");
+
+    // IV as first block for decryption (ECB keeps the slot for a uniform format)
+    out[0] = iv;
+    std::span<Block> blocks = out.subspan(1);
+    size_t chunkBlocks = mac ? STREAM_CHUNK_BYTES / sizeof(Block) : std::max<size_t>(1, blocks.size());
+
+    for (size_t begin = 0; begin < blocks.size(); begin += chunkBlocks) {
+        std::span<Block> chunk = blocks.subspan(begin, std::min(chunkBlocks, blocks.size() - begin));
+
+        for (size_t i = 0; i < chunk.size(); i++) {
+            size_t offset = (begin + i) * blockBytes;
+            if (offset + blockBytes <= plaintext.size()) {
+                chunk[i] = load_block<BlockBits>(plaintext.data() + offset);
+                continue;
+            }
+            // Last block is padded with zero bytes
+            uint8_t buffer[blockBytes] = {};
+            std::copy(plaintext.begin() + offset, plaintext.end(), buffer);
+            chunk[i] = load_block<BlockBits>(buffer);
+        }
+
+        switch (mode) {
+        case Mode::CBC: cbc_encrypt(cipher, begin == 0 ? iv : blocks[begin - 1], chunk); break;
+        case Mode::ECB: ecb_encrypt(cipher, chunk, threads); break;
+        case Mode::CTR: ctr_crypt(cipher, iv, chunk, threads, begin); break;
+        }
+
+        if (mac) mac->update(reinterpret_cast<const uint8_t*>(chunk.data()), chunk.size_bytes());
+    }
+}
+
+// Decryption in the selected mode.
+// Writes exactly out.size() plaintext bytes (at most ciphertext.size() blocks worth).
+// If mac is given, every ciphertext chunk is fed to it right before it is decrypted.
+template <unsigned BlockBits>
+void decrypt(std::span<const typename BlockTraits<BlockBits>::Block> ciphertext, typename BlockTraits<BlockBits>::Block iv,
+    std::span<uint8_t> out, const FeistelCipher<BlockBits>& cipher, Mode mode, unsigned threads, SipHash* mac = nullptr) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    constexpr size_t blockBytes = BlockBits / 8;
+
+    if (ciphertext_blocks<BlockBits>(out.size()) > ciphertext.size())
+        throw std::invalid_argument("decrypt: plaintext length exceeds the ciphertext");
+
+    size_t chunkBlocks = mac ? STREAM_CHUNK_BYTES / sizeof(Block) : std::max<size_t>(1, ciphertext.size());
+    std::vector<Block> work(std::min(chunkBlocks, ciphertext.size()));
+
+    for (size_t begin = 0; begin < ciphertext.size(); begin += chunkBlocks) {
+        std::span<const Block> in = ciphertext.subspan(begin, std::min(chunkBlocks, ciphertext.size() - begin));
+        std::span<Block> chunk(work.data(), in.size());
+
+        if (mac) mac->update(reinterpret_cast<const uint8_t*>(in.data()), in.size_bytes());
+
+        switch (mode) {
+        case Mode::CBC:
+            cbc_decrypt(cipher, begin == 0 ? iv : ciphertext[begin - 1], in, chunk, threads);
+            break;
+        case Mode::ECB:
+            std::copy(in.begin(), in.end(), chunk.begin());
+            ecb_decrypt(cipher, chunk, threads);
+            break;
+        case Mode::CTR:
+            std::copy(in.begin(), in.end(), chunk.begin());
+            ctr_crypt(cipher, iv, chunk, threads, begin);
+            break;
+        }
+
+        for (size_t i = 0; i < chunk.size(); i++) {
+            size_t offset = (begin + i) * blockBytes;
+            if (offset >= out.size()) break;
+            if (offset + blockBytes <= out.size()) {
+                store_block<BlockBits>(out.data() + offset, chunk[i]);
+                continue;
+            }
+            uint8_t buffer[blockBytes];
+            store_block<BlockBits>(buffer, chunk[i]);
+            std::copy(buffer, buffer + (out.size() - offset), out.begin() + offset);
+        }
+    }
+}
+
+
+// Incremental forms of encrypt and decrypt for messages that do not fit in
+// memory: the data comes in pieces of any size and every call returns the
+// blocks (bytes) that are complete. Between calls a stream keeps only the
+// chain state of its mode (the previous ciphertext block for CBC, the block
+// counter for CTR) and, when encrypting, the bytes of an incomplete block.
+// The outputs put together are exactly those of the one-shot functions.
+
+template <unsigned BlockBits>
+class EncryptStream {
+public:
+    using Block = typename BlockTraits<BlockBits>::Block;
+    static constexpr size_t blockBytes = BlockBits / 8;
+
+    // cipher (and mac, if given) must outlive the stream
+    EncryptStream(const FeistelCipher<BlockBits>& cipher, Block iv, Mode mode, unsigned threads, SipHash* mac = nullptr)
+        : cipher(cipher), iv(iv), previous(iv), mode(mode), threads(threads), mac(mac) {}
+
+    // Ciphertext blocks of the whole blocks of the data so far, into out (replaced)
+    void update(std::span<const uint8_t> data, std::vector<Block>& out) {
+        out.clear();
+        out.reserve((tailSize + data.size()) / blockBytes);
+        size_t used = 0;
+        if (tailSize > 0) {
+            used = std::min(data.size(), blockBytes - tailSize);
+            std::copy_n(data.data(), used, tail + tailSize);
+            tailSize += used;
+            if (tailSize < blockBytes) return;
+            out.push_back(load_block<BlockBits>(tail));
+            tailSize = 0;
+        }
+        for (; used + blockBytes <= data.size(); used += blockBytes) out.push_back(load_block<BlockBits>(data.data() + used));
+        std::copy(data.begin() + used, data.end(), tail);
+        tailSize = data.size() - used;
+        process(out);
+    }
+
+    // The last block, padded with zero bytes, if the data did not end on a block
+    void finalize(std::vector<Block>& out) {
+        out.clear();
+        if (tailSize == 0) return;
+        std::fill(tail + tailSize, tail + blockBytes, uint8_t(0));
+        out.push_back(load_block<BlockBits>(tail));
+        tailSize = 0;
+        process(out);
+    }
+
+private:
+    const FeistelCipher<BlockBits>& cipher;
+    Block iv;
+    Block previous;
+    uint64_t counter = 0;
+    Mode mode;
+    unsigned threads;
+    SipHash* mac;
+    uint8_t tail[blockBytes] = {};
+    size_t tailSize = 0;
+
+    void process(std::span<Block> blocks) {
+        if (blocks.empty()) return;
+        switch (mode) {
+        case Mode::CBC: cbc_encrypt(cipher, previous, blocks); previous = blocks.back(); break;
+        case Mode::ECB: ecb_encrypt(cipher, blocks, threads); break;
+        case Mode::CTR: ctr_crypt(cipher, iv, blocks, threads, counter); break;
+        }
+        counter += blocks.size();
+        if (mac) mac->update(reinterpret_cast<const uint8_t*>(blocks.data()), blocks.size_bytes());
+    }
+};
+
+template <unsigned BlockBits>
+class DecryptStream {
+public:
+    using Block = typename BlockTraits<BlockBits>::Block;
+    static constexpr size_t blockBytes = BlockBits / 8;
+
+    // length: plaintext bytes of the whole message, as given to decrypt.
+    // cipher (and mac, if given) must outlive the stream
+    DecryptStream(const FeistelCipher<BlockBits>& cipher, Block iv, uint64_t length, Mode mode, unsigned threads,
+        SipHash* mac = nullptr)
+        : cipher(cipher), iv(iv), previous(iv), remaining(length), mode(mode), threads(threads), mac(mac) {}
+
+    // Plaintext of the next ciphertext blocks into out (replaced), up to the message length
+    void update(std::span<const Block> blocks, std::vector<uint8_t>& out) {
+        out.clear();
+        if (blocks.empty()) return;
+        if (mac) mac->update(reinterpret_cast<const uint8_t*>(blocks.data()), blocks.size_bytes());
+
+        work.resize(blocks.size());
+        switch (mode) {
+        case Mode::CBC:
+            cbc_decrypt(cipher, previous, blocks, std::span<Block>(work), threads);
+            previous = blocks.back();
+            break;
+        case Mode::ECB:
+            std::copy(blocks.begin(), blocks.end(), work.begin());
+            ecb_decrypt(cipher, std::span<Block>(work), threads);
+            break;
+        case Mode::CTR:
+            std::copy(blocks.begin(), blocks.end(), work.begin());
+            ctr_crypt(cipher, iv, std::span<Block>(work), threads, counter);
+            break;
+        }
+        counter += blocks.size();
+
+        const size_t bytes = size_t(std::min<uint64_t>(remaining, uint64_t(blocks.size()) * blockBytes));
+        out.resize(blocks.size() * blockBytes);
+        for (size_t i = 0; i < work.size(); i++) store_block<BlockBits>(out.data() + i * blockBytes, work[i]);
+        out.resize(bytes);
+        remaining -= bytes;
+    }
+
+    // Throws if the blocks were too few for the message length
+    void finalize() {
+        if (remaining > 0) throw std::invalid_argument("decrypt: plaintext length exceeds the ciphertext");
+    }
+
+private:
+    const FeistelCipher<BlockBits>& cipher;
+    Block iv;
+    Block previous;
+    uint64_t counter = 0;
+    uint64_t remaining;
+    Mode mode;
+    unsigned threads;
+    SipHash* mac;
+    std::vector<Block> work;
+};
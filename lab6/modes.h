@@ -0,0 +1,110 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "feistel.h"
+#include "../common/parallel_chunks.h"
+
+
+// Block cipher modes of operation
+enum class Mode : uint8_t { CBC = 0, ECB = 1, CTR = 2 };
+
+inline const char* mode_name(Mode mode) {
+    switch (mode) {
+    case Mode::CBC: return "CBC";
+    case Mode::ECB: return "ECB";
+    case Mode::CTR: return "CTR";
+    }
+    return "?";
+}
+
+inline bool parse_mode(const std::string& name, Mode& mode) {
+    if (name == "cbc") mode = Mode::CBC;
+    else if (name == "ecb") mode = Mode::ECB;
+    else if (name == "ctr") mode = Mode::CTR;
+    else return false;
+    return true;
+}
+
+
+// Spans shorter than this are not worth a thread
+const size_t MIN_BLOCKS_PER_THREAD = 16384;
+
+// Counter block for CTR mode: iv + index (mod 2^BlockBits)
+template <unsigned BlockBits>
+typename BlockTraits<BlockBits>::Block counter_block(typename BlockTraits<BlockBits>::Block iv, uint64_t index) {
+    if constexpr (BlockBits == 128) {
+        uint64_t lo = iv.lo + index;
+        return { lo, iv.hi + (lo < iv.lo ? 1 : 0) };
+    }
+    else {
+        return typename BlockTraits<BlockBits>::Block(iv + index);
+    }
+}
+
+
+// CBC encryption is a chain, so it always runs on one thread
+template <unsigned BlockBits, size_t Rounds>
+void cbc_encrypt(const FeistelCipher<BlockBits, Rounds>& cipher, typename BlockTraits<BlockBits>::Block iv,
+    std::span<typename BlockTraits<BlockBits>::Block> blocks) {
+    auto previous = iv;
+    for (auto& block : blocks) {
+        // XOR with previous ciphertext block (or IV for first block)
+        block = cipher.encrypt_block(block ^ previous);
+        previous = block;
+    }
+}
+
+// CBC decryption: P[i] = D(C[i]) ^ C[i - 1], so every chunk only needs
+// the ciphertext block right before it
+template <unsigned BlockBits, size_t Rounds>
+void cbc_decrypt(const FeistelCipher<BlockBits, Rounds>& cipher, typename BlockTraits<BlockBits>::Block iv,
+    std::span<const typename BlockTraits<BlockBits>::Block> in, std::span<typename BlockTraits<BlockBits>::Block> out,
+    unsigned threads) {
+    parallel_chunks(in.size(), threads, MIN_BLOCKS_PER_THREAD, [&](size_t begin, size_t end) {
+        std::copy(in.begin() + begin, in.begin() + end, out.begin() + begin);
+        cipher.decrypt_blocks(out.subspan(begin, end - begin));
+        for (size_t i = begin; i < end; i++) {
+            out[i] = out[i] ^ (i == 0 ? iv : in[i - 1]);
+        }
+    });
+}
+
+template <unsigned BlockBits, size_t Rounds>
+void ecb_encrypt(const FeistelCipher<BlockBits, Rounds>& cipher, std::span<typename BlockTraits<BlockBits>::Block> blocks,
+    unsigned threads) {
+    parallel_chunks(blocks.size(), threads, MIN_BLOCKS_PER_THREAD, [&](size_t begin, size_t end) {
+        cipher.encrypt_blocks(blocks.subspan(begin, end - begin));
+    });
+}
+
+template <unsigned BlockBits, size_t Rounds>
+void ecb_decrypt(const FeistelCipher<BlockBits, Rounds>& cipher, std::span<typename BlockTraits<BlockBits>::Block> blocks,
+    unsigned threads) {
+    parallel_chunks(blocks.size(), threads, MIN_BLOCKS_PER_THREAD, [&](size_t begin, size_t end) {
+        cipher.decrypt_blocks(blocks.subspan(begin, end - begin));
+    });
+}
+
+// CTR mode is its own inverse: block ^= E(iv + i).
+// firstCounter is the index of blocks[0] in the whole message.
+template <unsigned BlockBits, size_t Rounds>
+void ctr_crypt(const FeistelCipher<BlockBits, Rounds>& cipher, typename BlockTraits<BlockBits>::Block iv,
+    std::span<typename BlockTraits<BlockBits>::Block> blocks, unsigned threads, uint64_t firstCounter = 0) {
+    using Block = typename BlockTraits<BlockBits>::Block;
+    const size_t BATCH = 1024;
+
+    parallel_chunks(blocks.size(), threads, MIN_BLOCKS_PER_THREAD, [&](size_t begin, size_t end) {
+        Block keystream[BATCH];
+        for (size_t i = begin; i < end; i += BATCH) {
+            size_t n = std::min(BATCH, end - i);
+            for (size_t j = 0; j < n; j++) keystream[j] = counter_block<BlockBits>(iv, firstCounter + i + j);
+            cipher.encrypt_blocks(std::span<Block>(keystream, n));
+            for (size_t j = 0; j < n; j++) blocks[i + j] = blocks[i + j] ^ keystream[j];
+        }
+    });
+}
@@ -0,0 +1,249 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "modes.h"
+#include "../common/differential.h"
+
+
+// Reference Feistel cipher and modes, the oracle of --fuzz for every block
+// width, mode and key (see baseline below for the rest): one block at a
+// time, every block as big-endian bytes (left half first), the round keys
+// in a vector.
+
+// (half ^ key) + rotl1(half)
+template <typename Half>
+Half reference_f(Half half, Half key) {
+    const unsigned bits = sizeof(Half) * 8;
+    Half rotated = Half((half << 1) | (half >> (bits - 1)));
+    return Half((half ^ key) + rotated);
+}
+
+template <typename Half>
+Half reference_load_half(const uint8_t* p) {
+    Half v = 0;
+    for (size_t i = 0; i < sizeof(Half); i++) v = Half((uint64_t(v) << 8) | p[i]);
+    return v;
+}
+
+template <typename Half>
+void reference_store_half(uint8_t* p, Half v) {
+    for (size_t i = 0; i < sizeof(Half); i++) p[i] = uint8_t(uint64_t(v) >> (8 * (sizeof(Half) - 1 - i)));
+}
+
+// The block of 2 * sizeof(Half) bytes at block, in place
+template <typename Half>
+void feistel_encrypt_block(uint8_t* block, const std::vector<Half>& keys) {
+    Half L = reference_load_half<Half>(block);
+    Half R = reference_load_half<Half>(block + sizeof(Half));
+
+    for (Half key : keys) {
+        Half newL = R;
+        Half newR = Half(L ^ reference_f(R, key));
+        L = newL;
+        R = newR;
+    }
+    reference_store_half(block, L);
+    reference_store_half(block + sizeof(Half), R);
+}
+
+template <typename Half>
+void feistel_decrypt_block(uint8_t* block, const std::vector<Half>& keys) {
+    Half L = reference_load_half<Half>(block);
+    Half R = reference_load_half<Half>(block + sizeof(Half));
+
+    for (size_t i = keys.size(); i-- > 0;) {
+        Half newR = L;
+        Half newL = Half(R ^ reference_f(L, keys[i]));
+        L = newL;
+        R = newR;
+    }
+    reference_store_half(block, L);
+    reference_store_half(block + sizeof(Half), R);
+}
+
+// block + index, the block read as a big-endian number (mod 2^bits)
+inline std::string reference_counter(std::string block, uint64_t index) {
+    unsigned carry = 0;
+    for (size_t i = block.size(); i-- > 0;) {
+        unsigned sum = uint8_t(block[i]) + unsigned(index & 0xFF) + carry;
+        block[i] = char(uint8_t(sum));
+        carry = sum >> 8;
+        index >>= 8;
+    }
+    return block;
+}
+
+inline std::string reference_xor(std::string a, const std::string& b) {
+    for (size_t i = 0; i < a.size(); i++) a[i] = char(a[i] ^ b[i]);
+    return a;
+}
+
+// The IV, then the plaintext padded with zero bytes to whole blocks, encrypted in mode
+template <typename Half>
+std::string reference_encrypt(const std::string& plaintext, const std::vector<Half>& keys, const std::string& iv, Mode mode) {
+    const size_t blockBytes = 2 * sizeof(Half);
+    std::string padded = plaintext;
+    while (padded.size() % blockBytes != 0) padded += '\0';
+
+    std::string result = iv;
+    std::string previous = iv;
+    for (size_t offset = 0; offset < padded.size(); offset += blockBytes) {
+        std::string block = padded.substr(offset, blockBytes);
+        if (mode == Mode::CBC) {
+            block = reference_xor(block, previous);
+            feistel_encrypt_block(reinterpret_cast<uint8_t*>(block.data()), keys);
+            previous = block;
+        }
+        else if (mode == Mode::ECB) {
+            feistel_encrypt_block(reinterpret_cast<uint8_t*>(block.data()), keys);
+        }
+        else {
+            std::string keystream = reference_counter(iv, offset / blockBytes);
+            feistel_encrypt_block(reinterpret_cast<uint8_t*>(keystream.data()), keys);
+            block = reference_xor(block, keystream);
+        }
+        result += block;
+    }
+    return result;
+}
+
+// Every block of a message (IV first) decrypted, padding included
+template <typename Half>
+std::string reference_decrypt(const std::string& message, const std::vector<Half>& keys, Mode mode) {
+    const size_t blockBytes = 2 * sizeof(Half);
+    const std::string iv = message.substr(0, blockBytes);
+
+    std::string result;
+    std::string previous = iv;
+    for (size_t offset = blockBytes; offset < message.size(); offset += blockBytes) {
+        std::string block = message.substr(offset, blockBytes);
+        if (mode == Mode::CBC) {
+            std::string encrypted = block;
+            feistel_decrypt_block(reinterpret_cast<uint8_t*>(block.data()), keys);
+            block = reference_xor(block, previous);
+            previous = encrypted;
+        }
+        else if (mode == Mode::ECB) {
+            feistel_decrypt_block(reinterpret_cast<uint8_t*>(block.data()), keys);
+        }
+        else {
+            std::string keystream = reference_counter(iv, offset / blockBytes - 1);
+            feistel_encrypt_block(reinterpret_cast<uint8_t*>(keystream.data()), keys);
+            block = reference_xor(block, keystream);
+        }
+        result += block;
+    }
+    return result;
+}
+
+// Hex format: trailing zero bytes of the last block are dropped, but never its first byte
+inline std::string reference_unpad(std::string decrypted, size_t blockBytes) {
+    const size_t lastBlock = decrypted.size() >= blockBytes ? decrypted.size() - blockBytes : 0;
+    while (decrypted.size() > lastBlock + 1 && decrypted.back() == '\0') decrypted.pop_back();
+    return decrypted;
+}
+
+
+// The Feistel cipher and CBC mode of the baseline lab6, copied as they were
+// (only made inline), the oracle of --fuzz for 16-bit blocks under its keys
+// and IV. Its encryption pads the last block with a zero byte, and its
+// decryption drops the second byte of a block when it is zero. The lab now
+// differs from it on purpose in this case only:
+//  - a zero byte inside the plaintext: the baseline drops it from the
+//    second half of any block, the hex format now trims the padding of the
+//    last block only (see unpadded_length in lab6.cpp); the decryption
+//    check leaves zero bytes out of the plaintext
+namespace baseline {
+using namespace std;
+
+// 8 keys (by 1 byte)
+inline vector<uint8_t> KEYS = { 15, 23, 71, 99, 201, 50, 77, 5 };
+
+// Add Initialization Vector (IV)
+const uint16_t INITIALIZATION_VECTOR = 0x1234; // Or generate randomly
+
+inline uint8_t F(uint8_t half, uint8_t key) {
+    return (half ^ key) + ((half << 1) | (half >> 7));
+}
+
+inline uint16_t feistel_encrypt_block(uint16_t block, const vector<uint8_t>& keys) {
+    uint8_t L = block >> 8;
+    uint8_t R = block & 0xFF;
+
+    for (uint8_t key : keys) {
+        uint8_t newL = R;
+        uint8_t newR = L ^ F(R, key);
+        L = newL;
+        R = newR;
+    }
+    return (uint16_t(L) << 8) | R;
+}
+
+inline uint16_t feistel_decrypt_block(uint16_t block, const vector<uint8_t>& keys) {
+    uint8_t L = block >> 8;
+    uint8_t R = block & 0xFF;
+
+    for (int i = keys.size() - 1; i >= 0; i--) {
+        uint8_t newR = L;
+        uint8_t newL = R ^ F(L, keys[i]);
+        L = newL;
+        R = newR;
+    }
+    return (uint16_t(L) << 8) | R;
+}
+
+// CBC mode encryption
+inline vector<uint16_t> encrypt(const string& text, const vector<uint8_t>& keys) {
+    vector<uint16_t> blocks;
+    uint16_t previous = INITIALIZATION_VECTOR;
+
+    for (size_t i = 0; i < text.size(); i += 2) {
+        uint8_t c1 = text[i];
+        uint8_t c2 = (i + 1 < text.size()) ? text[i + 1] : 0;
+        uint16_t block = (uint16_t(c1) << 8) | c2;
+
+        // XOR with previous ciphertext block (or IV for first block)
+        uint16_t xored = block ^ previous;
+
+        // Encrypt the XORed block
+        uint16_t encrypted = feistel_encrypt_block(xored, keys);
+        blocks.push_back(encrypted);
+
+        // Update previous for next iteration
+        previous = encrypted;
+    }
+
+    // Add IV as first block for decryption
+    blocks.insert(blocks.begin(), INITIALIZATION_VECTOR);
+    return blocks;
+}
+
+// CBC mode decryption
+inline string decrypt(const vector<uint16_t>& blocks_with_iv, const vector<uint8_t>& keys) {
+    if (blocks_with_iv.empty()) return "";
+
+    string result;
+    uint16_t previous = blocks_with_iv[0]; // First block is IV
+
+    for (size_t i = 1; i < blocks_with_iv.size(); i++) {
+        uint16_t encrypted = blocks_with_iv[i];
+
+        // Decrypt the block
+        uint16_t decrypted = feistel_decrypt_block(encrypted, keys);
+
+        // XOR with previous ciphertext block (or IV for first data block)
+        uint16_t xored = decrypted ^ previous;
+
+        char c1 = xored >> 8;
+        char c2 = xored & 0xFF;
+        result.push_back(c1);
+        if (c2 != '\0') result.push_back(c2);
+
+        // Update previous for next iteration
+        previous = encrypted;
+    }
+    return result;
+}
+}
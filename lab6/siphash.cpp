@@ -0,0 +1,101 @@
+#include <bit>
+#include <cstring>
+#include "siphash.h"
+
+using namespace std;
+
+
+static inline uint64_t rotl(uint64_t x, int b) {
+    return (x << b) | (x >> (64 - b));
+}
+
+static inline uint64_t load_le64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    if constexpr (endian::native == endian::big) {
+        uint64_t r = 0;
+        for (int i = 0; i < 8; i++) r = (r << 8) | ((v >> (8 * i)) & 0xFF);
+        v = r;
+    }
+    return v;
+}
+
+#define SIPROUND                                                    \
+    do {                                                            \
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);   \
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;                      \
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;                      \
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);   \
+    } while (0)
+
+
+SipHash::SipHash(const MacKey& key)
+    : v0(key[0] ^ 0x736f6d6570736575ULL),
+      v1(key[1] ^ 0x646f72616e646f6dULL),
+      v2(key[0] ^ 0x6c7967656e657261ULL),
+      v3(key[1] ^ 0x7465646279746573ULL) {
+}
+
+void SipHash::compress(uint64_t m) {
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+}
+
+void SipHash::update(const uint8_t* data, size_t size) {
+    total += size;
+
+    // Complete a word left over from the previous call
+    if (tailSize > 0) {
+        size_t n = min(size, 8 - tailSize);
+        memcpy(tail + tailSize, data, n);
+        tailSize += n;
+        data += n;
+        size -= n;
+        if (tailSize < 8) return;
+        compress(load_le64(tail));
+        tailSize = 0;
+    }
+
+    // Bulk words: the state lives in locals, otherwise the byte pointer
+    // may alias it and force a store after every word
+    uint64_t v0 = this->v0, v1 = this->v1, v2 = this->v2, v3 = this->v3;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t m = load_le64(data);
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+    this->v0 = v0;
+    this->v1 = v1;
+    this->v2 = v2;
+    this->v3 = v3;
+
+    memcpy(tail, data, size);
+    tailSize = size;
+}
+
+MacTag SipHash::finalize() {
+    uint64_t b = uint64_t(total) << 56;
+    for (size_t i = 0; i < tailSize; i++) b |= uint64_t(tail[i]) << (8 * i);
+    compress(b);
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    uint64_t h = v0 ^ v1 ^ v2 ^ v3;
+
+    MacTag tag;
+    for (size_t i = 0; i < MAC_TAG_SIZE; i++) tag[i] = uint8_t(h >> (8 * i));
+    return tag;
+}
+
+bool tags_equal(const MacTag& a, const uint8_t* b) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < MAC_TAG_SIZE; i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
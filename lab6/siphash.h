@@ -0,0 +1,30 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+const size_t MAC_TAG_SIZE = 8;
+using MacKey = std::array<uint64_t, 2>;
+using MacTag = std::array<uint8_t, MAC_TAG_SIZE>;
+
+// Streaming SipHash-2-4 (64-bit tag) keyed with 128 bits.
+// Data can be fed in pieces of any size; the result equals a one-shot hash.
+class SipHash {
+public:
+    explicit SipHash(const MacKey& key);
+
+    void update(const uint8_t* data, size_t size);
+    MacTag finalize();
+
+private:
+    uint64_t v0, v1, v2, v3;
+    uint8_t tail[8] = {};
+    size_t tailSize = 0;
+    uint64_t total = 0;
+
+    void compress(uint64_t m);
+};
+
+// Constant-time tag comparison
+bool tags_equal(const MacTag& a, const uint8_t* b);
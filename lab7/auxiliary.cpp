@@ -0,0 +1,46 @@
+#include <fstream>
+#include <string>
+#include <stdexcept>
+#include "auxiliary.h"
+#include "../common/alphabet.h"
+#include "../common/profiler.h"
+#include "../common/read_file.h"
+
+using namespace std;
+
+
+string readFileContent(const string& filePath, bool binary) {
+    ProfileScope scope("read");
+    ifstream file(filePath, binary ? ios::binary : ios::in);
+
+    if (!file.is_open())
+        throw runtime_error("Cannot open file to read: " + filePath);
+
+    string content = read_whole_file(file);
+    scope.add_bytes(content.size());
+    return content;
+}
+
+
+void writeFileContent(const string& filePath, const string& content, bool binary) {
+    ProfileScope scope("write", content.size());
+    ofstream out(filePath, binary ? ios::binary : ios::out);
+
+    if (!out.is_open())
+        throw runtime_error("Cannot open file to write: " + filePath);
+
+    out << content;
+    if (!out)
+        throw runtime_error("Cannot write file: " + filePath);
+}
+
+
+void toUpperCase(string& text) {
+    ProfileScope scope("uppercase", text.size());
+    to_upper_utf8(text);
+}
+
+void toLowerCase(string& text) {
+    ProfileScope scope("lowercase", text.size());
+    to_lower_utf8(text);
+}
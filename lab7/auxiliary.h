@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+
+std::string readFileContent(const std::string& filePath, bool binary = false);
+
+void writeFileContent(const std::string& filePath, const std::string& content, bool binary = false);
+
+void toUpperCase(std::string& text);
+
+void toLowerCase(std::string& text);
@@ -0,0 +1,361 @@
+#include <algorithm>
+#include <sstream>
+#include <string_view>
+#include <stdexcept>
+#include <vector>
+#include "cipher_context.h"
+#include "auxiliary.h"
+#include "../common/alphabet.h"
+#include "../common/arena.h"
+#include "../common/cipher_engines.h"
+#include "../common/profiler.h"
+#include "../lab5/hill_cipher.h"
+#include "../lab5/key_file.h"
+#include "../lab6/container.h"
+#include "../lab6/key_schedule.h"
+#include "../lab6/mapped_file.h"
+#include "../lab6/message.h"
+
+using namespace std;
+
+
+// Keys of the original substitution tool (lab3) for the built-in alphabets
+const string SUBSTITUTION_KEY = "mtufvwz .qcdebjhrikyxlna,g'op-s;";
+const string UKRAINIAN_SUBSTITUTION_KEY = "дзпгомкивбюіфчйрхяї;с штеєн,'цщаґьуж.-л";
+
+// Every job runs on one pool thread: the parallelism is across jobs
+const unsigned FEISTEL_JOB_THREADS = 1;
+
+
+static void require_no_options(const Job& job) {
+    if (!job.options.empty()) throw runtime_error("Cipher '" + job.cipher + "' takes no options");
+}
+
+
+// Text ciphers of lab2-lab5: the input is lowercased like in the original tools
+class TextContext : public CipherContext {
+public:
+    void run(const Job& job) const override {
+        require_no_options(job);
+        string text = readFileContent(job.inputPath);
+        toLowerCase(text);
+        writeFileContent(job.outputPath, transform(job.op, text));
+    }
+
+protected:
+    virtual string transform(JobOp op, const string& text) const = 0;
+};
+
+
+// Caesar and substitution ciphers map every symbol on its own: one index table per direction
+class TableContext : public TextContext {
+public:
+    // Caesar shift (lab2)
+    static shared_ptr<const CipherContext> caesar(const string& key) {
+        int shift;
+        size_t used = 0;
+        try {
+            shift = stoi(key, &used);
+        }
+        catch (...) {
+            used = 0;
+        }
+        if (used == 0 || used != key.size()) throw runtime_error("Caesar key must be an integer shift: '" + key + "'");
+        const int size = lab_alphabet().size();
+        shift = ((shift % size) + size) % size;
+
+        auto context = make_shared<TableContext>();
+        for (int i = 0; i < size; i++) {
+            int to = (i + shift) % size;
+            context->forward[i] = to;
+            context->backward[to] = i;
+        }
+        return context;
+    }
+
+    // Substitution with a permutation of the alphabet (lab3); "default" is the lab3 key
+    static shared_ptr<const CipherContext> substitution(const string& key) {
+        const Alphabet& alphabet = lab_alphabet();
+        string cryptoAlphabet = key;
+        if (key.empty() || key == "default") {
+            if (lab_alphabet_name() == "custom") throw runtime_error("There is no default substitution key for a custom alphabet");
+            cryptoAlphabet = lab_alphabet_name() == "ukrainian" ? UKRAINIAN_SUBSTITUTION_KEY : SUBSTITUTION_KEY;
+        }
+        toLowerCase(cryptoAlphabet);
+
+        auto context = make_shared<TableContext>();
+        // lab3 shows the characters it cannot decrypt in upper case
+        context->upperCaseOthers = true;
+        bool valid = false;
+        try {
+            // Distinct symbols, as many as in the alphabet, all from the alphabet
+            Alphabet crypto(cryptoAlphabet);
+            valid = crypto.size() == alphabet.size();
+            for (int i = 0; valid && i < alphabet.size(); i++) {
+                int to = alphabet.index(crypto.symbol(i));
+                valid = to >= 0;
+                if (valid) {
+                    context->forward[i] = to;
+                    context->backward[to] = i;
+                }
+            }
+        }
+        catch (const runtime_error&) {
+        }
+        if (!valid) throw runtime_error("Substitution key must be a permutation of \"" + alphabet.str() + "\"");
+        return context;
+    }
+
+    TableContext() : forward(lab_alphabet().size()), backward(lab_alphabet().size()) {}
+
+protected:
+    string transform(JobOp op, const string& text) const override {
+        return with_lookup([&](auto lookup) { return transform<lookup>(op, text); });
+    }
+
+private:
+    vector<int> forward;
+    vector<int> backward;
+    bool upperCaseOthers = false;
+
+    // With Lookup::ConstantTime the table is read whole for every symbol
+    template <Lookup L>
+    string transform(JobOp op, const string& text) const {
+        const Alphabet& alphabet = lab_alphabet();
+        const vector<int>& entries = op == JobOp::Encrypt ? forward : backward;
+        const CtTable<ALPHABET_MAX> ctTable(entries);
+        auto table = [&](int i) {
+            if constexpr (L == Lookup::Fast) return entries[i];
+            else return ctTable[size_t(i)];
+        };
+        if (op == JobOp::Encrypt || !upperCaseOthers) {
+            return alphabet.transform<L>(text, table);
+        }
+
+        string result;
+        result.reserve(text.size());
+        alphabet.for_each<L>(text,
+            [&](int i, string_view) {
+                char symbol[4];
+                result.append(symbol, alphabet.encode<L>(table(i), symbol));
+            },
+            [&](string_view c) {
+                size_t at = result.size();
+                result += c;
+                to_upper_utf8(result.data() + at, c.size());
+            });
+        return result;
+    }
+};
+
+
+// Vigenere cipher (lab4): key letters are looked up once
+class VigenereContext : public TextContext {
+public:
+    explicit VigenereContext(const string& key) {
+        const int size = lab_alphabet().size();
+        lab_alphabet().scan(key, [&](int pos) {
+            encryptShifts.push_back(pos);
+            decryptShifts.push_back((size - pos) % size);
+        });
+        if (encryptShifts.empty()) throw runtime_error("Vigenere key has no characters of the alphabet");
+    }
+
+protected:
+    // Same walk as lab4: key characters outside the alphabet are dropped,
+    // text characters outside it are copied and do not advance the key
+    string transform(JobOp op, const string& text) const override {
+        string result = vigenere(lab_alphabet(), text, op == JobOp::Encrypt ? encryptShifts : decryptShifts);
+        toUpperCase(result);
+        return result;
+    }
+
+private:
+    vector<int> encryptShifts;
+    vector<int> decryptShifts;
+};
+
+
+// Hill cipher (lab5): the inverse matrix is computed once per key.
+// The key is the matrix with rows separated by ';', e.g. "3 3;2 5", or
+// "@" and the path of a lab5 key file (a binary one has the inverse stored).
+class HillContext : public TextContext {
+public:
+    explicit HillContext(const string& key)
+        : cipher(key.rfind('@', 0) == 0 ? loadKeyFile(key.substr(1)) : HillCipher(parse(key))) {}
+
+protected:
+    string transform(JobOp op, const string& text) const override {
+        JobArena arena(cipher.workspaceSize(text.size()));
+        string result = op == JobOp::Encrypt ? cipher.encrypt(text, arena.get()) : cipher.decrypt(text, arena.get());
+        toUpperCase(result);
+        return result;
+    }
+
+private:
+    HillCipher cipher;
+
+    static vector<vector<int>> parse(string key) {
+        replace(key.begin(), key.end(), ';', '\n');
+        int n;
+        return parseKeyMatrix(key, n);
+    }
+};
+
+
+// Feistel cipher (lab6): the passphrase KDF is the expensive part and runs
+// once per key. Encryption writes the lab6 container; decryption reads
+// any container lab6 writes. Files are taken as raw bytes.
+// Options: cbc|ecb|ctr, 16|32|64|128 (block bits), auth. Decryption takes
+// only auth, which refuses a container without a tag.
+class FeistelContext : public CipherContext {
+public:
+    explicit FeistelContext(const string& key)
+        : schedule(key.empty() || key == "-" ? KeySchedule::legacy() : KeySchedule::from_passphrase(key)),
+          macKey(schedule.mac_key()),
+          cipher16(make_cipher<16>(schedule)) {
+    }
+
+    void run(const Job& job) const override {
+        if (job.op == JobOp::Decrypt) {
+            if (!job.options.empty() && job.options != "auth")
+                throw runtime_error("Decryption takes its options from the container (only auth is allowed)");
+            MappedFile file(job.inputPath);
+            ContainerHeader header = decode_container_header(file.data(), file.size());
+            if (!container_authenticated(header, job.options == "auth"))
+                throw runtime_error("The container has no authentication tag");
+            with_block_bits(header.blockBits, [&](auto bits) { decrypt_file<bits>(file, header, job.outputPath); });
+            return;
+        }
+
+        Mode mode = Mode::CBC;
+        unsigned blockBits = 16;
+        bool authenticate = false;
+        stringstream ss(job.options);
+        string option;
+        while (getline(ss, option, ',')) {
+            if (option == "auth") authenticate = true;
+            else if (option == "16" || option == "32" || option == "64" || option == "128") blockBits = stoi(option);
+            else if (!parse_mode(option, mode)) throw runtime_error("Unknown feistel option '" + option + "'");
+        }
+        with_block_bits(blockBits, [&](auto bits) { encrypt_file<bits>(job, mode, authenticate); });
+    }
+
+private:
+    KeySchedule schedule;
+    MacKey macKey;
+    FeistelCipher<16> cipher16;
+
+    template <typename Fn>
+    static void with_block_bits(unsigned bits, Fn&& fn) {
+        switch (bits) {
+        case 16: fn(integral_constant<unsigned, 16>()); break;
+        case 32: fn(integral_constant<unsigned, 32>()); break;
+        case 64: fn(integral_constant<unsigned, 64>()); break;
+        case 128: fn(integral_constant<unsigned, 128>()); break;
+        default: throw runtime_error("Unsupported block size " + to_string(bits));
+        }
+    }
+
+    // The 16-bit cipher is kept; the wider ones only expand round keys from the schedule
+    template <unsigned BlockBits>
+    FeistelCipher<BlockBits> cipher() const {
+        if constexpr (BlockBits == 16) return cipher16;
+        else return make_cipher<BlockBits>(schedule);
+    }
+
+    template <unsigned BlockBits>
+    void encrypt_file(const Job& job, Mode mode, bool authenticate) const {
+        using Block = typename BlockTraits<BlockBits>::Block;
+
+        string plaintext = readFileContent(job.inputPath, true);
+        span<const uint8_t> bytes(reinterpret_cast<const uint8_t*>(plaintext.data()), plaintext.size());
+
+        auto iv = random_iv<BlockBits>();
+        vector<Block> encrypted(ciphertext_blocks<BlockBits>(plaintext.size()) + 1);
+        span<const Block> blocks(encrypted.data() + 1, encrypted.size() - 1);
+        ContainerHeader header = make_container_header<BlockBits>(mode, iv, blocks.size(), plaintext.size(),
+            authenticate ? CONTAINER_FLAG_MAC : 0);
+
+        if (!authenticate) {
+            encrypt<BlockBits>(bytes, encrypted, cipher<BlockBits>(), iv, mode, FEISTEL_JOB_THREADS);
+            write_container<BlockBits>(job.outputPath, header, blocks);
+            return;
+        }
+
+        uint8_t rawHeader[CONTAINER_HEADER_SIZE];
+        encode_container_header(header, rawHeader);
+        SipHash mac(macKey);
+        mac.update(rawHeader, sizeof(rawHeader));
+        encrypt<BlockBits>(bytes, encrypted, cipher<BlockBits>(), iv, mode, FEISTEL_JOB_THREADS, &mac);
+        MacTag tag = mac.finalize();
+        write_container<BlockBits>(job.outputPath, header, blocks, &tag);
+    }
+
+    template <unsigned BlockBits>
+    void decrypt_file(const MappedFile& file, const ContainerHeader& header, const string& outputPath) const {
+        auto blocks = container_blocks<BlockBits>(header, file.data(), file.size());
+        string decrypted(size_t(header.length), '\0');
+        span<uint8_t> out(reinterpret_cast<uint8_t*>(decrypted.data()), decrypted.size());
+
+        if (header.flags & CONTAINER_FLAG_MAC) {
+            SipHash mac(macKey);
+            mac.update(file.data(), CONTAINER_HEADER_SIZE);
+            decrypt<BlockBits>(blocks, container_iv<BlockBits>(header), out, cipher<BlockBits>(), header.mode,
+                FEISTEL_JOB_THREADS, &mac);
+            if (!tags_equal(mac.finalize(), container_tag(header, file.data())))
+                throw runtime_error("Authentication failed: the ciphertext was modified or the key is wrong");
+        }
+        else {
+            decrypt<BlockBits>(blocks, container_iv<BlockBits>(header), out, cipher<BlockBits>(), header.mode,
+                FEISTEL_JOB_THREADS);
+        }
+        writeFileContent(outputPath, decrypted, true);
+    }
+};
+
+
+shared_ptr<const CipherContext> make_context(const string& cipher, const string& key) {
+    if (cipher == "caesar") return TableContext::caesar(key);
+    if (cipher == "substitution") return TableContext::substitution(key);
+    if (cipher == "vigenere") return make_shared<VigenereContext>(key);
+    if (cipher == "hill") return make_shared<HillContext>(key);
+    if (cipher == "feistel") return make_shared<FeistelContext>(key);
+    throw runtime_error("Unknown cipher '" + cipher + "'");
+}
+
+
+shared_ptr<const CipherContext> KeyCache::get(const string& cipher, const string& key) {
+    string cacheKey = cipher + '\n' + key;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        auto it = index.find(cacheKey);
+        if (it != index.end()) {
+            entries.splice(entries.begin(), entries, it->second);
+            hitCount++;
+            return it->second->second;
+        }
+    }
+
+    missCount++;
+    ProfileScope scope("key setup");
+    shared_ptr<const CipherContext> context = make_context(cipher, key);
+    scope.stop();
+
+    lock_guard<mutex> lock(cacheMutex);
+    auto it = index.find(cacheKey);
+    if (it != index.end()) return it->second->second;
+
+    entries.emplace_front(cacheKey, context);
+    index[cacheKey] = entries.begin();
+    if (entries.size() > capacity) {
+        index.erase(entries.back().first);
+        entries.pop_back();
+    }
+    return context;
+}
+
+size_t KeyCache::size() const {
+    lock_guard<mutex> lock(cacheMutex);
+    return entries.size();
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+
+enum class JobOp { Encrypt, Decrypt };
+
+// One file to encrypt or decrypt
+struct Job {
+    JobOp op = JobOp::Encrypt;
+    std::string cipher;   // caesar, substitution, vigenere, hill, feistel
+    std::string options;  // cipher specific, e.g. "ctr,auth" for feistel
+    std::string key;
+    std::string inputPath;
+    std::string outputPath;
+};
+
+// Everything a cipher derives from its key (tables, inverse matrix, round
+// keys), prepared once. Read-only after construction: jobs on different
+// threads share one context.
+class CipherContext {
+public:
+    virtual ~CipherContext() = default;
+
+    // Reads job.inputPath and writes job.outputPath; throws runtime_error
+    virtual void run(const Job& job) const = 0;
+};
+
+// Throws runtime_error for an unknown cipher or an invalid key
+std::shared_ptr<const CipherContext> make_context(const std::string& cipher, const std::string& key);
+
+
+// Recently used contexts, keyed by cipher and key. A miss builds the context
+// outside the lock: two jobs that miss on the same key at once both build it
+// and the first one to finish is kept.
+class KeyCache {
+public:
+    explicit KeyCache(size_t capacity) : capacity(capacity > 0 ? capacity : 1) {}
+
+    std::shared_ptr<const CipherContext> get(const std::string& cipher, const std::string& key);
+
+    size_t hits() const { return hitCount.load(); }
+    size_t misses() const { return missCount.load(); }
+    size_t size() const;
+
+private:
+    using Entry = std::pair<std::string, std::shared_ptr<const CipherContext>>;
+
+    size_t capacity;
+    mutable std::mutex cacheMutex;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+    std::atomic<size_t> hitCount{ 0 };
+    std::atomic<size_t> missCount{ 0 };
+};
@@ -4,60 +4,463 @@
 #include <iomanip>
 #include <fstream>
 #include <sstream>
-#include <cctype>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "auxiliary.h"
+#include "cipher_context.h"
+#include "local_socket.h"
+#include "../common/console_log.h"
+#include "../common/profiler.h"
+#include "../common/thread_pool.h"
 
 using namespace std;
 
 
-#define OUTPUT_FILE_NAME "output.txt"
+#define SOCKET_FILE_NAME "lab7.sock"
 
+// Prepared keys kept warm between jobs
+const size_t KEY_CACHE_SIZE = 64;
 
-std::string readFileContent(const std::string& filePath);
 
-void writeFileContent(const std::string& filePath, const std::string& content);
+// File encryption service.
+//
+// Requests are lines of tab-separated fields:
+//
+//   encrypt <cipher>[:<options>] <key> <input path> <output path>
+//   decrypt <cipher>[:<options>] <key> <input path> <output path>
+//   stats
+//   shutdown
+//
+// Ciphers: caesar (key: shift), substitution (key: permuted alphabet or
+// "default"), vigenere (key: word), hill (key: matrix rows separated by ';',
+// or @path of a lab5 key file), feistel (key: passphrase, "-" for the
+// built-in key; options: cbc|ecb|ctr, 16|32|64|128, auth; decrypt takes
+// only auth, to refuse a container without a tag).
+//
+// Every request gets one reply line, in request order:
+//
+//   OK job=<id> wait_ms=<time in queue> run_ms=<time to run> allocs=<heap allocations>
+//   ERR job=<id> <message>
+//
+// A connection may send many requests before reading: the jobs run in
+// parallel on the pool and the replies come back as they are ready.
 
-void toUpperCase(std::string& text);
 
-void toLowerCase(std::string& text);
+static vector<string> split_fields(const string& line) {
+    vector<string> fields;
+    stringstream ss(line);
+    string field;
+    while (getline(ss, field, '\t')) fields.push_back(field);
+    return fields;
+}
+
+static string join_fields(const vector<string>& fields) {
+    string line;
+    for (size_t i = 0; i < fields.size(); i++) {
+        if (i > 0) line += '\t';
+        line += fields[i];
+    }
+    return line;
+}
 
+static bool is_job_request(const vector<string>& fields) {
+    return fields.size() == 5 && (fields[0] == "encrypt" || fields[0] == "decrypt");
+}
 
+static Job parse_job(const vector<string>& fields) {
+    if (!is_job_request(fields))
+        throw runtime_error("Expected: encrypt|decrypt <cipher> <key> <input> <output> (tab-separated)");
 
-int main()
-{
-    std::cout << "Hello World!\n";
+    Job job;
+    job.op = fields[0] == "encrypt" ? JobOp::Encrypt : JobOp::Decrypt;
+    size_t colon = fields[1].find(':');
+    job.cipher = fields[1].substr(0, colon);
+    if (colon != string::npos) job.options = fields[1].substr(colon + 1);
+    job.key = fields[2];
+    job.inputPath = fields[3];
+    job.outputPath = fields[4];
+    return job;
+}
+
+static future<string> ready_reply(const string& reply) {
+    promise<string> p;
+    p.set_value(reply);
+    return p.get_future();
+}
+
+static double to_ms(chrono::steady_clock::duration d) {
+    return chrono::duration<double, milli>(d).count();
+}
+
+
+class Service {
+public:
+    Service(unsigned threads, size_t cacheSize) : cache(cacheSize), pool(threads) {}
+
+    // The future holds the reply line of the request
+    future<string> submit(const string& request) {
+        Job job;
+        try {
+            job = parse_job(split_fields(request));
+        }
+        catch (const exception& e) {
+            return ready_reply(string("ERR ") + e.what());
+        }
+
+        uint64_t id = nextJobId++;
+        submitted++;
+        auto reply = make_shared<promise<string>>();
+        future<string> result = reply->get_future();
+        auto queuedAt = chrono::steady_clock::now();
+        pool.submit([this, id, job = move(job), queuedAt, reply] {
+            reply->set_value(run_job(id, job, queuedAt));
+        });
+        return result;
+    }
+
+    string stats() const {
+        uint64_t done = completed + failed;
+        ostringstream out;
+        out << fixed << setprecision(3)
+            << "OK submitted=" << submitted << " completed=" << completed << " failed=" << failed
+            << " queued=" << pool.queued() << " running=" << pool.busy() << " workers=" << pool.size()
+            << " avg_latency_ms=" << (done ? totalLatencyUs / 1000.0 / done : 0.0)
+            << " max_latency_ms=" << maxLatencyUs / 1000.0
+            << " cache_hits=" << cache.hits() << " cache_misses=" << cache.misses() << " cache_size=" << cache.size();
+        return out.str();
+    }
+
+private:
+    KeyCache cache;
+
+    atomic<uint64_t> nextJobId{ 1 };
+    atomic<uint64_t> submitted{ 0 };
+    atomic<uint64_t> completed{ 0 };
+    atomic<uint64_t> failed{ 0 };
+    atomic<uint64_t> totalLatencyUs{ 0 };
+    atomic<uint64_t> maxLatencyUs{ 0 };
+
+    // Declared last: destroyed first, so queued jobs still see the cache and counters
+    ThreadPool pool;
+
+    string run_job(uint64_t id, const Job& job, chrono::steady_clock::time_point queuedAt) {
+        auto startedAt = chrono::steady_clock::now();
+        uint64_t startAllocations = thread_allocation_count();
+        string error;
+        try {
+            ProfileScope scope("job");
+            cache.get(job.cipher, job.key)->run(job);
+        }
+        catch (const exception& e) {
+            error = e.what();
+        }
+        auto finishedAt = chrono::steady_clock::now();
+        uint64_t allocations = thread_allocation_count() - startAllocations;
+
+        uint64_t latencyUs = uint64_t(chrono::duration_cast<chrono::microseconds>(finishedAt - queuedAt).count());
+        totalLatencyUs += latencyUs;
+        uint64_t seen = maxLatencyUs;
+        while (latencyUs > seen && !maxLatencyUs.compare_exchange_weak(seen, latencyUs)) {
+        }
+
+        ostringstream out;
+        if (!error.empty()) {
+            failed++;
+            out << "ERR job=" << id << " " << error;
+            return out.str();
+        }
+        completed++;
+        out << fixed << setprecision(3) << "OK job=" << id
+            << " wait_ms=" << to_ms(startedAt - queuedAt) << " run_ms=" << to_ms(finishedAt - startedAt)
+            << " allocs=" << allocations;
+        return out.str();
+    }
+};
+
+
+struct ServerState {
+    string socketPath;
+    atomic<bool> stopping{ false };
+    mutex connectionsMutex;
+    condition_variable connectionsDone;
+    int connections = 0;
+    set<LocalSocket*> reading; // connections that may be blocked in read_line
+};
+
+// Stops reading on every open connection, so that an idle client does not
+// hold up the shutdown; replies already queued are still written
+static void stop_reading(ServerState& server) {
+    lock_guard<mutex> lock(server.connectionsMutex);
+    for (LocalSocket* connection : server.reading) connection->shutdown_read();
+}
+
+// Reads requests until the client closes its side; a second thread writes
+// the replies in request order as the jobs finish
+static void serve_connection(LocalSocket& connection, Service& service, ServerState& server) {
+    mutex repliesMutex;
+    condition_variable repliesReady;
+    deque<future<string>> replies;
+    bool endOfRequests = false;
+
+    thread writer([&] {
+        bool peerGone = false;
+        while (true) {
+            future<string> reply;
+            {
+                unique_lock<mutex> lock(repliesMutex);
+                repliesReady.wait(lock, [&] { return !replies.empty() || endOfRequests; });
+                if (replies.empty()) return;
+                reply = move(replies.front());
+                replies.pop_front();
+            }
+            // The job runs to the end even if nobody is there to read the reply
+            string line = reply.get() + "\n";
+            if (peerGone) continue;
+            try {
+                connection.write_all(line);
+            }
+            catch (const exception&) {
+                peerGone = true;
+            }
+        }
+    });
+
+    // Registered before stopping is checked: a connection that comes in
+    // during the shutdown either sees stopping or is reached by stop_reading
+    {
+        lock_guard<mutex> lock(server.connectionsMutex);
+        server.reading.insert(&connection);
+    }
+
+    string line;
+    while (!server.stopping && connection.read_line(line)) {
+        if (line.empty()) continue;
+
+        future<string> reply;
+        if (line == "stats") {
+            reply = ready_reply(service.stats());
+        }
+        else if (line == "shutdown") {
+            server.stopping = true;
+            reply = ready_reply("OK shutting down");
+            stop_reading(server);
+            // Wake the accept loop up
+            try {
+                LocalSocket::connect(server.socketPath);
+            }
+            catch (const exception&) {
+            }
+        }
+        else {
+            reply = service.submit(line);
+        }
+
+        lock_guard<mutex> lock(repliesMutex);
+        replies.push_back(move(reply));
+        repliesReady.notify_one();
+    }
+
+    {
+        lock_guard<mutex> lock(server.connectionsMutex);
+        server.reading.erase(&connection);
+    }
+    {
+        lock_guard<mutex> lock(repliesMutex);
+        endOfRequests = true;
+    }
+    repliesReady.notify_one();
+    writer.join();
 }
 
+static int run_server(const string& socketPath, unsigned threads, size_t cacheSize) {
+    Service service(threads, cacheSize);
+    ServerState server;
+    server.socketPath = socketPath;
 
+    LocalSocket listener;
+    try {
+        listener = LocalSocket::listen(socketPath);
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+    cout << "Listening on " << socketPath << " (" << max(1u, threads) << " workers)" << endl;
 
-// --- auxiliary ---
-string readFileContent(const string& filePath) {
-    ifstream file(filePath);
+    while (!server.stopping) {
+        LocalSocket client;
+        try {
+            client = listener.accept();
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+            break;
+        }
+        if (server.stopping) break;
+
+        {
+            lock_guard<mutex> lock(server.connectionsMutex);
+            server.connections++;
+        }
+        thread([client = move(client), &service, &server]() mutable {
+            serve_connection(client, service, server);
+            client.close();
+            lock_guard<mutex> lock(server.connectionsMutex);
+            server.connections--;
+            server.connectionsDone.notify_all();
+        }).detach();
+    }
 
-    if (!file.is_open())
-        throw runtime_error("Cannot open file to read: " + filePath);
+    // Let open connections receive their replies
+    {
+        unique_lock<mutex> lock(server.connectionsMutex);
+        server.connectionsDone.wait(lock, [&] { return server.connections == 0; });
+    }
+    listener.close();
+    remove(socketPath.c_str());
 
-    return string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    cout << service.stats() << endl;
+    return 0;
 }
 
+// Sends the request lines of input and prints the replies. Relative paths
+// are made absolute: the service resolves them in its own directory.
+static int run_client(const string& socketPath, istream& input) {
+    LocalSocket connection;
+    try {
+        connection = LocalSocket::connect(socketPath);
 
-void writeFileContent(const string& filePath, const string& content) {
-    ofstream out(filePath);
+        string line;
+        while (getline(input, line)) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
 
-    if (!out.is_open())
-        throw runtime_error("Cannot open file to write: " + filePath);
+            vector<string> fields = split_fields(line);
+            if (is_job_request(fields)) {
+                fields[3] = filesystem::absolute(fields[3]).string();
+                fields[4] = filesystem::absolute(fields[4]).string();
+                line = join_fields(fields);
+            }
+            connection.write_all(line + "\n");
+        }
+        connection.shutdown_write();
+    }
+    catch (const exception& e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
 
-    out << content;
+    int errors = 0;
+    string reply;
+    while (connection.read_line(reply)) {
+        console_write(reply + "\n");
+        if (reply.rfind("OK", 0) != 0) errors++;
+    }
+    return errors == 0 ? 0 : 1;
 }
 
+// Shutdown with an idle client: one client connects and sends nothing while
+// another sends "shutdown"; the service has to stop on its own
+static int run_self_test() {
+    const string socketPath = (filesystem::temp_directory_path() / "lab7-self-test.sock").string();
+    auto stopped = make_shared<promise<int>>();
+    future<int> result = stopped->get_future();
+    thread([socketPath, stopped] { stopped->set_value(run_server(socketPath, 1, KEY_CACHE_SIZE)); }).detach();
 
-void toUpperCase(string& text) {
-    for (char& c : text) {
-        c = toupper((unsigned char)c);
+    LocalSocket idle;
+    for (int attempt = 0; !idle.valid() && attempt < 100; attempt++) {
+        try {
+            idle = LocalSocket::connect(socketPath);
+        }
+        catch (const exception&) {
+            this_thread::sleep_for(chrono::milliseconds(20));
+        }
     }
+    if (!idle.valid()) {
+        cerr << "The service did not start on " << socketPath << endl;
+        return 1;
+    }
+
+    stringstream requests("shutdown\n");
+    if (run_client(socketPath, requests) != 0) return 1;
+    bool stoppedInTime = result.wait_for(chrono::seconds(5)) == future_status::ready;
+    cout << "Shutdown with an idle client: " << (stoppedInTime ? "ok" : "FAILED (the service still waits for it)") << endl;
+    return stoppedInTime ? 0 : 1;
 }
 
-void toLowerCase(string& text) {
-    for (char& c : text) {
-        c = tolower((unsigned char)c);
+
+int main(int argc, char* argv[])
+{
+    profiler_init();
+    console_init();
+
+    string socketPath = SOCKET_FILE_NAME;
+    unsigned threads = max(1u, thread::hardware_concurrency());
+    size_t cacheSize = KEY_CACHE_SIZE;
+    int command = 0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--serve") command = 1;
+        else if (arg == "--submit") command = 2;
+        else if (arg == "--self-test") command = 3;
+        else if (arg == "--socket" && i + 1 < argc) socketPath = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) threads = unsigned(stoul(argv[++i]));
+        else if (arg == "--cache" && i + 1 < argc) cacheSize = size_t(stoul(argv[++i]));
+        else if (arg == "--profile" && i + 1 < argc) {
+            string format = argv[++i];
+            profiler_enable(format == "json" ? ProfileFormat::Json : ProfileFormat::Text);
+        }
+        else {
+            cerr << "Usage: lab7 [--serve | --submit | --self-test] [--socket PATH] [--threads N] [--cache N] [--profile text|json]" << endl;
+            return 1;
+        }
+    }
+
+    // Batch use: requests on stdin
+    if (command == 1) return run_server(socketPath, threads, cacheSize);
+    if (command == 2) return run_client(socketPath, cin);
+    if (command == 3) return run_self_test();
+
+    int choice;
+
+    cout << "=== File encryption service ===" << endl;
+    cout << "1. Start the service" << endl;
+    cout << "2. Submit requests from a file" << endl;
+    cout << "Choose an option (1 or 2): ";
+    cin >> choice;
+    cin.ignore();
+
+    if (choice == 1) {
+        return run_server(socketPath, threads, cacheSize);
+    }
+    else if (choice == 2) {
+        string requestsPath;
+
+        cout << "\nEnter the path to the requests file: ";
+        getline(cin, requestsPath);
+
+        stringstream requests;
+        try {
+            requests << readFileContent(requestsPath);
+        }
+        catch (const exception& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+        return run_client(socketPath, requests);
     }
-}
\ No newline at end of file
+    else {
+        cerr << "Invalid option!" << endl;
+        return 1;
+    }
+}
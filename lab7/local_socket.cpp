@@ -0,0 +1,162 @@
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include "local_socket.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+#ifdef _WIN32
+static void close_handle(uintptr_t handle) {
+    closesocket(SOCKET(handle));
+}
+
+static void init_sockets() {
+    static once_flag once;
+    call_once(once, [] {
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) throw runtime_error("Cannot initialize Winsock");
+    });
+}
+
+const int SEND_FLAGS = 0;
+const int SHUT_WRITE = SD_SEND;
+const int SHUT_READ = SD_RECEIVE;
+#else
+static void close_handle(int handle) {
+    ::close(handle);
+}
+
+static void init_sockets() {
+}
+
+// A vanished client must not kill the service with SIGPIPE
+const int SEND_FLAGS = MSG_NOSIGNAL;
+const int SHUT_WRITE = SHUT_WR;
+const int SHUT_READ = SHUT_RD;
+#endif
+
+static sockaddr_un make_address(const string& path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) throw runtime_error("Socket path is too long: " + path);
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+
+LocalSocket::~LocalSocket() {
+    close();
+}
+
+LocalSocket::LocalSocket(LocalSocket&& other) noexcept
+    : handle(exchange(other.handle, INVALID)), buffer(move(other.buffer)), bufferPos(other.bufferPos) {
+}
+
+LocalSocket& LocalSocket::operator=(LocalSocket&& other) noexcept {
+    if (this != &other) {
+        close();
+        handle = exchange(other.handle, INVALID);
+        buffer = move(other.buffer);
+        bufferPos = other.bufferPos;
+    }
+    return *this;
+}
+
+LocalSocket LocalSocket::listen(const string& path) {
+    init_sockets();
+    sockaddr_un address = make_address(path);
+
+    LocalSocket socket(Handle(::socket(AF_UNIX, SOCK_STREAM, 0)));
+    if (!socket.valid()) throw runtime_error("Cannot create socket");
+
+    remove(path.c_str());
+    if (::bind(socket.handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        throw runtime_error("Cannot bind socket: " + path);
+    if (::listen(socket.handle, SOMAXCONN) != 0) throw runtime_error("Cannot listen on socket: " + path);
+    return socket;
+}
+
+LocalSocket LocalSocket::connect(const string& path) {
+    init_sockets();
+    sockaddr_un address = make_address(path);
+
+    LocalSocket socket(Handle(::socket(AF_UNIX, SOCK_STREAM, 0)));
+    if (!socket.valid()) throw runtime_error("Cannot create socket");
+    if (::connect(socket.handle, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+        throw runtime_error("Cannot connect to " + path + " (is the service running?)");
+    return socket;
+}
+
+LocalSocket LocalSocket::accept() const {
+    Handle client = Handle(::accept(handle, nullptr, nullptr));
+    if (client == INVALID) throw runtime_error("Cannot accept a connection");
+    return LocalSocket(client);
+}
+
+bool LocalSocket::valid() const {
+    return handle != INVALID;
+}
+
+bool LocalSocket::read_line(string& line) {
+    while (true) {
+        size_t end = buffer.find('\n', bufferPos);
+        if (end != string::npos) {
+            line.assign(buffer, bufferPos, end - bufferPos);
+            bufferPos = end + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            return true;
+        }
+
+        buffer.erase(0, bufferPos);
+        bufferPos = 0;
+
+        char chunk[4096];
+        int received = int(::recv(handle, chunk, sizeof(chunk), 0));
+        if (received <= 0) {
+            // An unterminated last line still counts
+            if (buffer.empty()) return false;
+            line = move(buffer);
+            buffer.clear();
+            return true;
+        }
+        buffer.append(chunk, size_t(received));
+    }
+}
+
+void LocalSocket::write_all(const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        int n = int(::send(handle, data.data() + sent, int(data.size() - sent), SEND_FLAGS));
+        if (n <= 0) throw runtime_error("Connection closed by peer");
+        sent += size_t(n);
+    }
+}
+
+void LocalSocket::shutdown_write() {
+    ::shutdown(handle, SHUT_WRITE);
+}
+
+void LocalSocket::shutdown_read() {
+    ::shutdown(handle, SHUT_READ);
+}
+
+void LocalSocket::close() {
+    if (valid()) close_handle(handle);
+    handle = INVALID;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+
+// Stream socket in the AF_UNIX (local) domain. Windows 10 and later provide
+// AF_UNIX through afunix.h, so the same code serves both platforms.
+class LocalSocket {
+public:
+    LocalSocket() = default;
+    ~LocalSocket();
+
+    LocalSocket(LocalSocket&& other) noexcept;
+    LocalSocket& operator=(LocalSocket&& other) noexcept;
+    LocalSocket(const LocalSocket&) = delete;
+    LocalSocket& operator=(const LocalSocket&) = delete;
+
+    // Binds and listens at path (a stale socket file is replaced)
+    static LocalSocket listen(const std::string& path);
+    static LocalSocket connect(const std::string& path);
+
+    LocalSocket accept() const;
+
+    bool valid() const;
+
+    // Next '\n'-terminated line without the terminator; false at end of stream
+    bool read_line(std::string& line);
+
+    // Throws runtime_error if the peer is gone
+    void write_all(const std::string& data);
+
+    // Signals end of stream to the peer, reading is still possible
+    void shutdown_write();
+
+    // Ends reading: a read_line blocked on another thread returns false,
+    // writing is still possible
+    void shutdown_read();
+
+    void close();
+
+private:
+#ifdef _WIN32
+    using Handle = uintptr_t;
+#else
+    using Handle = int;
+#endif
+    static constexpr Handle INVALID = Handle(-1);
+
+    explicit LocalSocket(Handle handle) : handle(handle) {}
+
+    Handle handle = INVALID;
+    std::string buffer;
+    size_t bufferPos = 0;
+};